@@ -0,0 +1,297 @@
+#include "devices/ktimer.h"
+#include <debug.h>
+#include "devices/timer.h"
+#include "threads/cpu.h"
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+
+/* Timer wheels.
+
+   This is the classic hierarchical timer wheel [Varghese].  A
+   timer goes into the lowest level whose span covers its delay,
+   in the slot for its expiry tick.  Adding and cancelling thus
+   take constant time.  Each tick, the wheel runs the timers in
+   the level 0 slot for that tick.  When the tick starts a new
+   span of a higher level, the timers in that level's slot for
+   the span are first moved down into lower levels, where they
+   now fit.  Each timer moves at most WHEEL_LEVELS - 1 times. */
+
+static struct timer_wheel *lock_own_wheel (void);
+static void add_timer (struct timer_wheel *, struct ktimer *,
+                       int64_t expires);
+static void enqueue (struct timer_wheel *, struct ktimer *);
+static void cascade (struct timer_wheel *, int level, size_t slot);
+static int64_t next_expiry (struct timer_wheel *);
+static void wake_thread (struct ktimer *, void *thread);
+
+/* Initializes timer T to call FUNC with AUX when it expires. */
+void
+ktimer_init (struct ktimer *t, ktimer_func *func, void *aux)
+{
+  ASSERT (t != NULL);
+  ASSERT (func != NULL);
+
+  t->cpu = NULL;
+  t->func = func;
+  t->aux = aux;
+}
+
+/* Adds timer T, which must not be pending, to the running CPU's
+   wheel, to expire at tick EXPIRES.  T runs on this CPU, at the
+   first timer interrupt at or after tick EXPIRES.  If EXPIRES
+   has already passed, T runs at the next tick. */
+void
+ktimer_add (struct ktimer *t, int64_t expires)
+{
+  ASSERT (!ktimer_pending (t));
+
+  struct timer_wheel *w = lock_own_wheel ();
+  add_timer (w, t, expires);
+  spinlock_release (&w->lock);
+}
+
+/* Cancels timer T.  Returns true if T was pending, false if it
+   had already expired or was never added.  In the latter case
+   T's function may still be running on another CPU. */
+bool
+ktimer_cancel (struct ktimer *t)
+{
+  for (;;)
+    {
+      struct cpu *c = t->cpu;
+      barrier ();
+      if (c == NULL)
+        return false;
+
+      spinlock_acquire (&c->wheel.lock);
+      if (t->cpu == c)
+        {
+          list_remove (&t->elem);
+          t->cpu = NULL;
+          c->wheel.timer_cnt--;
+          spinlock_release (&c->wheel.lock);
+          return true;
+        }
+
+      /* T expired, and may have been added again, while we were
+         acquiring the lock. */
+      spinlock_release (&c->wheel.lock);
+    }
+}
+
+/* Returns true if timer T has been added and has not expired or
+   been cancelled yet. */
+bool
+ktimer_pending (const struct ktimer *t)
+{
+  return t->cpu != NULL;
+}
+
+/* Initializes the timer wheel of CPU C, which must be the
+   running CPU, starting at the current tick. */
+void
+ktimer_init_cpu (struct cpu *c)
+{
+  struct timer_wheel *w = &c->wheel;
+
+  spinlock_init (&w->lock);
+  w->clk = timer_ticks ();
+  w->timer_cnt = 0;
+  for (int level = 0; level < WHEEL_LEVELS; level++)
+    for (size_t slot = 0; slot < WHEEL_SLOTS; slot++)
+      list_init (&w->slots[level][slot]);
+}
+
+/* Runs the running CPU's timers that are due.  Called by the
+   timer interrupt handler. */
+void
+ktimer_run (void)
+{
+  struct timer_wheel *w = lock_own_wheel ();
+  int64_t now = timer_ticks ();
+
+  /* After the CPU's tick was stopped, skip straight to the first
+     tick that has anything to do. */
+  if (now - w->clk > 1)
+    {
+      int64_t next = next_expiry (w);
+      if (next > w->clk)
+        w->clk = next < now ? next : now;
+    }
+
+  while (w->clk <= now)
+    {
+      int64_t clk = w->clk;
+      struct list *expired = &w->slots[0][clk & (WHEEL_SLOTS - 1)];
+
+      for (int level = 1; level < WHEEL_LEVELS; level++)
+        {
+          int shift = WHEEL_BITS * level;
+          if ((clk & (((int64_t) 1 << shift) - 1)) != 0)
+            break;
+          cascade (w, level, (clk >> shift) & (WHEEL_SLOTS - 1));
+        }
+
+      w->clk++;
+      while (!list_empty (expired))
+        {
+          struct ktimer *t = list_entry (list_pop_front (expired),
+                                         struct ktimer, elem);
+          t->cpu = NULL;
+          w->timer_cnt--;
+
+          /* Release the lock so that T's function can add timers. */
+          spinlock_release (&w->lock);
+          t->func (t, t->aux);
+          spinlock_acquire (&w->lock);
+        }
+    }
+  spinlock_release (&w->lock);
+}
+
+/* Returns the first tick at which the running CPU's wheel has
+   work to do, or KTIMER_NONE if no timer is pending.  This is
+   either the expiry of a timer or the tick at which some timers
+   move down to a lower level. */
+int64_t
+ktimer_next_expiry (void)
+{
+  struct timer_wheel *w = lock_own_wheel ();
+  int64_t next = next_expiry (w);
+  spinlock_release (&w->lock);
+  return next;
+}
+
+/* Blocks the running thread until tick EXPIRES.  The thread is
+   woken up by the running CPU. */
+void
+ktimer_sleep_until (int64_t expires)
+{
+  struct ktimer timer;
+
+  ASSERT (!intr_context ());
+
+  ktimer_init (&timer, wake_thread, thread_current ());
+
+  /* Holding the wheel's lock keeps interrupts off until the thread
+     has blocked, so that it cannot be woken up before. */
+  struct timer_wheel *w = lock_own_wheel ();
+  add_timer (w, &timer, expires);
+  thread_block (&w->lock);
+  spinlock_release (&w->lock);
+}
+
+/* Acquires the running CPU's wheel's lock and returns the
+   wheel. */
+static struct timer_wheel *
+lock_own_wheel (void)
+{
+  intr_disable_push ();
+  struct timer_wheel *w = &get_cpu ()->wheel;
+  spinlock_acquire (&w->lock);
+  intr_enable_pop ();
+  return w;
+}
+
+/* Adds T to W, which must be the running CPU's locked wheel, to
+   expire at tick EXPIRES. */
+static void
+add_timer (struct timer_wheel *w, struct ktimer *t, int64_t expires)
+{
+  ASSERT (spinlock_held_by_current_cpu (&w->lock));
+
+  t->expires = expires;
+  t->cpu = get_cpu ();
+  w->timer_cnt++;
+  enqueue (w, t);
+
+  /* The CPU may have stopped its tick. */
+  timer_wake_at (expires);
+}
+
+/* Puts T into the slot of W where it belongs, given W's current
+   tick. */
+static void
+enqueue (struct timer_wheel *w, struct ktimer *t)
+{
+  const int64_t span = (int64_t) 1 << (WHEEL_BITS * WHEEL_LEVELS);
+  int64_t expires = t->expires;
+  int level;
+
+  /* A timer that is already due runs at the next tick processed.
+     One that is too far ahead waits at the end of the last level
+     until it comes within reach. */
+  if (expires < w->clk)
+    expires = w->clk;
+  else if (expires - w->clk >= span)
+    expires = w->clk + span - 1;
+
+  for (level = 0; level < WHEEL_LEVELS - 1; level++)
+    if (expires - w->clk < (int64_t) 1 << (WHEEL_BITS * (level + 1)))
+      break;
+  list_push_back (&w->slots[level][(expires >> (WHEEL_BITS * level))
+                                   & (WHEEL_SLOTS - 1)],
+                  &t->elem);
+}
+
+/* Moves the timers in SLOT of LEVEL of W down to lower levels. */
+static void
+cascade (struct timer_wheel *w, int level, size_t slot)
+{
+  struct list *list = &w->slots[level][slot];
+
+  /* None of the timers goes back into the same slot, because
+     SLOT's span has just begun. */
+  while (!list_empty (list))
+    enqueue (w, list_entry (list_pop_front (list), struct ktimer, elem));
+}
+
+/* Returns the first tick at or after W's current tick at which W
+   has work to do, or KTIMER_NONE if W is empty. */
+static int64_t
+next_expiry (struct timer_wheel *w)
+{
+  int64_t next = KTIMER_NONE;
+
+  if (w->timer_cnt == 0)
+    return next;
+
+  /* Level 0 has one slot per tick. */
+  for (int64_t i = 0; i < WHEEL_SLOTS; i++)
+    if (!list_empty (&w->slots[0][(w->clk + i) & (WHEEL_SLOTS - 1)]))
+      {
+        next = w->clk + i;
+        break;
+      }
+
+  /* A slot of a higher level has work when its span begins.  The
+     slot whose span is under way was emptied at its start, so any
+     timers in it wait for its next turn. */
+  for (int level = 1; level < WHEEL_LEVELS; level++)
+    {
+      int shift = WHEEL_BITS * level;
+      int64_t span = w->clk >> shift;
+      for (int64_t i = 0; i <= WHEEL_SLOTS; i++)
+        {
+          int64_t start = (span + i) << shift;
+          if (start < w->clk)
+            continue;
+          if (start >= next)
+            break;
+          if (!list_empty (&w->slots[level][(span + i)
+                                            & (WHEEL_SLOTS - 1)]))
+            {
+              next = start;
+              break;
+            }
+        }
+    }
+  return next;
+}
+
+/* Timer function for ktimer_sleep_until(). */
+static void
+wake_thread (struct ktimer *t UNUSED, void *thread)
+{
+  thread_unblock (thread);
+}
@@ -0,0 +1,72 @@
+#ifndef DEVICES_KTIMER_H
+#define DEVICES_KTIMER_H
+
+/* Kernel timers.
+
+   A kernel timer calls a function once, at a given timer tick.
+   Each CPU keeps the timers added on it in its own timer wheel
+   and runs them from its own timer interrupt, so adding and
+   cancelling a timer take constant time and never touch
+   another CPU's data, and a thread sleeping with timer_sleep()
+   is woken up on the CPU it went to sleep on.
+
+   Timer functions run in an external interrupt context with
+   interrupts off, so they may not sleep.  A timer function may
+   add its own timer again. */
+
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "threads/spinlock.h"
+
+/* Levels of a timer wheel, and slots per level.  Level 0 holds
+   timers that expire in the next WHEEL_SLOTS ticks, one slot per
+   tick.  Each slot of level N covers WHEEL_SLOTS**N ticks, and its
+   timers move down a level once that span starts.  Timers due
+   more than WHEEL_SLOTS**WHEEL_LEVELS ticks ahead wait in the last
+   level and move down as time passes. */
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 4
+
+/* Returned by ktimer_next_expiry() if no timer is pending. */
+#define KTIMER_NONE INT64_MAX
+
+struct ktimer;
+struct cpu;
+
+/* Function called when a timer expires, given its AUX. */
+typedef void ktimer_func (struct ktimer *, void *aux);
+
+/* A kernel timer. */
+struct ktimer
+  {
+    struct list_elem elem;      /* Element in a wheel slot. */
+    int64_t expires;            /* Tick at which to run. */
+    struct cpu *cpu;            /* CPU whose wheel holds the timer,
+                                   or null if not pending. */
+    ktimer_func *func;          /* Function to run. */
+    void *aux;                  /* Auxiliary data for FUNC. */
+  };
+
+/* A CPU's pending timers. */
+struct timer_wheel
+  {
+    struct spinlock lock;       /* Protects all members. */
+    int64_t clk;                /* Next tick to process. */
+    size_t timer_cnt;           /* Number of pending timers. */
+    struct list slots[WHEEL_LEVELS][WHEEL_SLOTS];
+  };
+
+void ktimer_init (struct ktimer *, ktimer_func *, void *aux);
+void ktimer_add (struct ktimer *, int64_t expires);
+bool ktimer_cancel (struct ktimer *);
+bool ktimer_pending (const struct ktimer *);
+
+/* Used by the timer device. */
+void ktimer_init_cpu (struct cpu *);
+void ktimer_run (void);
+int64_t ktimer_next_expiry (void);
+void ktimer_sleep_until (int64_t expires);
+
+#endif /* devices/ktimer.h */
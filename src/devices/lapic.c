@@ -98,12 +98,14 @@ lapic_init (void)
   /* Enable local APIC; set spurious interrupt vector. */
   lapicw (SVR, ENABLE | (T_IRQ0 + IRQ_SPURIOUS));
 
-  /* The timer repeatedly counts down at bus frequency
-     from lapic[TICR] and then issues an interrupt.
+  /* The timer counts down once at bus frequency from lapic[TICR]
+     and then issues an interrupt.  The timer interrupt handler
+     arms it again with lapic_set_next_event() for as long as the
+     CPU needs a tick.
      If PintOS cared more about precise timekeeping,
      TICR would be calibrated using an external time source. */
   lapicw (TDCR, X1);
-  lapicw (TIMER, PERIODIC | (T_IRQ0 + IRQ_TIMER));
+  lapicw (TIMER, ONESHOT | (T_IRQ0 + IRQ_TIMER));
   lapicw (TICR, COUNT);
 
   /* Disable logical interrupt lines. */
@@ -135,11 +137,14 @@ lapic_init (void)
   lapicw (TPR, 0);
 }
 
-/* COMMENT missing.  Remove if unused. */
+/* Arms this CPU's timer to interrupt once, NS nanoseconds from
+   now, replacing any pending interrupt.  An NS of 0 stops the
+   timer. */
 void
-lapic_set_next_event (uint32_t delta)
+lapic_set_next_event (uint32_t ns)
 {
-  lapicw (TICR, delta);
+  if (lapic_base_addr)
+    lapicw (TICR, (uint64_t) ns * (BUS_FREQUENCY / 1000000) / 1000);
 }
 
 int
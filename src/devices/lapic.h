@@ -18,6 +18,7 @@ volatile uint32_t *lapic_base_addr;
 #define IPI_TLB 1
 #define IPI_DEBUG 2
 #define IPI_SCHEDULE 3
+#define IPI_TICK 4
 
 int lapic_get_cpuid (void);
 void lapic_ack (void);
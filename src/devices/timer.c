@@ -9,6 +9,9 @@
 #include "threads/thread.h"
 #include "threads/cpu.h"
 #include "devices/trap.h"
+#include "devices/ktimer.h"
+#include "devices/lapic.h"
+#include "lib/kernel/x86.h"
 
 /* See [8254] for hardware details of the 8254 timer chip. */
 
@@ -19,26 +22,45 @@
 #error TIMER_FREQ <= 1000 recommended
 #endif
 
+/* Nanoseconds per timer tick. */
+#define NSEC_PER_TICK (NSEC_PER_SEC / TIMER_FREQ)
+
+/* Timer ticks over which the TSC rate is measured. */
+#define TSC_CALIBRATE_TICKS 20
+
+/* Fixed-point shift of tsc_mult. */
+#define TSC_SHIFT 24
+
 /* Number of timer ticks since OS booted. */
 static int64_t ticks;
 
 /* Number of loops per timer tick.
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
-/* The current time wall clock time in nanoseconds */
-static uint64_t cur_time = 0;
+/* Nanoseconds per TSC cycle, times 2**TSC_SHIFT.
+   Initialized by timer_calibrate(); until then, timer_clock()
+   counts whole ticks. */
+static uint32_t tsc_mult;
 
-/* Sleeping thread list OUR CODE */
-static struct list waiting_threads;
+/* If true, CPUs other than CPU 0 may stop their tick when
+   nothing needs it.  See timer_stop_tick(). */
+bool timer_nohz = true;
 
-/* Spin lock for accessing the waiting threads */
-static struct spinlock waiting_threads_lock;
+/* Time set by timer_settime(), and whether it overrides the
+   clock. */
+static uint64_t cur_time = 0;
+static bool cur_time_set;
 
 static intr_handler_func timer_interrupt;
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
 static void real_time_delay (int64_t num, int32_t denom);
+static void tsc_calibrate (void);
+static void clock_start (void);
+static uint64_t tsc_to_ns (uint64_t cycles);
+static void program_next_tick (void);
+static void program_next_event (int64_t tick);
 
 /* Sets up the timer to interrupt TIMER_FREQ times per second,
    and registers the corresponding interrupt. */
@@ -46,11 +68,11 @@ void
 timer_init (void) 
 {
   intr_register_ext (0x20 + IRQ_TIMER, timer_interrupt, "8254 Timer");
-  spinlock_init(&waiting_threads_lock);
-  list_init(&waiting_threads);
+  ktimer_init_cpu (get_cpu ());
 }
 
-/* Calibrates loops_per_tick, used to implement brief delays. */
+/* Calibrates loops_per_tick, used to implement brief delays,
+   and the TSC rate, used by timer_clock(). */
 void
 timer_calibrate (void) 
 {
@@ -75,13 +97,40 @@ timer_calibrate (void)
       loops_per_tick |= test_bit;
 
   printf ("%'"PRIu64" loops/s.\n", (uint64_t) loops_per_tick * TIMER_FREQ);
+
+  tsc_calibrate ();
+}
+
+/* Starts the clock and the timer wheel on an application
+   processor.  Must be called with interrupts off, after the BSP
+   has run timer_calibrate(). */
+void
+timer_init_on_ap (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  /* Start the clock at a tick, so that its ticks line up with
+     CPU 0's. */
+  int64_t start = timer_ticks ();
+  while (timer_ticks () == start)
+    barrier ();
+  clock_start ();
+  ktimer_init_cpu (get_cpu ());
 }
 
 /* Returns the number of timer ticks since the OS booted. */
 int64_t
 timer_ticks (void) 
 {
-  int64_t t = ticks;
+  /* CPU 0 may update the two halves of TICKS between our reads
+     of them.  Read until we get the same value twice. */
+  int64_t t;
+  do
+    {
+      t = ticks;
+      barrier ();
+    }
+  while (t != ticks);
   return t;
 }
 
@@ -93,26 +142,15 @@ timer_elapsed (int64_t then)
   return timer_ticks () - then;
 }
 
-/* Comparision for list entries, returns true if time a comes before time b */
-bool
-timer_sleep_lessThan(const struct list_elem* a, const struct list_elem* b, __attribute__((unused)) void * aux) {
-  return list_entry(a, struct waiting_thread, elem)->when < list_entry(b, struct waiting_thread, elem)->when;
-}	
-
 /* Sleeps for approximately TICKS timer ticks.  Interrupts must
    be turned on. */
 void
 timer_sleep (int64_t ticks) 
 {
   ASSERT (intr_get_level () == INTR_ON);
-  
-  struct waiting_thread this_wait;
-  this_wait.to_wake = thread_current ();
-  this_wait.when = ticks + timer_ticks ();
-  spinlock_acquire(&waiting_threads_lock);
-  list_insert_ordered(&waiting_threads, &this_wait.elem, timer_sleep_lessThan, NULL); 
-  thread_block (&waiting_threads_lock);
-  spinlock_release(&waiting_threads_lock);
+
+  if (ticks > 0)
+    ktimer_sleep_until (timer_ticks () + ticks);
 }
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
@@ -182,47 +220,156 @@ timer_ndelay (int64_t ns)
 void
 timer_print_stats (void) 
 {
-  printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
+  uint64_t interrupts = 0;
+  for (struct cpu *c = cpus; c < cpus + ncpu; c++)
+    interrupts += c->timer_interrupts;
+  printf ("Timer: %"PRId64" ticks, %"PRIu64" interrupts\n",
+          timer_ticks (), interrupts);
 }
 
-/* Unblocks all threads that were waiting for this tick */
+/* Stops the running CPU's tick, so that it takes no timer
+   interrupts until timer_start_tick().  Has no effect on CPU 0,
+   which keeps time and wakes sleeping threads, or if timer_nohz
+   is false.  Interrupts must be off. */
 void
-awaken_sleeping_threads ()
-{
-    spinlock_acquire(&waiting_threads_lock);
-
-    struct waiting_thread * curr_waiter;
-    struct waiting_thread * t;
-    list_for_each_entry_safe(curr_waiter, t, &waiting_threads.head, elem) {
-       if (curr_waiter->when > ticks)
-       {
-          break;
-       }
-       else if (curr_waiter->when < ticks)
-       {
-          thread_unblock(curr_waiter->to_wake);
-          list_remove(&curr_waiter->elem);
-       }
-    }
+timer_stop_tick (void)
+{
+  struct cpu *c = get_cpu ();
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  if (!timer_nohz || c->id == 0 || c->tick_stopped)
+    return;
 
-    spinlock_release(&waiting_threads_lock);
+  c->tick_stopped = true;
+  c->tick_stop_time = timer_clock ();
+  program_next_event (ktimer_next_expiry ());
+}
+
+/* Restarts the running CPU's tick after timer_stop_tick().
+   Interrupts must be off. */
+void
+timer_start_tick (void)
+{
+  struct cpu *c = get_cpu ();
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  if (!c->tick_stopped)
+    return;
+
+  c->tick_stopped = false;
+  program_next_tick ();
+}
+
+/* Makes sure that the running CPU takes a timer interrupt at
+   tick TICK, even if its tick is stopped.  Interrupts must be
+   off. */
+void
+timer_wake_at (int64_t tick)
+{
+  struct cpu *c = get_cpu ();
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  if (c->tick_stopped && tick < c->next_event)
+    program_next_event (tick);
+}
+
+/* Returns the number of ticks that CPU C has gone without since
+   its tick was stopped, not counting ticks already passed to
+   timer_account_missed().  Returns 0 if C's tick is running.
+   The result is approximate if C is not the running CPU. */
+int64_t
+timer_missed_ticks (const struct cpu *c)
+{
+  if (!c->tick_stopped)
+    return 0;
+
+  uint64_t now = timer_clock ();
+  if (now <= c->tick_stop_time)
+    return 0;
+  return (now - c->tick_stop_time) / NSEC_PER_TICK;
+}
+
+/* Records that CNT of the running CPU's missed ticks have been
+   accounted for.  Interrupts must be off. */
+void
+timer_account_missed (int64_t cnt)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  get_cpu ()->tick_stop_time += cnt * NSEC_PER_TICK;
 }
 
 /* Timer interrupt handler. */
 static void
 timer_interrupt (struct intr_frame *args UNUSED)
 {
+  struct cpu *c = get_cpu ();
+
+  c->timer_interrupts++;
+
   /* CPU 0 is in charge of maintaining wall-clock time */
-  if (get_cpu ()->id == 0) 
-    {
-      ticks++;
-      
-      awaken_sleeping_threads ();
+  if (c->id == 0) 
+    ticks++;
+
+  ktimer_run ();
 
-      timer_settime (timer_ticks () * NSEC_PER_SEC / TIMER_FREQ);
+  /* A CPU whose tick is stopped is interrupted only when its
+     timers need attention. */
+  if (c->tick_stopped)
+    {
+      program_next_event (ktimer_next_expiry ());
+      return;
     }
-    
+
+  /* thread_tick() may stop the tick. */
   thread_tick ();
+  if (!c->tick_stopped)
+    program_next_tick ();
+}
+
+/* Arms the running CPU's timer for the next tick.  Ticks are
+   kept on a fixed grid of the clock, so that the time spent in
+   the interrupt handler does not make them drift.  An interrupt
+   that arrives a little early still counts as the tick it was
+   meant for. */
+static void
+program_next_tick (void)
+{
+  uint32_t delta = NSEC_PER_TICK - timer_clock () % NSEC_PER_TICK;
+  if (delta < NSEC_PER_TICK / 2)
+    delta += NSEC_PER_TICK;
+  lapic_set_next_event (delta);
+}
+
+/* Arms the running CPU's timer, while its tick is stopped, to
+   interrupt at tick TICK, or not at all if TICK is KTIMER_NONE.
+   CPU 0 advances the tick count at the start of each tick, so
+   the interrupt comes a little after that. */
+static void
+program_next_event (int64_t tick)
+{
+  struct cpu *c = get_cpu ();
+
+  /* The LAPIC timer cannot count much further than this. */
+  const int64_t max_ticks = TIMER_FREQ;
+
+  c->next_event = tick;
+  if (tick == KTIMER_NONE)
+    {
+      lapic_set_next_event (0);
+      return;
+    }
+
+  int64_t delta = tick - timer_ticks ();
+  if (delta < 1)
+    delta = 1;
+  else if (delta > max_ticks)
+    {
+      delta = max_ticks;
+      c->next_event = timer_ticks () + delta;
+    }
+  lapic_set_next_event (delta * NSEC_PER_TICK
+                        - timer_clock () % NSEC_PER_TICK
+                        + NSEC_PER_TICK / 4);
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
@@ -244,6 +391,74 @@ too_many_loops (unsigned loops)
   return start != ticks;
 }
 
+/* Measures the number of TSC cycles per timer tick and starts
+   the clock on the BSP. */
+static void
+tsc_calibrate (void)
+{
+  uint64_t start_tsc, cycles;
+  int64_t start;
+
+  ASSERT (intr_get_level () == INTR_ON);
+  printf ("Calibrating TSC...  ");
+
+  /* Wait for a timer tick, then count cycles over the next
+     TSC_CALIBRATE_TICKS ticks. */
+  start = ticks;
+  while (ticks == start)
+    barrier ();
+  start_tsc = rdtsc ();
+  start = ticks;
+  while (ticks - start < TSC_CALIBRATE_TICKS)
+    barrier ();
+  cycles = rdtsc () - start_tsc;
+
+  /* A TSC slower than NSEC_PER_SEC >> (32 - TSC_SHIFT) Hz would
+     overflow tsc_mult.  Keep counting ticks in that case. */
+  uint64_t mult = ((uint64_t) NSEC_PER_TICK * TSC_CALIBRATE_TICKS
+                   << TSC_SHIFT) / cycles;
+  if (mult == 0 || mult > UINT32_MAX)
+    {
+      printf ("unusable, using timer ticks.\n");
+      return;
+    }
+
+  intr_disable_push ();
+  tsc_mult = mult;
+  clock_start ();
+  intr_enable_pop ();
+
+  printf ("%'"PRIu64" cycles/s.\n",
+          cycles * TIMER_FREQ / TSC_CALIBRATE_TICKS);
+}
+
+/* Starts the clock on the running CPU at the current tick.
+
+   Each CPU reads its own TSC, so the TSCs need not be in sync
+   across CPUs.  Clocks on different CPUs may differ by up to a
+   tick.  The scheduler charges a thread's run time only on the
+   CPU that ran it, and tolerates the skew where it compares a
+   time with another CPU's: a difference that comes out negative
+   counts as zero. */
+static void
+clock_start (void)
+{
+  struct cpu *c = get_cpu ();
+  c->tsc_base = rdtsc ();
+  c->clock_base = timer_ticks () * NSEC_PER_TICK;
+}
+
+/* Converts CYCLES TSC cycles to nanoseconds.  The multiplication
+   is split in two 32x32-bit halves so that it cannot overflow
+   even for very long intervals. */
+static uint64_t
+tsc_to_ns (uint64_t cycles)
+{
+  uint64_t hi = (cycles >> 32) * tsc_mult;
+  uint64_t lo = (cycles & UINT32_MAX) * tsc_mult;
+  return (hi << (32 - TSC_SHIFT)) + (lo >> TSC_SHIFT);
+}
+
 /* Iterates through a simple loop LOOPS times, for implementing
    brief delays.
 
@@ -296,20 +511,48 @@ real_time_delay (int64_t num, int32_t denom)
   busy_wait (loops_per_tick * num / 1000 * TIMER_FREQ / (denom / 1000)); 
 }
 
+/* Returns the time in nanoseconds since the OS booted, with
+   the resolution of the running CPU's time-stamp counter.  The
+   clock is monotonic on each CPU.  Before timer_calibrate() has
+   run, it advances only once per tick. */
+uint64_t
+timer_clock (void)
+{
+  if (tsc_mult == 0)
+    return timer_ticks () * NSEC_PER_TICK;
+
+  intr_disable_push ();
+  struct cpu *c = get_cpu ();
+  uint64_t ns = c->clock_base + tsc_to_ns (rdtsc () - c->tsc_base);
+  intr_enable_pop ();
+  return ns;
+}
+
 /*
  * Set the current (wall-clock) time.
- * This is done by the simulation framework during testing, and
- * done by CPU0 during the actual execution.
+ * This is done by the simulation framework during testing; until
+ * timer_cleartime() is called, timer_gettime() returns TIME
+ * instead of reading the clock.
  */
 void
 timer_settime (uint64_t time) 
 {
   cur_time = time;
+  cur_time_set = true;
+}
+
+/* Makes timer_gettime() read the clock again after
+   timer_settime(). */
+void
+timer_cleartime (void)
+{
+  cur_time_set = false;
 }
 
-/* Return current time in nanosec units */
+/* Return current time in nanosec units.  The scheduler uses this
+   for all of its accounting. */
 uint64_t
 timer_gettime ()
 {
-  return cur_time;
+  return cur_time_set ? cur_time : timer_clock ();
 }
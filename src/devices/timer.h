@@ -10,27 +10,9 @@
 #define TIMER_FREQ 1000
 #define NSEC_PER_SEC 1000000000
 
-/* Struct for handling timer sleeping OUR CODE*/
-struct waiting_thread
-{
-   /* The tick this thread is waiting for. */
-   int64_t when;
-   
-   /* Pointer to the thread for waking up on the correct tick. */
-   struct thread * to_wake;
-
-   /* List element for linking inside the double list. */
-   struct list_elem elem;
-};
-
-/* Comparision function used by the list functions to order the waiting thread list OUR CODE*/
-bool timer_sleep_lessThan (const struct list_elem * a, const struct list_elem * b, void * aux);
-
-/* Function for awakening all threads waiting for current tick OUR CODE*/
-void awaken_sleeping_threads (void);
-
 void timer_init (void);
 void timer_calibrate (void);
+void timer_init_on_ap (void);
 
 int64_t timer_ticks (void);
 int64_t timer_elapsed (int64_t);
@@ -48,8 +30,21 @@ void timer_ndelay (int64_t nanoseconds);
 
 void timer_print_stats (void);
 
+/* Dynamic tick. */
+struct cpu;
+extern bool timer_nohz;
+void timer_stop_tick (void);
+void timer_start_tick (void);
+void timer_wake_at (int64_t tick);
+int64_t timer_missed_ticks (const struct cpu *);
+void timer_account_missed (int64_t);
+
+/* High-resolution clock, in ns since boot. */
+uint64_t timer_clock (void);
+
 /* Set the current time */
 void timer_settime(uint64_t); 
+void timer_cleartime (void);
 
 /* Return the current wall clock time in ns */
 uint64_t timer_gettime (void);
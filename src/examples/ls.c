@@ -24,39 +24,46 @@ list_dir (const char *dir, bool verbose)
 
   if (isdir (dir_fd))
     {
-      char name[READDIR_MAX_LEN];
+      /* Room for many entries, so that each getdents() call
+         returns a batch of them. */
+      static int buf[1024];
+      int n;
 
       printf ("%s", dir);
       if (verbose)
         printf (" (inumber %d)", inumber (dir_fd));
       printf (":\n");
 
-      while (readdir (dir_fd, name)) 
-        {
-          printf ("%s", name); 
-          if (verbose) 
-            {
-              char full_name[128];
-              int entry_fd;
+      while ((n = getdents (dir_fd, buf, sizeof buf)) > 0)
+        for (int ofs = 0; ofs < n; )
+          {
+            struct dirent *d = (struct dirent *) ((char *) buf + ofs);
+            ofs += d->d_reclen;
 
-              snprintf (full_name, sizeof full_name, "%s/%s", dir, name);
-              entry_fd = open (full_name);
+            printf ("%s", d->d_name); 
+            if (verbose) 
+              {
+                printf (": ");
+                if (d->d_type == DT_DIR)
+                  printf ("directory");
+                else
+                  {
+                    char full_name[128];
+                    int entry_fd;
 
-              printf (": ");
-              if (entry_fd != -1)
-                {
-                  if (isdir (entry_fd))
-                    printf ("directory");
-                  else
-                    printf ("%d-byte file", filesize (entry_fd));
-                  printf (", inumber %d", inumber (entry_fd));
-                }
-              else
-                printf ("open failed");
-              close (entry_fd);
-            }
-          printf ("\n");
-        }
+                    snprintf (full_name, sizeof full_name, "%s/%s",
+                              dir, d->d_name);
+                    entry_fd = open (full_name);
+                    if (entry_fd != -1)
+                      printf ("%d-byte file", filesize (entry_fd));
+                    else
+                      printf ("open failed");
+                    close (entry_fd);
+                  }
+                printf (", inumber %d", d->d_ino);
+              }
+            printf ("\n");
+          }
     }
   else 
     printf ("%s: not a directory\n", dir);
@@ -3,36 +3,94 @@
 #include "stdlib.h"
 #include "filesys/filesys.h"
 #include "threads/malloc.h"
-#include "filesys/rw-lock.h"
+#include "threads/rw-lock.h"
 #include "string.h"
 #include "threads/thread.h"
 #include "stdio.h"
 #include "devices/timer.h"
 #include "lib/kernel/queue.h"
+#include "filesys/journal.h"
+#include "threads/spinlock.h"
 
 
+/* Marks a cache block that holds no sector. */
+#define NO_SECTOR ((block_sector_t) -1)
+
+/* Buckets in the hash table of cached sectors. */
+#define CACHE_BUCKETS 32
+
 struct cache_block
 {
-  struct list_elem elem;        /* List element for buffer cache. */ 
+  struct list_elem elem;        /* List element for its hash bucket. */ 
   block_sector_t sector;        /* Corresponding sector number on disk. */ 
+  bool referenced;              /* Accessed since the clock hand passed. */
   bool dirty;                   /* Indicate modification since cached. */
   bool valid;                   /* Indicate cached status of the block. */
+  bool logged;                  /* Logged by the running journal transaction.
+                                   Pinned until the transaction commits. */
   void *data;                   /* 512 bytes of block data on disk. */
 
   struct rw_lock rw_lock;       /* Read-write lock (shared-exclusive lock). */
+
+  /* Dirty blocks that are not logged are on DIRTY_BLOCKS, and on
+     the dirty list of the inode that wrote them, if any.  The
+     lists and OWNER are protected by dirty_lock. */
+  struct list_elem dirty_elem;  /* List element for dirty_blocks. */
+  struct list_elem owner_elem;  /* List element for OWNER. */
+  struct list *owner;           /* Dirty list of the writing inode. */
+  int64_t dirty_since;          /* Tick at which the block became dirty. */
+};
+
+/* A bucket of the hash table that maps sectors to cache blocks.
+   A block's SECTOR only changes while the block is held
+   exclusively and the lock of the bucket it leaves or joins is
+   held, so a lookup only takes one short spinlock. */
+struct cache_bucket
+{
+  struct spinlock lock;         /* Protects BLOCKS. */
+  struct list blocks;           /* Cached blocks hashing here. */
 };
 
-struct list buffer_cache;       /* Cached blocks. */
-struct list free_cache;         /* Free blocks. Only used before cache become full. 
-                                   Note that size of buffer_cache + free_cache 
-                                   is always 64. */
-struct lock cache_lock;
+static struct cache_block blocks[MAX_CACHE_SIZE];   /* All cache blocks. */
+static struct cache_bucket buckets[CACHE_BUCKETS];  /* Cached sectors. */
+
+/* Cache hits only set a block's reference bit.  On a miss, the
+   clock hand sweeps BLOCKS for a victim, clearing reference bits
+   on the way.  Misses are serialized by evict_lock. */
+static struct lock evict_lock;
+static size_t clock_hand;               /* Protected by evict_lock. */
+
+static struct list dirty_blocks;        /* Dirty, unlogged blocks,
+                                           oldest first. */
+static size_t dirty_cnt;                /* Number of DIRTY_BLOCKS. */
+static struct lock dirty_lock;          /* Protects the dirty lists. */
 struct array_queue read_queue;  /* Queue used for read-ahead daemon. */
 
 
 static bool block_init (struct cache_block *block);
-static struct cache_block * evict_LRU_block (block_sector_t sector);
+static struct cache_block * evict_block (block_sector_t sector);
+static struct cache_block * clock_select_victim (void);
+static struct cache_bucket * sector_bucket (block_sector_t sector);
 static struct cache_block * cache_lookup (block_sector_t sector);
+static void dirty_list_remove (struct cache_block *block);
+static void mark_block_clean (struct cache_block *block);
+static size_t write_batch (bool expired_only, bool wait);
+static bool writeback_needed (void);
+
+/* Write-behind tunables, settable on the kernel command line.
+   Percentages are of MAX_CACHE_SIZE. */
+unsigned cache_dirty_background_ratio = 25; /* Start write-behind. */
+unsigned cache_dirty_ratio = 50;        /* Writers write back themselves. */
+int64_t cache_dirty_expire = 3000;      /* Ticks a block may stay dirty. */
+int64_t cache_writeback_interval = 500; /* Ticks between checks for
+                                           expired blocks. */
+
+/* Blocks written back per batch, in sector order. */
+#define WRITEBACK_BATCH 16
+
+static struct semaphore writeback_sema; /* Wakes the write-behind daemon. */
+static bool writeback_kicked;           /* WRITEBACK_SEMA is up.
+                                           Protected by dirty_lock. */
 
 
 /* Initialize empty block. */
@@ -40,41 +98,50 @@ static bool
 block_init (struct cache_block *block)
 {
   ASSERT (block != NULL);
-  block->sector = SIZE_MAX;
+  block->sector = NO_SECTOR;
+  block->referenced = false;
   block->dirty = false;
   block->valid = false;
+  block->logged = false;
+  block->owner = NULL;
   block->data = malloc (BLOCK_SECTOR_SIZE);
   if (!block->data)
-    {
-      free (block);
-      return false;
-    }
+    return false;
 
-  rw_lock_init (&block->rw_lock);
+  rw_lock_init (&block->rw_lock, RW_LOCK_FAIR);
 
   return true;
 }
 
-/* Initialize buffer cache and its lock. */
+/* Initialize buffer cache and its locks. */
 void
 cache_init (void)
 {
-  lock_init (&cache_lock);
-  list_init (&buffer_cache);
-  list_init (&free_cache);
+  for (int i = 0; i < CACHE_BUCKETS; i++)
+    {
+      spinlock_init (&buckets[i].lock);
+      list_init (&buckets[i].blocks);
+    }
+  lock_init (&evict_lock);
+  clock_hand = 0;
+  lock_init (&dirty_lock);
+  list_init (&dirty_blocks);
+  dirty_cnt = 0;
+  sema_init (&writeback_sema, 0);
+  writeback_kicked = false;
   queue_init (&read_queue, MAX_CACHE_SIZE, true);
 
-  /* Initialize 64 empty cache blocks. */
+  /* Eviction relies on some blocks never being logged. */
+  ASSERT (JOURNAL_TX_MAX < MAX_CACHE_SIZE);
+
+  /* Initialize 64 empty cache blocks.  They are in no bucket until
+     the clock hand hands them out. */
   for (int n = 0; n < MAX_CACHE_SIZE; n++)
-    {
-      struct cache_block *block = malloc (sizeof (struct cache_block));
-      if (block == NULL || !block_init (block))
-        {
-          printf ("Buffer cache: fail to allocate 64 cache blocks.");
-          thread_exit ();
-        }
-      list_push_front (&free_cache, &block->elem);
-    }
+    if (!block_init (&blocks[n]))
+      {
+        printf ("Buffer cache: fail to allocate 64 cache blocks.");
+        thread_exit ();
+      }
 }
 
 /* Reserve a block in buffer cache dedicated to hold this sector.
@@ -83,114 +150,140 @@ cache_init (void)
 struct cache_block * 
 cache_get_block (block_sector_t sector, bool exclusive)
 {
-  struct cache_block *block = NULL;
-  bool evicted;
+  ASSERT (sector != NO_SECTOR);
 
-  do
+  while (true)
     {
-      evicted = false;
-      lock_acquire (&cache_lock);
-
-      /* Checks if block was already cached. */
-      block = cache_lookup (sector);
-
-      /* The block was not cached. */
+      /* Checks if block was already cached.  If not, claim a block
+         for it, unless another thread just did. */
+      struct cache_block *block = cache_lookup (sector);
       if (block == NULL)
-        {
-          /* When cache is full, select Least recently used block. */
-          if (list_empty (&free_cache))
-            block = evict_LRU_block (sector);
+        block = evict_block (sector);
+      if (block == NULL)
+        continue;
 
-          /* Otherwise, use available empty block. */
-          else
-            {
-              struct list_elem *e = list_front (&free_cache);
-              block = list_entry (e, struct cache_block, elem);
-              block->sector = sector;
-            }
-        }
-      
-      /* At this point, block is cached in, empty, or invalid (evicted). */
-      ASSERT (block != NULL);
-      /* Mark the block as most recently accessed. */
-      list_remove (&block->elem);
-      list_push_front (&buffer_cache, &block->elem);
-      
-      lock_release (&cache_lock);
-      
       /* Acquire per-block read-write lock. */
       if (exclusive)
-        {
-          write_lock_acquire (&block->rw_lock);
-          block->rw_lock.mode = WRITE_LOCKED;
-        }
+        write_lock_acquire (&block->rw_lock);
       else
-        {
-          read_lock_acquire (&block->rw_lock);
-          block->rw_lock.mode = READ_LOCKED;
-        }
+        read_lock_acquire (&block->rw_lock);
 
       /* Check if the block have been evicted
          while acquiring the read-write lock. */
-      if (block->sector != sector)
+      if (block->sector == sector)
         {
-          evicted = true;
-          block->rw_lock.mode = UNLOCKED;
-          if (exclusive)
-            write_lock_release (&block->rw_lock);
-          else
-            read_lock_release (&block->rw_lock);
+          block->referenced = true;
+          return block;
         }
 
-    /* Start over if block was indeed evicted. */
-    } while (evicted);
-
-
-  return block;
+      /* Start over if block was indeed evicted. */
+      rw_lock_release (&block->rw_lock);
+    }
 }
 
-/* Locate the Least Recently Used block from the buffer cache. */
+/* Claim a cache block for SECTOR, which was not found in the
+   cache.  Returns the block, which is not locked, or a null
+   pointer if another thread cached SECTOR meanwhile. */
 static struct cache_block * 
-evict_LRU_block (block_sector_t sector)
+evict_block (block_sector_t sector)
 {
-  struct cache_block *victim = NULL;
-
-  /* Iterate from the back of the buffer cache
-     to find the Least recently used block that is not pinned. */
-  while (!victim)
+  while (true)
     {
-      for (struct list_elem *e = list_rbegin (&buffer_cache); 
-           e != list_rend (&buffer_cache); e = list_prev (e))
+      lock_acquire (&evict_lock);
+      if (cache_lookup (sector) != NULL)
+        {
+          lock_release (&evict_lock);
+          return NULL;
+        }
+
+      struct cache_block *victim = clock_select_victim ();
+      if (victim == NULL)
         {
-          struct cache_block *block = list_entry (e, struct cache_block, elem);
-          /* Check if the block is pinned by other process. 
-             If not, select the block as victim. */
-          if (write_lock_try_acquire (&block->rw_lock))
+          /* Every block is logged or in use.  The journal keeps
+             fewer than MAX_CACHE_SIZE blocks logged, so the others
+             are only held for a while, but their holders may have
+             to miss in the cache themselves before they let go.
+             Wait for them without holding evict_lock. */
+          lock_release (&evict_lock);
+          thread_yield ();
+          continue;
+        }
+      if (!victim->dirty)
+        {
+          /* Move the victim to SECTOR's bucket.  Holding evict_lock
+             until it is there keeps other threads missing on
+             SECTOR from claiming a second block. */
+          struct cache_bucket *bucket;
+          if (victim->sector != NO_SECTOR)
             {
-              victim = block;
-              break;
+              bucket = sector_bucket (victim->sector);
+              spinlock_acquire (&bucket->lock);
+              list_remove (&victim->elem);
+              spinlock_release (&bucket->lock);
             }
+          victim->valid = false;
+          bucket = sector_bucket (sector);
+          spinlock_acquire (&bucket->lock);
+          victim->sector = sector;
+          list_push_back (&bucket->blocks, &victim->elem);
+          spinlock_release (&bucket->lock);
+
+          lock_release (&evict_lock);
+          rw_lock_release (&victim->rw_lock);
+          return victim;
         }
+
+      /* Write back a dirty victim without holding evict_lock and
+         start over.  The block keeps its sector until then, so
+         nobody reads a stale copy from disk. */
+      lock_release (&evict_lock);
+      block_write (fs_device, victim->sector, victim->data);
+      mark_block_clean (victim);
+      rw_lock_release (&victim->rw_lock);
     }
+}
 
-  lock_release (&cache_lock);
-  
-  ASSERT (victim != NULL);
-  /* Write back to disk if the victim is dirty. 
-     Otherwise, non-dirty block can be simply discarded. */
-  if (victim->dirty)
-    block_write (fs_device, victim->sector, victim->data);
+/* Sweep the clock hand over the cache blocks and return the first
+   one that has not been referenced since the last sweep and is
+   not in use, held exclusively.  Clean blocks are preferred, so
+   that the caller does not have to wait for a write; a dirty
+   block is only returned after two full sweeps found no clean
+   one.  Logged blocks must stay cached until their transaction
+   commits.  Returns a null pointer if two sweeps found every
+   block logged or in use.  Must be called with evict_lock
+   held. */
+static struct cache_block *
+clock_select_victim (void)
+{
+  struct cache_block *dirty_victim = NULL;
 
-  /* Update the block's meta data before releasing the lock. */
-  victim->sector = sector;
-  victim->valid = false;
-  victim->dirty = false;
+  ASSERT (lock_held_by_current_thread (&evict_lock));
 
-  write_lock_release (&victim->rw_lock);
+  for (size_t scanned = 1; ; scanned++)
+    {
+      struct cache_block *block = &blocks[clock_hand];
+      clock_hand = (clock_hand + 1) % MAX_CACHE_SIZE;
 
-  lock_acquire (&cache_lock);
+      if (block->referenced)
+        block->referenced = false;
+      else if (block != dirty_victim
+               && write_lock_try_acquire (&block->rw_lock))
+        {
+          if (!block->logged && !block->dirty)
+            {
+              if (dirty_victim != NULL)
+                rw_lock_release (&dirty_victim->rw_lock);
+              return block;
+            }
+          else if (!block->logged && dirty_victim == NULL)
+            dirty_victim = block;
+          else
+            rw_lock_release (&block->rw_lock);
+        }
 
-  return victim;
+      if (scanned == 2 * MAX_CACHE_SIZE)
+        return dirty_victim;
+    }
 }
 
 /* Release access to cache block. */
@@ -199,10 +292,7 @@ cache_put_block (struct cache_block *block)
 {
   ASSERT (block != NULL);
 
-  if (block->rw_lock.mode == WRITE_LOCKED)
-    write_lock_release (&block->rw_lock);
-  else if (block->rw_lock.mode == READ_LOCKED)
-    read_lock_release (&block->rw_lock);
+  rw_lock_release (&block->rw_lock);
 }
 
 /* Read cache block from disk, returns pointer to data. */
@@ -219,34 +309,178 @@ cache_read_block (struct cache_block *block)
   return block->data;
 }
 
-/* Fill cache block with zeros, returns pointer to data. */
+/* Fill cache block with zeros, returns pointer to data.
+   The caller must mark the block dirty or log it. */
 void *
 cache_zero_block (struct cache_block *block)
 {
   ASSERT (block != NULL);
   memset (block->data, 0, BLOCK_SECTOR_SIZE);
-  block->dirty = true;
   block->valid = true;
   return block->data;
 }
 
-/* Mark cache block dirty (must be written back). */
+/* Mark cache block, which must be held exclusively, dirty (must be
+   written back).  OWNER is the dirty list of the inode whose data
+   the block holds, which cache_sync_blocks() writes back, or a
+   null pointer. */
+void
+cache_mark_block_dirty (struct cache_block *block, struct list *owner)
+{
+  ASSERT (block != NULL);
+  ASSERT (rw_lock_held_by_current_thread (&block->rw_lock));
+
+  lock_acquire (&dirty_lock);
+  /* A logged block is written back by the journal. */
+  if (!block->logged)
+    {
+      if (!block->dirty)
+        {
+          list_push_back (&dirty_blocks, &block->dirty_elem);
+          block->dirty_since = timer_ticks ();
+          dirty_cnt++;
+          if (!writeback_kicked && writeback_needed ())
+            {
+              writeback_kicked = true;
+              sema_up (&writeback_sema);
+            }
+        }
+      if (block->owner != owner)
+        {
+          if (block->owner != NULL)
+            list_remove (&block->owner_elem);
+          if (owner != NULL)
+            list_push_back (owner, &block->owner_elem);
+          block->owner = owner;
+        }
+    }
+  block->dirty = true;
+  lock_release (&dirty_lock);
+}
+
+/* Mark cache block, which holds file system metadata and must be
+   held exclusively, as modified by the running journal transaction.
+   The block is not written back before the transaction commits. */
 void
-cache_mark_block_dirty (struct cache_block *block)
+cache_log_block (struct cache_block *block)
 {
   ASSERT (block != NULL);
+  ASSERT (rw_lock_held_by_current_thread (&block->rw_lock));
+
+  lock_acquire (&dirty_lock);
+  dirty_list_remove (block);
+  bool newly_logged = !block->logged;
   block->dirty = true;
+  block->logged = true;
+  lock_release (&dirty_lock);
+
+  if (newly_logged)
+    journal_add (block->sector);
 }
 
-/* Search if the given sector was already cached into the buffer cache. */
+/* Write the cached copy of SECTOR, whose transaction has been
+   committed to the journal, back to its home location. */
+void
+cache_checkpoint_block (block_sector_t sector)
+{
+  struct cache_block *block = cache_get_block (sector, true);
+  ASSERT (block->logged && block->valid);
+  block_write (fs_device, block->sector, block->data);
+  lock_acquire (&dirty_lock);
+  block->dirty = false;
+  block->logged = false;
+  lock_release (&dirty_lock);
+  cache_put_block (block);
+}
+
+/* Remove BLOCK from the dirty lists, if it is on them.
+   Must be called with dirty_lock held. */
+static void
+dirty_list_remove (struct cache_block *block)
+{
+  ASSERT (lock_held_by_current_thread (&dirty_lock));
+  if (block->dirty && !block->logged)
+    {
+      list_remove (&block->dirty_elem);
+      dirty_cnt--;
+      if (block->owner != NULL)
+        list_remove (&block->owner_elem);
+      block->owner = NULL;
+    }
+}
+
+/* Mark BLOCK, which must be held exclusively and just have been
+   written back, clean. */
+static void
+mark_block_clean (struct cache_block *block)
+{
+  lock_acquire (&dirty_lock);
+  dirty_list_remove (block);
+  block->dirty = false;
+  lock_release (&dirty_lock);
+}
+
+/* Write back the dirty blocks on OWNER, the dirty list of an inode,
+   waiting for blocks that are in use.  Blocks dirtied again while
+   this runs may be left for a later call. */
+void
+cache_sync_blocks (struct list *owner)
+{
+  lock_acquire (&dirty_lock);
+  for (size_t cnt = list_size (owner); cnt > 0 && !list_empty (owner); cnt--)
+    {
+      struct cache_block *block = list_entry (list_front (owner),
+                                              struct cache_block, owner_elem);
+      lock_release (&dirty_lock);
+
+      write_lock_acquire (&block->rw_lock);
+      /* The block may have been written back or evicted meanwhile. */
+      if (block->owner == owner)
+        {
+          block_write (fs_device, block->sector, block->data);
+          mark_block_clean (block);
+        }
+      rw_lock_release (&block->rw_lock);
+
+      lock_acquire (&dirty_lock);
+    }
+  lock_release (&dirty_lock);
+}
+
+/* Detach the dirty blocks on OWNER, the dirty list of an inode
+   that is being freed.  They are still written back later. */
+void
+cache_disown_blocks (struct list *owner)
+{
+  lock_acquire (&dirty_lock);
+  while (!list_empty (owner))
+    {
+      struct cache_block *block = list_entry (list_pop_front (owner),
+                                              struct cache_block, owner_elem);
+      block->owner = NULL;
+    }
+  lock_release (&dirty_lock);
+}
+
+/* Returns the hash bucket of SECTOR. */
+static struct cache_bucket *
+sector_bucket (block_sector_t sector)
+{
+  return &buckets[sector % CACHE_BUCKETS];
+}
+
+/* Search if the given sector was already cached into the buffer
+   cache.  The returned block is not locked, so the caller must
+   check its sector again after locking it. */
 static struct cache_block * 
 cache_lookup (block_sector_t sector)
 {
+  struct cache_bucket *bucket = sector_bucket (sector);
   struct cache_block *block = NULL;
-  /* Iterate over the buffer cache and check if the requested block
-     was already cached into the cache. */
-  for (struct list_elem *e = list_begin (&buffer_cache); 
-       e != list_end (&buffer_cache); e = list_next (e))
+
+  spinlock_acquire (&bucket->lock);
+  for (struct list_elem *e = list_begin (&bucket->blocks); 
+       e != list_end (&bucket->blocks); e = list_next (e))
     {
       struct cache_block *curr_blk = list_entry (e, struct cache_block, elem);
       if (curr_blk->sector == sector)
@@ -255,6 +489,7 @@ cache_lookup (block_sector_t sector)
           break;
         }
     }
+  spinlock_release (&bucket->lock);
 
   return block;
 }
@@ -285,44 +520,166 @@ cache_read_ahead_daemon (void *unused UNUSED)
     }
 }
 
-/* Periodically write all dirty blocks inside buffer cache to disk. 
-   This should be done asynchronously in the background. */
+/* Returns true if the write-behind daemon has work to do: too
+   many blocks are dirty, or the oldest one has expired.
+   Must be called with dirty_lock held. */
+static bool
+writeback_needed (void)
+{
+  ASSERT (lock_held_by_current_thread (&dirty_lock));
+  if (dirty_cnt > MAX_CACHE_SIZE * cache_dirty_background_ratio / 100)
+    return true;
+  if (list_empty (&dirty_blocks))
+    return false;
+
+  struct cache_block *oldest = list_entry (list_front (&dirty_blocks),
+                                           struct cache_block, dirty_elem);
+  return timer_elapsed (oldest->dirty_since) >= cache_dirty_expire;
+}
+
+/* Write back dirty blocks in the background.  The daemon wakes up
+   when the dirty blocks exceed the background ratio, or every
+   cache_writeback_interval ticks to write back expired blocks,
+   and writes in sector-sorted batches until neither is the case
+   any more. */
 void
 cache_write_behind_daemon (void *unused UNUSED)
 {
   while (true)
     {
-      timer_sleep (5000);
-      cache_flush ();
+      sema_down (&writeback_sema);
+
+      lock_acquire (&dirty_lock);
+      writeback_kicked = false;
+      while (writeback_needed ())
+        {
+          bool expired_only = (dirty_cnt <= MAX_CACHE_SIZE
+                               * cache_dirty_background_ratio / 100);
+          lock_release (&dirty_lock);
+          size_t written = write_batch (expired_only, false);
+          lock_acquire (&dirty_lock);
+
+          /* Blocks in use are left for the next wakeup. */
+          if (written == 0)
+            break;
+        }
+      lock_release (&dirty_lock);
     }
 }
 
-/* Write back all dirty blocks inside buffer cache to disk. */
+/* Wake the write-behind daemon periodically, so that dirty blocks
+   do not stay in the cache much longer than cache_dirty_expire. */
 void
-cache_flush (void)
+cache_write_behind_timer (void *unused UNUSED)
 {
-  for (struct list_elem *e = list_rbegin (&buffer_cache); 
-       e != list_rend (&buffer_cache);) 
-    { 
-      struct cache_block *block = list_entry (e, struct cache_block, elem);
-      /* Write back only dirty block. */
-      if (block->dirty) 
+  while (true)
+    {
+      timer_sleep (cache_writeback_interval);
+
+      lock_acquire (&dirty_lock);
+      if (!writeback_kicked && writeback_needed ())
         {
-          if (write_lock_try_acquire (&block->rw_lock))
-            {
-              /* Checks whether block has been evicted while acquiring the lock. */
-              if (block->valid && block->dirty)
-                {
-                  block_write (fs_device, block->sector, block->data);
-                  block->dirty = false;
-                }
-              write_lock_release (&block->rw_lock);
-            }
+          writeback_kicked = true;
+          sema_up (&writeback_sema);
         }
+      lock_release (&dirty_lock);
+    }
+}
+
+/* Throttle a thread that has just dirtied cache blocks.  If more
+   than cache_dirty_ratio percent of the cache is dirty, the
+   thread writes back batches itself until it is not, instead of
+   leaving foreground eviction to find only dirty blocks. */
+void
+cache_throttle_writer (void)
+{
+  size_t limit = MAX_CACHE_SIZE * cache_dirty_ratio / 100;
 
-      lock_acquire (&cache_lock);
-      e = list_prev (e);
-      lock_release (&cache_lock);
+  lock_acquire (&dirty_lock);
+  while (dirty_cnt > limit)
+    {
+      lock_release (&dirty_lock);
+      size_t written = write_batch (false, false);
+      lock_acquire (&dirty_lock);
+      if (written == 0)
+        break;
     }
+  lock_release (&dirty_lock);
+}
+
+/* Compares the sectors of the cache blocks that A and B point to. */
+static int
+compare_sectors (const void *a_, const void *b_)
+{
+  const struct cache_block *a = *(struct cache_block * const *) a_;
+  const struct cache_block *b = *(struct cache_block * const *) b_;
+  return a->sector < b->sector ? -1 : a->sector > b->sector;
 }
 
+/* Write back up to WRITEBACK_BATCH of the oldest dirty blocks, in
+   sector order so that the disk sees ascending requests.  If
+   EXPIRED_ONLY, only blocks that have been dirty for at least
+   cache_dirty_expire ticks are written.  Blocks in use are
+   skipped, unless WAIT, in which case the caller waits for them.
+   Returns the number of blocks written. */
+static size_t
+write_batch (bool expired_only, bool wait)
+{
+  struct cache_block *batch[WRITEBACK_BATCH];
+  size_t cnt = 0;
+
+  lock_acquire (&dirty_lock);
+  for (struct list_elem *e = list_begin (&dirty_blocks);
+       e != list_end (&dirty_blocks) && cnt < WRITEBACK_BATCH;
+       e = list_next (e))
+    {
+      struct cache_block *block = list_entry (e, struct cache_block,
+                                              dirty_elem);
+      if (expired_only
+          && timer_elapsed (block->dirty_since) < cache_dirty_expire)
+        break;
+      batch[cnt++] = block;
+    }
+  lock_release (&dirty_lock);
+
+  /* The sectors may change before the blocks are locked, in which
+     case the order is only approximate. */
+  qsort (batch, cnt, sizeof *batch, compare_sectors);
+
+  size_t written = 0;
+  for (size_t i = 0; i < cnt; i++)
+    {
+      struct cache_block *block = batch[i];
+      if (wait)
+        write_lock_acquire (&block->rw_lock);
+      else if (!write_lock_try_acquire (&block->rw_lock))
+        continue;
+
+      /* Checks whether block has been written back meanwhile. */
+      if (block->dirty && !block->logged)
+        {
+          block_write (fs_device, block->sector, block->data);
+          mark_block_clean (block);
+          written++;
+        }
+      rw_lock_release (&block->rw_lock);
+    }
+  return written;
+}
+
+/* Write back all dirty blocks inside buffer cache to disk,
+   except those logged by the running journal transaction.
+   Only the dirty blocks are visited, in sector-sorted batches,
+   waiting for blocks in use, until none remain dirty. */
+void
+cache_flush (void)
+{
+  lock_acquire (&dirty_lock);
+  while (!list_empty (&dirty_blocks))
+    {
+      lock_release (&dirty_lock);
+      write_batch (false, true);
+      lock_acquire (&dirty_lock);
+    }
+  lock_release (&dirty_lock);
+}
@@ -7,6 +7,12 @@
 
 #define MAX_CACHE_SIZE 64
 
+/* Write-behind tunables, see cache.c. */
+extern unsigned cache_dirty_background_ratio;
+extern unsigned cache_dirty_ratio;
+extern int64_t cache_dirty_expire;
+extern int64_t cache_writeback_interval;
+
 struct cache_block;
 
 
@@ -15,10 +21,16 @@ struct cache_block * cache_get_block (block_sector_t sector, bool exclusive);
 void cache_put_block (struct cache_block *);
 void *cache_read_block (struct cache_block *);
 void *cache_zero_block (struct cache_block *);
-void cache_mark_block_dirty (struct cache_block *);
+void cache_mark_block_dirty (struct cache_block *, struct list *owner);
+void cache_log_block (struct cache_block *);
+void cache_checkpoint_block (block_sector_t);
+void cache_sync_blocks (struct list *owner);
+void cache_disown_blocks (struct list *owner);
 void cache_read_ahead (block_sector_t);
 void cache_read_ahead_daemon (void *);
 void cache_write_behind_daemon (void *);
+void cache_write_behind_timer (void *);
+void cache_throttle_writer (void);
 void cache_flush (void);
 
 #endif  /* filesys/cache.h */
@@ -0,0 +1,185 @@
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* A cached directory entry.
+
+   Maps NAME inside the directory whose inode is in sector DIR to
+   the sector of the named inode, or records that no such name
+   exists (a negative entry).  Entries are only created and
+   removed while the lock of directory DIR is held, which orders
+   them with respect to the on-disk updates made by dir_add() and
+   dir_remove(). */
+struct dentry
+  {
+    struct hash_elem hash_elem;         /* Element in DENTRIES. */
+    struct list_elem lru_elem;          /* Element in LRU. */
+    block_sector_t dir;                 /* Sector of parent directory. */
+    block_sector_t sector;              /* Sector of named inode. */
+    bool negative;                      /* True if NAME does not exist. */
+    const char *name;                   /* Name within DIR. */
+  };
+
+static struct hash dentries;            /* All cached entries. */
+static struct list lru;                 /* Most recently used first. */
+static size_t dentry_cnt;               /* Number of cached entries. */
+static struct lock dcache_lock;         /* Protects all of the above. */
+
+static hash_hash_func dentry_hash;
+static hash_less_func dentry_less;
+static struct dentry *find (block_sector_t dir, const char *name);
+static void insert (block_sector_t dir, const char *name,
+                    block_sector_t sector, bool negative);
+static void evict (struct dentry *);
+
+/* Initializes the dentry cache. */
+void
+dcache_init (void)
+{
+  hash_init (&dentries, dentry_hash, dentry_less, NULL);
+  list_init (&lru);
+  dentry_cnt = 0;
+  lock_init (&dcache_lock);
+}
+
+/* Looks up NAME in the directory whose inode is in sector DIR.
+   Returns DCACHE_HIT and stores the sector of the named inode in
+   *SECTOR, DCACHE_NEGATIVE if NAME is known not to exist, or
+   DCACHE_MISS if the directory has to be searched. */
+enum dcache_result
+dcache_lookup (block_sector_t dir, const char *name, block_sector_t *sector)
+{
+  enum dcache_result result = DCACHE_MISS;
+
+  lock_acquire (&dcache_lock);
+  struct dentry *d = find (dir, name);
+  if (d != NULL)
+    {
+      list_remove (&d->lru_elem);
+      list_push_front (&lru, &d->lru_elem);
+      if (d->negative)
+        result = DCACHE_NEGATIVE;
+      else
+        {
+          *sector = d->sector;
+          result = DCACHE_HIT;
+        }
+    }
+  lock_release (&dcache_lock);
+
+  return result;
+}
+
+/* Records that NAME in the directory whose inode is in sector
+   DIR refers to the inode in SECTOR. */
+void
+dcache_insert (block_sector_t dir, const char *name, block_sector_t sector)
+{
+  insert (dir, name, sector, false);
+}
+
+/* Records that the directory whose inode is in sector DIR has no
+   entry named NAME. */
+void
+dcache_insert_negative (block_sector_t dir, const char *name)
+{
+  insert (dir, name, 0, true);
+}
+
+/* Forgets anything cached about NAME in the directory whose
+   inode is in sector DIR. */
+void
+dcache_invalidate (block_sector_t dir, const char *name)
+{
+  lock_acquire (&dcache_lock);
+  struct dentry *d = find (dir, name);
+  if (d != NULL)
+    evict (d);
+  lock_release (&dcache_lock);
+}
+
+/* Caches NAME in DIR, replacing any existing entry for it and
+   evicting the least recently used entry if the cache is full.
+   Silently does nothing if memory is short, since the cache is
+   only an optimization. */
+static void
+insert (block_sector_t dir, const char *name, block_sector_t sector,
+        bool negative)
+{
+  size_t name_len = strlen (name) + 1;
+  struct dentry *d = malloc (sizeof *d + name_len);
+  if (d == NULL)
+    return;
+
+  memcpy (d + 1, name, name_len);
+  d->name = (const char *) (d + 1);
+  d->dir = dir;
+  d->sector = sector;
+  d->negative = negative;
+
+  lock_acquire (&dcache_lock);
+  struct hash_elem *old = hash_replace (&dentries, &d->hash_elem);
+  if (old != NULL)
+    {
+      struct dentry *o = hash_entry (old, struct dentry, hash_elem);
+      list_remove (&o->lru_elem);
+      free (o);
+    }
+  else if (++dentry_cnt > DCACHE_SIZE)
+    evict (list_entry (list_back (&lru), struct dentry, lru_elem));
+  list_push_front (&lru, &d->lru_elem);
+  lock_release (&dcache_lock);
+}
+
+/* Returns the entry for NAME in DIR, or a null pointer if there
+   is none.  Must be called with dcache_lock held. */
+static struct dentry *
+find (block_sector_t dir, const char *name)
+{
+  struct dentry key;
+  struct hash_elem *e;
+
+  ASSERT (lock_held_by_current_thread (&dcache_lock));
+
+  key.dir = dir;
+  key.name = name;
+  e = hash_find (&dentries, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct dentry, hash_elem) : NULL;
+}
+
+/* Removes D from the cache and frees it.
+   Must be called with dcache_lock held. */
+static void
+evict (struct dentry *d)
+{
+  ASSERT (lock_held_by_current_thread (&dcache_lock));
+
+  hash_delete (&dentries, &d->hash_elem);
+  list_remove (&d->lru_elem);
+  dentry_cnt--;
+  free (d);
+}
+
+/* Returns a hash value for dentry E. */
+static unsigned
+dentry_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct dentry *d = hash_entry (e, struct dentry, hash_elem);
+  return hash_string (d->name) ^ hash_int (d->dir);
+}
+
+/* Returns true if dentry A precedes dentry B. */
+static bool
+dentry_less (const struct hash_elem *a_, const struct hash_elem *b_,
+             void *aux UNUSED)
+{
+  const struct dentry *a = hash_entry (a_, struct dentry, hash_elem);
+  const struct dentry *b = hash_entry (b_, struct dentry, hash_elem);
+  if (a->dir != b->dir)
+    return a->dir < b->dir;
+  return strcmp (a->name, b->name) < 0;
+}
@@ -0,0 +1,26 @@
+#ifndef FILESYS_DCACHE_H
+#define FILESYS_DCACHE_H
+
+#include "devices/block.h"
+
+/* Maximum number of cached directory entries, positive and
+   negative together. */
+#define DCACHE_SIZE 1024
+
+/* Result of a dentry cache lookup. */
+enum dcache_result
+  {
+    DCACHE_MISS,                /* Nothing known, scan the directory. */
+    DCACHE_HIT,                 /* Name exists, sector returned. */
+    DCACHE_NEGATIVE             /* Name is known not to exist. */
+  };
+
+void dcache_init (void);
+enum dcache_result dcache_lookup (block_sector_t dir, const char *name,
+                                  block_sector_t *sector);
+void dcache_insert (block_sector_t dir, const char *name,
+                    block_sector_t sector);
+void dcache_insert_negative (block_sector_t dir, const char *name);
+void dcache_invalidate (block_sector_t dir, const char *name);
+
+#endif /* filesys/dcache.h */
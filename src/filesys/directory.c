@@ -1,12 +1,15 @@
 #include "filesys/directory.h"
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
+#include <round.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
-#include "threads/palloc.h"
-#include "threads/vaddr.h"
 #include "threads/thread.h"
 #include <user/errno.h>
 
@@ -14,23 +17,185 @@
 struct dir 
   {
     struct inode *inode;                /* Backing store. */
-    off_t pos;                          /* Current position. */
+    uint64_t pos;                       /* dir_iterate() cookie. */
   };
 
-/* A single directory entry. */
+/* On-disk directory format.
+
+   A directory is a sequence of BLOCK_SECTOR_SIZE blocks, each
+   starting with a struct dir_block_header.  A small directory is
+   a single leaf block holding its entries in no particular
+   order.  When that block overflows it becomes the root of a
+   hash index: its entries move to a new leaf and block 0 instead
+   holds a table of (hash, block) pairs sorted by hash, each
+   naming the leaf (or, once the root itself fills, the second
+   level index block) that holds the names whose hash is at least
+   that value and below the next pair's.  Finding a name
+   therefore reads at most three blocks regardless of the size of
+   the directory.
+
+   Entries in a leaf are variable-length records that tile the
+   block after its header, each recording the distance to the
+   next, so short names take little space.  Removing an entry
+   merges its record into the previous one; only the first record
+   of a leaf can be free.  A full leaf is split at the median hash
+   of its entries into a new block appended to the directory, so
+   all entries with equal hashes always share a leaf.  Leaves are
+   not merged again when entries are removed.  dir_readdir()
+   returns entries in hash order, so that splits, which move
+   entries between blocks but never change their hashes, do not
+   disturb a listing in progress.
+
+   A zero-filled block is an empty leaf, so a newly created,
+   zero-length directory needs no initialization. */
+
+/* Kinds of directory block. */
+enum dir_block_type
+  {
+    DIR_LEAF = 0,                       /* Holds directory entries. */
+    DIR_INDEX = 1                       /* Holds (hash, block) pairs. */
+  };
+
+/* Header at the start of every directory block. */
+struct dir_block_header
+  {
+    uint16_t type;                      /* A dir_block_type. */
+    uint16_t count;                     /* Number of entries in use. */
+    uint16_t depth;                     /* Root only: index levels below. */
+    uint16_t unused;
+  };
+
+/* A single directory entry.  No inode lives in sector 0, which
+   holds the free map, so INODE_SECTOR 0 marks a free record. */
 struct dir_entry 
   {
     block_sector_t inode_sector;        /* Sector number of header. */
-    char name[NAME_MAX + 1];            /* Null terminated file name. */
-    bool in_use;                        /* In use or free? */
+    uint16_t rec_len;                   /* Bytes up to the next record. */
+    uint8_t name_len;                   /* Length of NAME. */
+    uint8_t type;                       /* A dir_entry_type. */
+    char name[];                        /* File name, not null terminated. */
+  };
+
+/* Kinds of inode a directory entry refers to. */
+enum dir_entry_type
+  {
+    DIR_TYPE_FILE = 1,                  /* Ordinary file. */
+    DIR_TYPE_DIR = 2                    /* Directory. */
+  };
+
+/* An entry of an index block. */
+struct dir_index_entry
+  {
+    uint32_t hash;                      /* Lowest hash found in BLOCK. */
+    uint32_t block;                     /* Block number within directory. */
   };
 
-/* Creates a directory with space for ENTRY_CNT entries in the
-   given SECTOR.  Returns true if successful, false on failure. */
+/* Offset of the first record in a leaf. */
+#define DIR_LEAF_START sizeof (struct dir_block_header)
+/* Upper bound on the entries in a leaf. */
+#define DIR_LEAF_CNT ((BLOCK_SECTOR_SIZE - DIR_LEAF_START) \
+                      / sizeof (struct dir_entry))
+#define DIR_INDEX_CNT ((BLOCK_SECTOR_SIZE - sizeof (struct dir_block_header)) \
+                       / sizeof (struct dir_index_entry))
+
+/* Index levels below the root.  Two levels address more leaves
+   than an inode can hold, even with one 255-byte name per
+   leaf. */
+#define DIR_MAX_DEPTH 2
+
+/* A directory block. */
+union dir_block
+  {
+    struct dir_block_header h;
+    struct
+      {
+        struct dir_block_header h;
+        struct dir_index_entry entries[DIR_INDEX_CNT];
+      } index;
+    uint8_t raw[BLOCK_SECTOR_SIZE];
+  };
+
+/* The blocks visited while looking up a name. */
+struct dir_path
+  {
+    int levels;                         /* Index blocks visited. */
+    uint32_t index[DIR_MAX_DEPTH + 1];  /* Index blocks, root first. */
+    int slot[DIR_MAX_DEPTH + 1];        /* Entry followed in each. */
+    uint32_t leaf;                      /* Leaf block reached. */
+  };
+
+static void read_block (struct inode *, uint32_t, union dir_block *);
+static bool write_block (struct inode *, uint32_t, const union dir_block *);
+static uint32_t new_block (struct inode *);
+static uint32_t find_leaf (struct inode *, uint32_t hash, union dir_block *,
+                           struct dir_path *);
+static size_t leaf_find (union dir_block *, const char *name, size_t len,
+                         size_t *prevp);
+static bool leaf_insert (union dir_block *, const char *name, size_t len,
+                         block_sector_t, uint8_t type);
+static void leaf_remove (union dir_block *, size_t ofs, size_t prev);
+static bool split (struct inode *, const struct dir_path *, union dir_block *,
+                   uint32_t hash);
+static bool dir_is_empty (struct inode *);
+
+/* Returns the hash of the LEN-byte NAME that places it in the
+   index. */
+static uint32_t
+dir_hash (const char *name, size_t len)
+{
+  return hash_bytes (name, len);
+}
+
+/* Returns the bytes taken by an entry with a LEN-byte name. */
+static size_t
+entry_size (size_t len)
+{
+  return ROUND_UP (sizeof (struct dir_entry) + len, sizeof (uint32_t));
+}
+
+/* Returns the entry at byte offset OFS of leaf B. */
+static struct dir_entry *
+entry_at (union dir_block *b, size_t ofs)
+{
+  ASSERT (ofs >= DIR_LEAF_START && ofs < BLOCK_SECTOR_SIZE);
+  return (struct dir_entry *) (b->raw + ofs);
+}
+
+/* Returns the offset of the entry following the one at OFS in
+   leaf B, which is BLOCK_SECTOR_SIZE after the last entry. */
+static size_t
+entry_next (union dir_block *b, size_t ofs)
+{
+  size_t rec_len = entry_at (b, ofs)->rec_len;
+  ASSERT (rec_len >= sizeof (struct dir_entry)
+          && ofs + rec_len <= BLOCK_SECTOR_SIZE);
+  return ofs + rec_len;
+}
+
+/* Returns true if E is the "." or ".." entry. */
+static bool
+entry_is_dot (const struct dir_entry *e)
+{
+  return (e->name_len == 1 && e->name[0] == '.')
+         || (e->name_len == 2 && e->name[0] == '.' && e->name[1] == '.');
+}
+
+/* Makes B an empty leaf. */
+static void
+leaf_init (union dir_block *b)
+{
+  memset (b, 0, sizeof *b);
+  b->h.type = DIR_LEAF;
+  entry_at (b, DIR_LEAF_START)->rec_len = BLOCK_SECTOR_SIZE - DIR_LEAF_START;
+}
+
+/* Creates an empty directory in the given SECTOR.
+   Returns true if successful, false on failure. */
 bool
-dir_create (block_sector_t sector, size_t entry_cnt)
+dir_create (block_sector_t sector)
 {
-  return inode_create (sector, entry_cnt * sizeof (struct dir_entry), true);
+  ASSERT (sizeof (union dir_block) == BLOCK_SECTOR_SIZE);
+  return inode_create (sector, 0, true);
 }
 
 /* Opens and returns the directory for the given INODE, of which
@@ -98,10 +263,11 @@ dir_traverse_path (const char *path, bool is_dir)
   bool rightmost_dir = false;
 
   /* Copy the given name, including path, for the file. */
-  char *path_copy = palloc_get_page (0);   
+  size_t path_size = strlen (path) + 1;
+  char *path_copy = malloc (path_size);
   if (path_copy == NULL)     
     return NULL;   
-  strlcpy (path_copy, path, PGSIZE);
+  memcpy (path_copy, path, path_size);
 
   /* Extract file name from the path */
   char *file_name;
@@ -145,7 +311,7 @@ dir_traverse_path (const char *path, bool is_dir)
       if (!dir_lookup (dir, dir_name, &inode))
         {
           dir_close (dir);
-          palloc_free_page (path_copy);
+          free (path_copy);
           return NULL;
         }
 
@@ -159,57 +325,247 @@ dir_traverse_path (const char *path, bool is_dir)
     }
 
 traverse_done:
-  palloc_free_page (path_copy);
+  free (path_copy);
   return dir;
 }
 
-/* Searches DIR for a file with the given NAME.
-   If successful, returns true, sets *EP to the directory entry
-   if EP is non-null, and sets *OFSP to the byte offset of the
-   directory entry if OFSP is non-null.
-   otherwise, returns false and ignores EP and OFSP. */
+/* Reads directory block BLOCK of INODE into B.  Blocks past the
+   end of the directory read as empty leaves. */
+static void
+read_block (struct inode *inode, uint32_t block, union dir_block *b)
+{
+  off_t ofs = (off_t) block * BLOCK_SECTOR_SIZE;
+  off_t n = inode_read_at (inode, b, BLOCK_SECTOR_SIZE, ofs);
+  if (n < 0)
+    n = 0;
+  memset (b->raw + n, 0, BLOCK_SECTOR_SIZE - n);
+
+  /* A zero-filled block is an empty leaf. */
+  if (b->h.type == DIR_LEAF && entry_at (b, DIR_LEAF_START)->rec_len == 0)
+    leaf_init (b);
+}
+
+/* Writes B to directory block BLOCK of INODE.
+   Returns true if successful, false on a disk or memory error. */
 static bool
-lookup (const struct dir *dir, const char *name,
-        struct dir_entry *ep, off_t *ofsp) 
+write_block (struct inode *inode, uint32_t block, const union dir_block *b)
+{
+  off_t ofs = (off_t) block * BLOCK_SECTOR_SIZE;
+  return inode_write_at (inode, b, BLOCK_SECTOR_SIZE, ofs)
+         == BLOCK_SECTOR_SIZE;
+}
+
+/* Returns the number of the block just past the end of the
+   directory in INODE.  Block 0 always exists, even in a
+   zero-length directory. */
+static uint32_t
+new_block (struct inode *inode)
 {
-  struct dir_entry e;
-  size_t ofs;
-  
+  uint32_t cnt = DIV_ROUND_UP (inode_length (inode), BLOCK_SECTOR_SIZE);
+  return cnt > 0 ? cnt : 1;
+}
+
+/* Returns the slot of the last entry of index block B whose hash
+   is not above HASH, using binary search. */
+static int
+index_find (const union dir_block *b, uint32_t hash)
+{
+  int lo = 0, hi = b->h.count;
+
+  ASSERT (b->h.type == DIR_INDEX && b->h.count > 0);
+  while (hi - lo > 1)
+    {
+      int mid = (lo + hi) / 2;
+      if (b->index.entries[mid].hash <= hash)
+        lo = mid;
+      else
+        hi = mid;
+    }
+  return lo;
+}
+
+/* Walks the index of directory INODE down to the leaf that holds
+   names with the given HASH, reading it into B, and records the
+   blocks visited in *PATH.  Returns the leaf's block number. */
+static uint32_t
+find_leaf (struct inode *inode, uint32_t hash, union dir_block *b,
+           struct dir_path *path)
+{
+  uint32_t block = 0;
+
+  path->levels = 0;
+  read_block (inode, block, b);
+  while (b->h.type == DIR_INDEX && path->levels <= DIR_MAX_DEPTH)
+    {
+      int slot = index_find (b, hash);
+      path->index[path->levels] = block;
+      path->slot[path->levels] = slot;
+      path->levels++;
+      block = b->index.entries[slot].block;
+      read_block (inode, block, b);
+    }
+  ASSERT (b->h.type == DIR_LEAF);
+
+  path->leaf = block;
+  return block;
+}
+
+/* Returns the offset of the entry for the LEN-byte NAME in leaf
+   B, or 0 if B has no such entry.  If PREVP is non-null, sets
+   *PREVP to the offset of the preceding entry, or to 0 if the
+   entry is the first in B. */
+static size_t
+leaf_find (union dir_block *b, const char *name, size_t len, size_t *prevp)
+{
+  size_t prev = 0;
+
+  for (size_t ofs = DIR_LEAF_START; ofs < BLOCK_SECTOR_SIZE;
+       ofs = entry_next (b, ofs))
+    {
+      struct dir_entry *e = entry_at (b, ofs);
+      if (e->inode_sector != 0 && e->name_len == len
+          && !memcmp (e->name, name, len))
+        {
+          if (prevp != NULL)
+            *prevp = prev;
+          return ofs;
+        }
+      prev = ofs;
+    }
+  return 0;
+}
+
+/* Adds an entry for the LEN-byte NAME and the inode in SECTOR,
+   of the given dir_entry_type TYPE, to leaf B, in the first
+   record with enough unused space.
+   Returns false if B has no room for it. */
+static bool
+leaf_insert (union dir_block *b, const char *name, size_t len,
+             block_sector_t sector, uint8_t type)
+{
+  size_t need = entry_size (len);
+
+  ASSERT (sector != 0);
+  for (size_t ofs = DIR_LEAF_START; ofs < BLOCK_SECTOR_SIZE;
+       ofs = entry_next (b, ofs))
+    {
+      struct dir_entry *e = entry_at (b, ofs);
+      size_t used = e->inode_sector != 0 ? entry_size (e->name_len) : 0;
+      if (e->rec_len - used < need)
+        continue;
+
+      /* Carve the new entry out of the end of E's record. */
+      if (used > 0)
+        {
+          struct dir_entry *new = entry_at (b, ofs + used);
+          new->rec_len = e->rec_len - used;
+          e->rec_len = used;
+          e = new;
+        }
+      e->inode_sector = sector;
+      e->name_len = len;
+      e->type = type;
+      memcpy (e->name, name, len);
+      b->h.count++;
+      return true;
+    }
+  return false;
+}
+
+/* Removes the entry at OFS from leaf B, where PREV is the offset
+   of the preceding entry as returned by leaf_find().  The freed
+   record is merged into the preceding one, if any. */
+static void
+leaf_remove (union dir_block *b, size_t ofs, size_t prev)
+{
+  struct dir_entry *e = entry_at (b, ofs);
+
+  if (prev != 0)
+    entry_at (b, prev)->rec_len += e->rec_len;
+  else
+    {
+      e->inode_sector = 0;
+      e->name_len = 0;
+    }
+  b->h.count--;
+}
+
+/* Searches DIR for a file with the given NAME and sets *SECTOR
+   to the sector of its inode, or to 0 if there is no such file.
+   Returns false, without searching, if memory allocation
+   fails. */
+static bool
+lookup (const struct dir *dir, const char *name, block_sector_t *sector) 
+{
+  struct dir_path path;
+  union dir_block *b;
+  size_t len, ofs;
+
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (e.in_use && !strcmp (name, e.name)) 
-      {
-        if (ep != NULL)
-          *ep = e;
-        if (ofsp != NULL)
-          *ofsp = ofs;
-        return true;
-      }
-  return false;
+  b = malloc (sizeof *b);
+  if (b == NULL)
+    return false;
+
+  len = strlen (name);
+  find_leaf (dir->inode, dir_hash (name, len), b, &path);
+  ofs = leaf_find (b, name, len, NULL);
+  *sector = ofs != 0 ? entry_at (b, ofs)->inode_sector : 0;
+
+  free (b);
+  return true;
 }
 
 /* Searches DIR for a file with the given NAME
    and returns true if one exists, false otherwise.
    On success, sets *INODE to an inode for the file, otherwise to
-   a null pointer.  The caller must close *INODE. */
+   a null pointer.  The caller must close *INODE.
+
+   The answer is taken from the dentry cache when possible, so
+   that resolving the same path again does not parse the
+   directory.  The directory lock is still held, shared with
+   other lookups, around the cache lookup and inode_open(), so
+   that dir_remove() cannot free the inode in between. */
 bool
 dir_lookup (const struct dir *dir, const char *name,
             struct inode **inode) 
 {
-  struct dir_entry e;
+  block_sector_t dir_sector, sector;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  inode_lock_acquire (dir->inode);
+  dir_sector = inode_get_inumber (dir->inode);
+  inode_lock_acquire_shared (dir->inode);
 
-  if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
-  else
-    *inode = NULL;
+  switch (dcache_lookup (dir_sector, name, &sector))
+    {
+    case DCACHE_HIT:
+      *inode = inode_open (sector);
+      break;
+
+    case DCACHE_NEGATIVE:
+      *inode = NULL;
+      break;
+
+    case DCACHE_MISS:
+      /* Running out of memory says nothing about NAME, so only a
+         real miss is remembered. */
+      if (!lookup (dir, name, &sector))
+        *inode = NULL;
+      else if (sector != 0)
+        {
+          dcache_insert (dir_sector, name, sector);
+          *inode = inode_open (sector);
+        }
+      else
+        {
+          dcache_insert_negative (dir_sector, name);
+          *inode = NULL;
+        }
+      break;
+    }
 
   inode_lock_release (dir->inode);
 
@@ -218,127 +574,529 @@ dir_lookup (const struct dir *dir, const char *name,
 
 /* Adds a file named NAME to DIR, which must not already contain a
    file by that name.  The file's inode is in sector
-   INODE_SECTOR.
+   INODE_SECTOR and is a directory if IS_DIR is true.
    Returns true if successful, false on failure.
-   Fails if NAME is invalid (i.e. too long) or a disk or memory
-   error occurs. */
+   Fails if NAME is invalid (i.e. too long), if the directory is
+   full, or if a disk or memory error occurs. */
 bool
-dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
+dir_add (struct dir *dir, const char *name, block_sector_t inode_sector,
+         bool is_dir)
 {
-  struct dir_entry e;
-  off_t ofs;
+  struct dir_path path;
+  union dir_block *b;
+  uint32_t hash;
+  size_t len;
   bool success = false;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
   /* Check NAME for validity. */
-  if (*name == '\0' || strlen (name) > NAME_MAX)
+  len = strlen (name);
+  if (len == 0 || len > NAME_MAX)
     {
       thread_current ()->errno = ENAME;
       return false;
     }
 
+  b = malloc (sizeof *b);
+  if (b == NULL)
+    return false;
+  hash = dir_hash (name, len);
+
   inode_lock_acquire (dir->inode);
-  /* Check that NAME is not in use. */
-  if (lookup (dir, name, NULL, NULL))
+  /* Check that NAME is not in use.  Only the leaf for its hash
+     can contain it. */
+  find_leaf (dir->inode, hash, b, &path);
+  if (leaf_find (b, name, len, NULL) != 0)
     goto done;
 
-  /* Set OFS to offset of free slot.
-     If there are no free slots, then it will be set to the
-     current end-of-file.
-     
-     inode_read_at() will only return a short read at end of file.
-     Otherwise, we'd need to verify that we didn't get a short
-     read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (!e.in_use)
-      break;
+  /* Add the entry, splitting the leaf as often as needed to make
+     room for it. */
+  while (!leaf_insert (b, name, len, inode_sector,
+                       is_dir ? DIR_TYPE_DIR : DIR_TYPE_FILE))
+    {
+      if (!split (dir->inode, &path, b, hash))
+        goto done;
+      find_leaf (dir->inode, hash, b, &path);
+    }
 
-  /* Write slot. */
-  e.in_use = true;
-  strlcpy (e.name, name, sizeof e.name);
-  e.inode_sector = inode_sector;
-  success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+  /* Write the leaf, replacing any negative dentry for NAME. */
+  dcache_invalidate (inode_get_inumber (dir->inode), name);
+  success = write_block (dir->inode, path.leaf, b);
+  if (success)
+    dcache_insert (inode_get_inumber (dir->inode), name, inode_sector);
 
  done:
   inode_lock_release (dir->inode);
+  free (b);
   return success;
 }
 
+/* Returns the hash at which to split leaf B so that an entry
+   with hash NEW_HASH can be added: the median hash of its
+   entries and the new one, moved up if necessary so that entries
+   with equal hashes stay together.  Returns 0 if all of them
+   have the same hash and the leaf cannot be split. */
+static uint32_t
+split_hash (union dir_block *b, uint32_t new_hash)
+{
+  uint32_t hashes[DIR_LEAF_CNT + 1];
+  int cnt = 0;
+
+  hashes[cnt++] = new_hash;
+  for (size_t ofs = DIR_LEAF_START; ofs < BLOCK_SECTOR_SIZE;
+       ofs = entry_next (b, ofs))
+    {
+      struct dir_entry *e = entry_at (b, ofs);
+      if (e->inode_sector != 0)
+        hashes[cnt++] = dir_hash (e->name, e->name_len);
+    }
+
+  /* Insertion sort; leaves are small. */
+  for (int i = 1; i < cnt; i++)
+    {
+      uint32_t h = hashes[i];
+      int j;
+      for (j = i; j > 0 && hashes[j - 1] > h; j--)
+        hashes[j] = hashes[j - 1];
+      hashes[j] = h;
+    }
+
+  for (int i = cnt / 2; i < cnt; i++)
+    if (hashes[i] != hashes[0])
+      return hashes[i];
+  return 0;
+}
+
+/* Inserts (HASH, BLOCK) into index block B after SLOT.
+   B must not be full. */
+static void
+index_insert (union dir_block *b, int slot, uint32_t hash, uint32_t block)
+{
+  ASSERT (b->h.count < DIR_INDEX_CNT);
+  memmove (&b->index.entries[slot + 2], &b->index.entries[slot + 1],
+           (b->h.count - slot - 1) * sizeof b->index.entries[0]);
+  b->index.entries[slot + 1].hash = hash;
+  b->index.entries[slot + 1].block = block;
+  b->h.count++;
+}
+
+/* Makes room in directory INODE below index block LEVEL of PATH,
+   which must be full, by giving the index one more level (if it
+   is the root) or by splitting it in two.  If its parent is full
+   as well, makes room there instead, and callers try again.
+   Returns true if successful, false if the directory cannot grow
+   or on a disk or memory error. */
+static bool
+split_index (struct inode *inode, const struct dir_path *path, int level)
+{
+  union dir_block *b = malloc (3 * sizeof *b);
+  union dir_block *new = b + 1;
+  union dir_block *parent = b + 2;
+  bool success = false;
+
+  if (b == NULL)
+    return false;
+  read_block (inode, path->index[level], b);
+  ASSERT (b->h.type == DIR_INDEX && b->h.count == DIR_INDEX_CNT);
+
+  if (level == 0)
+    {
+      /* Move the root's entries one level down. */
+      uint32_t block = new_block (inode);
+      if (b->h.depth >= DIR_MAX_DEPTH)
+        goto done;
+      memcpy (new, b, sizeof *b);
+      new->h.depth = 0;
+      if (!write_block (inode, block, new))
+        goto done;
+
+      b->h.depth++;
+      b->h.count = 1;
+      b->index.entries[0].hash = 0;
+      b->index.entries[0].block = block;
+      success = write_block (inode, 0, b);
+    }
+  else
+    {
+      /* Move the upper half into a new index block and link it
+         into the parent, which must have room for it. */
+      uint32_t block = new_block (inode);
+      int half = b->h.count / 2;
+
+      read_block (inode, path->index[level - 1], parent);
+      if (parent->h.count == DIR_INDEX_CNT)
+        {
+          success = split_index (inode, path, level - 1);
+          goto done;
+        }
+
+      memset (new, 0, sizeof *new);
+      new->h.type = DIR_INDEX;
+      new->h.count = b->h.count - half;
+      memcpy (new->index.entries, &b->index.entries[half],
+              new->h.count * sizeof b->index.entries[0]);
+      b->h.count = half;
+      if (!write_block (inode, block, new)
+          || !write_block (inode, path->index[level], b))
+        goto done;
+      index_insert (parent, path->slot[level - 1],
+                    new->index.entries[0].hash, block);
+      success = write_block (inode, path->index[level - 1], parent);
+    }
+
+ done:
+  free (b);
+  return success;
+}
+
+/* Splits LEAF, the leaf at the end of PATH in directory INODE,
+   to make room for an entry whose hash is HASH, or makes room in
+   the index so that it can be split.  Callers repeat the lookup
+   and call again while the leaf has no room.
+   Returns true if successful, false if the directory cannot grow
+   or on a disk or memory error. */
+static bool
+split (struct inode *inode, const struct dir_path *path,
+       union dir_block *leaf, uint32_t hash)
+{
+  union dir_block *b, *new, *old;
+  uint32_t block;
+  bool success = false;
+
+  /* The directory consists of a single leaf.  Move it to a new
+     block and turn block 0 into the root of the index. */
+  if (path->levels == 0)
+    {
+      block = new_block (inode);
+      if (!write_block (inode, block, leaf))
+        return false;
+
+      memset (leaf, 0, sizeof *leaf);
+      leaf->h.type = DIR_INDEX;
+      leaf->h.count = 1;
+      leaf->index.entries[0].hash = 0;
+      leaf->index.entries[0].block = block;
+      return write_block (inode, 0, leaf);
+    }
+
+  /* Make room in the parent first. */
+  b = malloc (3 * sizeof *b);
+  if (b == NULL)
+    return false;
+  new = b + 1;
+  old = b + 2;
+  read_block (inode, path->index[path->levels - 1], b);
+  if (b->h.count == DIR_INDEX_CNT)
+    {
+      success = split_index (inode, path, path->levels - 1);
+      goto done;
+    }
+
+  hash = split_hash (leaf, hash);
+  if (hash == 0)
+    goto done;
+
+  /* Redistribute the entries, those at or above HASH going into a
+     new leaf.  Rebuilding both leaves also packs them. */
+  memcpy (old, leaf, sizeof *old);
+  leaf_init (leaf);
+  leaf_init (new);
+  for (size_t ofs = DIR_LEAF_START; ofs < BLOCK_SECTOR_SIZE;
+       ofs = entry_next (old, ofs))
+    {
+      struct dir_entry *e = entry_at (old, ofs);
+      if (e->inode_sector != 0)
+        {
+          union dir_block *to = (dir_hash (e->name, e->name_len) >= hash
+                                 ? new : leaf);
+          if (!leaf_insert (to, e->name, e->name_len, e->inode_sector,
+                            e->type))
+            NOT_REACHED ();
+        }
+    }
+
+  block = new_block (inode);
+  index_insert (b, path->slot[path->levels - 1], hash, block);
+  success = (write_block (inode, block, new)
+             && write_block (inode, path->leaf, leaf)
+             && write_block (inode, path->index[path->levels - 1], b));
+
+ done:
+  free (b);
+  return success;
+}
+
+/* Returns true if directory INODE has no entries other than "."
+   and "..". */
+static bool
+dir_is_empty (struct inode *inode)
+{
+  union dir_block *b = malloc (sizeof *b);
+  uint32_t cnt = new_block (inode);
+  bool empty = true;
+
+  if (b == NULL)
+    return false;
+  for (uint32_t block = 0; block < cnt && empty; block++)
+    {
+      read_block (inode, block, b);
+      if (b->h.type != DIR_LEAF)
+        continue;
+      for (size_t ofs = DIR_LEAF_START; ofs < BLOCK_SECTOR_SIZE;
+           ofs = entry_next (b, ofs))
+        {
+          /* Ignore "." and ".." directory entries */
+          struct dir_entry *e = entry_at (b, ofs);
+          if (e->inode_sector != 0 && !entry_is_dot (e))
+            {
+              empty = false;
+              break;
+            }
+        }
+    }
+  free (b);
+  return empty;
+}
+
 /* Removes any entry for NAME in DIR.
    Returns true if successful, false on failure,
    which occurs only if there is no file with the given NAME. */
 bool
 dir_remove (struct dir *dir, const char *name) 
 {
-  struct dir_entry e;
+  struct dir_path path;
   struct inode *inode = NULL;
+  union dir_block *b;
+  block_sector_t sector;
   bool success = false;
-  off_t ofs;
+  size_t len, ofs, prev;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  b = malloc (sizeof *b);
+  if (b == NULL)
+    return false;
+
+  journal_begin (JOURNAL_OP_CREDITS);
   inode_lock_acquire (dir->inode);
   /* Find directory entry. */
-  if (!lookup (dir, name, &e, &ofs))
+  len = strlen (name);
+  find_leaf (dir->inode, dir_hash (name, len), b, &path);
+  ofs = leaf_find (b, name, len, &prev);
+  if (ofs == 0)
     goto done;
+  sector = entry_at (b, ofs)->inode_sector;
 
   /* Open inode. */
-  inode = inode_open (e.inode_sector);
+  inode = inode_open (sector);
   if (inode == NULL)
     goto done;
 
   /* If it is directory, remove only when it is empty. */
-  if (inode_is_dir (inode))
-    {
-      struct dir_entry e;
-      off_t ofs;
-
-      for (ofs = 0; inode_read_at (inode, &e, sizeof e, ofs) == sizeof e;
-           ofs += sizeof e) 
-        {
-          /* Ignore "." and ".." directory entries */
-          if (e.in_use && strcmp (e.name, ".") && strcmp (e.name, ".."))
-            goto done;
-        }
-    }
+  if (inode_is_dir (inode) && !dir_is_empty (inode))
+    goto done;
 
   /* Erase directory entry. */
-  e.in_use = false;
-  if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
+  leaf_remove (b, ofs, prev);
+  dcache_invalidate (inode_get_inumber (dir->inode), name);
+  if (!write_block (dir->inode, path.leaf, b))
     goto done;
 
-  /* Remove inode. */
+  /* Remove inode.  A removed directory keeps its "." and ".."
+     entries on disk, so drop them from the dentry cache before
+     the sector can be reused. */
+  if (inode_is_dir (inode))
+    {
+      dcache_invalidate (sector, ".");
+      dcache_invalidate (sector, "..");
+    }
   inode_remove (inode);
   success = true;
 
 done:
   inode_lock_release (dir->inode);
+  journal_end ();
+
+  /* Closing the last opener deletes the inode's blocks, which is
+     done in handles of its own if this is not nested in another
+     one. */
   inode_close (inode);
+  free (b);
   return success;
 }
 
-/* Reads the next directory entry in DIR and stores the name in
-   NAME.  Returns true if successful, false if the directory
-   contains no more entries. */
-bool
-dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
+/* dir_iterate() position once no entries remain. */
+#define DIR_POS_END UINT64_MAX
+
+/* Returns the dir_iterate() position of the entry that follows
+   the first MINOR entries, in name order, whose hash is HASH. */
+static uint64_t
+make_pos (uint32_t hash, uint32_t minor)
+{
+  return ((uint64_t) hash << 32) | minor;
+}
+
+/* Compares the names of entries A and B the way memcmp() does,
+   a name that is a prefix of another sorting first. */
+static int
+entry_name_cmp (const struct dir_entry *a, const struct dir_entry *b)
 {
-  struct dir_entry e;
+  size_t len = a->name_len < b->name_len ? a->name_len : b->name_len;
+  int cmp = memcmp (a->name, b->name, len);
+  return cmp != 0 ? cmp : a->name_len - b->name_len;
+}
 
-  while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
+/* Sets *HASH to the lowest hash held by the leaf after the one
+   at the end of PATH in directory INODE, reading index blocks
+   into B.  Returns false if that leaf is the last one. */
+static bool
+next_leaf_hash (struct inode *inode, const struct dir_path *path,
+                union dir_block *b, uint32_t *hash)
+{
+  for (int level = path->levels - 1; level >= 0; level--)
     {
-      dir->pos += sizeof e;
-      /* Ignore "." and ".." directory entries */
-      if (e.in_use && strcmp (e.name, ".") && strcmp (e.name, ".."))
+      read_block (inode, path->index[level], b);
+      if (path->slot[level] + 1 < b->h.count)
         {
-          strlcpy (name, e.name, NAME_MAX + 1);
+          *hash = b->index.entries[path->slot[level] + 1].hash;
           return true;
-        } 
+        }
     }
   return false;
 }
 
+/* Passes the entries of DIR, starting at its current position,
+   to FILL along with AUX until FILL returns false or the
+   directory contains no more entries.  The position advances
+   past each entry that FILL accepts, so that the next call
+   resumes with the entry that FILL rejected.  "." and ".." are
+   skipped.
+
+   Entries are returned in order of hash, and entries with equal
+   hashes in order of name.  DIR's position is an opaque cookie
+   holding the hash of the next entry and the number of entries
+   with that hash already returned.  Splitting a leaf moves
+   entries to other blocks but keeps their hashes, so a cookie
+   stays valid while entries are added, as it does when the
+   entry last returned is removed.  Only a name whose hash
+   collides with the one in the cookie can be skipped or
+   repeated.  Each leaf is read once per call, however many of
+   its entries FILL accepts. */
+void
+dir_iterate (struct dir *dir, dir_filldir_func *fill, void *aux)
+{
+  struct
+    {
+      union dir_block b;
+      struct
+        {
+          uint32_t hash;
+          uint16_t ofs;
+        }
+      order[DIR_LEAF_CNT];
+    }
+  *leaf = malloc (sizeof *leaf);
+  union dir_block *b = &leaf->b;
+  bool full = false;
+
+  if (leaf == NULL)
+    return;
+
+  inode_lock_acquire_shared (dir->inode);
+  while (!full && dir->pos != DIR_POS_END)
+    {
+      uint32_t hash = dir->pos >> 32;
+      uint32_t minor = (uint32_t) dir->pos;
+      uint32_t rank = 0;
+      struct dir_path path;
+      int cnt = 0;
+
+      /* Sort the leaf's entries at or above HASH. */
+      find_leaf (dir->inode, hash, b, &path);
+      for (size_t ofs = DIR_LEAF_START; ofs < BLOCK_SECTOR_SIZE;
+           ofs = entry_next (b, ofs))
+        {
+          /* Ignore "." and ".." directory entries */
+          struct dir_entry *e = entry_at (b, ofs);
+          uint32_t h;
+          int i;
+
+          if (e->inode_sector == 0 || entry_is_dot (e))
+            continue;
+          h = dir_hash (e->name, e->name_len);
+          if (h < hash)
+            continue;
+
+          for (i = cnt; i > 0; i--)
+            {
+              struct dir_entry *prev = entry_at (b, leaf->order[i - 1].ofs);
+              if (leaf->order[i - 1].hash < h
+                  || (leaf->order[i - 1].hash == h
+                      && entry_name_cmp (prev, e) < 0))
+                break;
+              leaf->order[i] = leaf->order[i - 1];
+            }
+          leaf->order[i].hash = h;
+          leaf->order[i].ofs = ofs;
+          cnt++;
+        }
+
+      for (int i = 0; i < cnt; i++)
+        {
+          struct dir_entry *e = entry_at (b, leaf->order[i].ofs);
+          uint32_t h = leaf->order[i].hash;
+
+          if (h == hash && rank++ < minor)
+            continue;
+          if (!fill (e->name, e->name_len, e->inode_sector,
+                     e->type == DIR_TYPE_DIR, aux))
+            {
+              full = true;
+              break;
+            }
+          if (h != hash)
+            {
+              hash = h;
+              rank = 1;
+              minor = 0;
+            }
+          dir->pos = make_pos (hash, rank);
+        }
+
+      if (!full)
+        dir->pos = (next_leaf_hash (dir->inode, &path, b, &hash)
+                    ? make_pos (hash, 0) : DIR_POS_END);
+    }
+  inode_lock_release (dir->inode);
+
+  free (leaf);
+}
+
+/* dir_filldir_func for dir_readdir().  Copies the first entry
+   into the buffer AUX and rejects the rest. */
+static bool
+readdir_fill (const char *name, size_t len, block_sector_t inumber UNUSED,
+              bool is_dir UNUSED, void *aux)
+{
+  char *buf = aux;
+
+  if (buf[0] != '\0')
+    return false;
+  memcpy (buf, name, len);
+  buf[len] = '\0';
+  return true;
+}
+
+/* Reads the next directory entry in DIR and stores the name in
+   NAME.  Returns true if successful, false if the directory
+   contains no more entries. */
+bool
+dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
+{
+  name[0] = '\0';
+  dir_iterate (dir, readdir_fill, name);
+  return name[0] != '\0';
+}
@@ -6,15 +6,14 @@
 #include "devices/block.h"
 
 /* Maximum length of a file name component.
-   This is the traditional UNIX maximum length.
-   After directories are implemented, this maximum length may be
-   retained, but much longer full path names must be allowed. */
-#define NAME_MAX 14
+   Directory entries store names in variable-length records, so
+   this only bounds the length of a single name. */
+#define NAME_MAX 255
 
 struct inode;
 
 /* Opening and closing directories. */
-bool dir_create (block_sector_t sector, size_t entry_cnt);
+bool dir_create (block_sector_t sector);
 struct dir *dir_open (struct inode *);
 struct dir *dir_open_root (void);
 struct dir *dir_reopen (struct dir *);
@@ -24,8 +23,17 @@ struct dir *dir_traverse_path (const char *path, bool is_dir);
 
 /* Reading and writing. */
 bool dir_lookup (const struct dir *, const char *name, struct inode **);
-bool dir_add (struct dir *, const char *name, block_sector_t);
+bool dir_add (struct dir *, const char *name, block_sector_t, bool is_dir);
 bool dir_remove (struct dir *, const char *name);
 bool dir_readdir (struct dir *, char name[NAME_MAX + 1]);
 
+/* Called by dir_iterate() for each directory entry, with the
+   LEN-byte NAME (not null terminated), the sector of the entry's
+   inode, and whether it is a directory.  Returns false to stop
+   before consuming the entry. */
+typedef bool dir_filldir_func (const char *name, size_t len,
+                               block_sector_t inumber, bool is_dir,
+                               void *aux);
+void dir_iterate (struct dir *, dir_filldir_func *, void *aux);
+
 #endif /* filesys/directory.h */
@@ -3,43 +3,32 @@
 #include "filesys/inode.h"
 #include "threads/malloc.h"
 #include "string.h"
-#include <list.h>
-#include "threads/synch.h"
 #include "lib/kernel/queue.h"
 #include "stdio.h"
 #include "devices/input.h"
 #include <user/errno.h>
-
-
-static struct list open_files;
-static struct lock open_files_lock;
+#include <atomic-ops.h>
 
 
 static int read_error (struct file *file);
 static int write_error (struct file *file);
 
-/* An open file. */
+/* An open file.
+   Files are not kept on any global list: an open file is reachable
+   only through the descriptors (or kernel pointers) that reference
+   it, so opening and closing never serialize across CPUs. */
 struct file 
   {
-    struct list_elem elem;      /* Element in open file list. */
     file_type type;             /* Type of file. */
     struct inode *inode;        /* File's inode. */
     off_t pos;                  /* Current position. */
     bool deny_write;            /* Has file_deny_write() been called? */
-    int ref_count;              /* Number of referencing fd. */
+    int ref_count;              /* Number of referencing fd.
+                                   Only updated atomically. */
     struct dir *dir;            /* Used when file is directory. */
     struct pipe *pipe;          /* Used when file is Pipe end. */
   };
 
-/* Initialize open file list, keeping track of files that provide 
-   layer of indirection between file descriptor and inode. */
-void
-file_init (void)
-{
-  list_init (&open_files);
-  lock_init (&open_files_lock);
-}
-
 /* Open console, STDIN or STDOUT, and returns as a file. */
 struct file *
 file_open_console (file_type type)
@@ -48,12 +37,11 @@ file_open_console (file_type type)
     return NULL;
 
   struct file *file = calloc (1, sizeof *file);
+  if (file == NULL)
+    return NULL;
+
   file->type = type;
   file->ref_count = 1;
-  
-  lock_acquire (&open_files_lock);
-  list_push_front (&open_files, &file->elem);
-  lock_release (&open_files_lock);
 
   return file;
 }
@@ -83,10 +71,6 @@ file_open (struct inode *inode)
       file->ref_count = 1;
       file->pipe = NULL;
 
-      lock_acquire (&open_files_lock);
-      list_push_front (&open_files, &file->elem);
-      lock_release (&open_files_lock);
-
       return file;
     }
   else
@@ -112,13 +96,11 @@ file_close (struct file *file)
   if (file != NULL)
     {
       /* Release resources if this was the last reference. */
-      if (--file->ref_count == 0)
+      if (atomic_fetch_sub_explicit (&file->ref_count, 1,
+                                     ATOMIC_ACQ_REL) == 1)
         {
           file_allow_write (file);
           inode_close (file->inode);
-          lock_acquire (&open_files_lock);
-          list_remove (&file->elem);
-          lock_release (&open_files_lock);
 
           pipe_close (file->pipe, file);
 
@@ -140,10 +122,8 @@ file_dup (struct file *file)
 {
   if (file != NULL)
     {
-      ASSERT (file->ref_count > 0);
-      lock_acquire (&open_files_lock);
-      file->ref_count++;
-      lock_release (&open_files_lock);
+      ASSERT (atomic_load_relaxed (&file->ref_count) > 0);
+      atomic_fetch_add_explicit (&file->ref_count, 1, ATOMIC_RELAXED);
     }
 
   return file;
@@ -199,10 +179,17 @@ file_read (struct file *file, void *buffer, off_t size)
    starting at offset FILE_OFS in the file.
    Returns the number of bytes actually read,
    which may be less than SIZE if end of file is reached.
-   The file's current position is unaffected. */
+   The file's current position is unaffected.
+   Only regular files can be read at an offset. */
 off_t
 file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs) 
 {
+  int error = read_error (file);
+  if (error)
+    return -error;
+  if (file->type != REG)
+    return -ESPIPE;
+
   return inode_read_at (file->inode, buffer, size, file_ofs);
 }
 
@@ -259,11 +246,18 @@ file_write (struct file *file, const void *buffer, off_t size)
    which may be less than SIZE if end of file is reached.
    (Normally we'd grow the file in that case, but file growth is
    not yet implemented.)
-   The file's current position is unaffected. */
+   The file's current position is unaffected.
+   Only regular files can be written at an offset. */
 off_t
 file_write_at (struct file *file, const void *buffer, off_t size,
                off_t file_ofs) 
 {
+  int error = write_error (file);
+  if (error)
+    return -error;
+  if (file->type != REG)
+    return -ESPIPE;
+
   return inode_write_at (file->inode, buffer, size, file_ofs);
 }
 
@@ -355,17 +349,11 @@ file_pipe_ends (struct pipe *pipe, struct file **read_end, struct file **write_e
   (*read_end)->type = PIPE;
   (*read_end)->ref_count = 1;
   (*read_end)->pipe = pipe;
-  lock_acquire (&open_files_lock);
-  list_push_front (&open_files, &(*read_end)->elem);
-  lock_release (&open_files_lock);
 
   /* Initialize wirte end of the pipe. */
   (*write_end)->type = PIPE;
   (*write_end)->ref_count = 1;
   (*write_end)->pipe = pipe;
-  lock_acquire (&open_files_lock);
-  list_push_front (&open_files, &(*write_end)->elem);
-  lock_release (&open_files_lock);
 
   return true;
 
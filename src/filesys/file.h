@@ -11,8 +11,6 @@ typedef enum _file_type file_type;
 struct inode;
 struct pipe;
 
-void file_init (void);
-
 /* Opening and closing files. */
 struct file *file_open_console (file_type);
 struct file *file_open (struct inode *);
@@ -7,6 +7,8 @@
 #include "filesys/inode.h"
 #include "filesys/directory.h"
 #include "filesys/cache.h"
+#include "filesys/dcache.h"
+#include "filesys/journal.h"
 #include "threads/thread.h"
 
 /* Partition that contains the file system. */
@@ -24,18 +26,27 @@ filesys_init (bool format)
     PANIC ("No file system device found, can't initialize file system.");
 
   cache_init ();
+  journal_init ();
   inode_init ();
-  file_init ();
+  dcache_init ();
   free_map_init ();
 
+  /* Finish any metadata update that was committed to the journal
+     but not yet written home before the file system is used. */
   if (format) 
     do_format ();
+  else
+    journal_recover ();
 
   free_map_open ();
   
-  /* Spawn daemon threads dedicated to read-ahead and write-behind. */
+  /* Spawn daemon threads dedicated to read-ahead and write-behind,
+     and one that commits the journal periodically. */
   thread_create ("read-ahead", NICE_DEFAULT, cache_read_ahead_daemon, NULL);
   thread_create ("write-behind", NICE_DEFAULT, cache_write_behind_daemon, NULL);
+  thread_create ("write-behind-timer", NICE_DEFAULT, cache_write_behind_timer,
+                 NULL);
+  thread_create ("journal-commit", NICE_DEFAULT, journal_commit_daemon, NULL);
 }
 
 /* Shuts down the file system module, writing any unwritten data
@@ -43,18 +54,18 @@ filesys_init (bool format)
 void
 filesys_done (void) 
 {
-  /* Write back free map first then flush the buffer cache. */
+  /* Commit the journal, then flush the buffer cache. */
   free_map_close ();
+  journal_commit ();
   cache_flush ();
 }
 
-/* Create a directory named given from the path with the given
-   NUM_ENTRIES.
+/* Create a directory named given from the path.
    Returns true if successful, false otherwise.
    Fails if a file named NAME already exists,
    or if internal memory allocation fails. */
 bool 
-filesys_dir_create (const char *path, int num_entries)
+filesys_dir_create (const char *path)
 {
   block_sector_t inode_sector = 0;
 
@@ -67,16 +78,19 @@ filesys_dir_create (const char *path, int num_entries)
 
   struct inode *inode = NULL;
   struct dir *new_dir;
+  journal_begin (JOURNAL_OP_CREDITS);
   /* First, create new directory.
      Make sure file with the same name does not already exists. */
   bool success = (dir != NULL 
-                  && free_map_allocate (1, &inode_sector)
-                  && dir_create (inode_sector, num_entries)
-                  && dir_add (dir, file_name, inode_sector));
+                  && free_map_allocate (1, inode_get_inumber (dir_get_inode (dir)),
+                                        &inode_sector)
+                  && dir_create (inode_sector)
+                  && dir_add (dir, file_name, inode_sector, true));
 
   if (!success && inode_sector != 0) 
     {
       free_map_release (inode_sector, 1);
+      journal_end ();
       return false;
     }
 
@@ -86,14 +100,16 @@ filesys_dir_create (const char *path, int num_entries)
      newly created directory. */
   success = (dir_lookup (dir, file_name, &inode)
              && (new_dir = dir_open (inode))
-             && dir_add (new_dir, ".", inode_get_inumber (inode))
-             && dir_add (new_dir, "..", inode_get_inumber (dir_get_inode (dir))));
+             && dir_add (new_dir, ".", inode_get_inumber (inode), true)
+             && dir_add (new_dir, "..",
+                         inode_get_inumber (dir_get_inode (dir)), true));
 
   if (!success) 
     {
       dir_remove (dir, file_name);
       free_map_release (inode_sector, 1);
     }
+  journal_end ();
   
   return success;
 }
@@ -115,13 +131,16 @@ filesys_create (const char *path, off_t initial_size)
   /* Traverse the path until reach destination directory */
   struct dir *dir = dir_traverse_path (path, false);
 
+  journal_begin (JOURNAL_OP_CREDITS);
   bool success = (dir != NULL 
-                  && free_map_allocate (1, &inode_sector)
+                  && free_map_allocate (1, inode_get_inumber (dir_get_inode (dir)),
+                                        &inode_sector)
                   && inode_create (inode_sector, initial_size, false)
-                  && dir_add (dir, file_name, inode_sector));
+                  && dir_add (dir, file_name, inode_sector, false));
 
   if (!success && inode_sector != 0) 
     free_map_release (inode_sector, 1);
+  journal_end ();
   
   return success;
 }
@@ -173,6 +192,8 @@ filesys_remove (const char *path)
   /* Traverse the path until reach destination directory */
   struct dir *dir = dir_traverse_path (path, false);
 
+  /* dir_remove() starts its own handle, so that deleting the
+     file's blocks can take more. */
   bool success = dir != NULL && dir_remove (dir, file_name);
 
   return success;
@@ -184,12 +205,14 @@ do_format (void)
 {
   struct dir *root_dir;
   printf ("Formatting file system...");
+  journal_format ();
   free_map_create ();
-  if (!dir_create (ROOT_DIR_SECTOR, 0)
+  if (!dir_create (ROOT_DIR_SECTOR)
       || !(root_dir = dir_open_root ())
-      || !dir_add (root_dir, ".", ROOT_DIR_SECTOR)
-      || !dir_add (root_dir, "..", ROOT_DIR_SECTOR))
+      || !dir_add (root_dir, ".", ROOT_DIR_SECTOR, true)
+      || !dir_add (root_dir, "..", ROOT_DIR_SECTOR, true))
     PANIC ("root directory creation failed");
   free_map_close ();
+  journal_commit ();
   printf ("done.\n");
 }
@@ -13,7 +13,7 @@ struct block *fs_device;
 
 void filesys_init (bool format);
 void filesys_done (void);
-bool filesys_dir_create (const char *name, int num_entries);
+bool filesys_dir_create (const char *name);
 bool filesys_create (const char *name, off_t initial_size);
 struct file *filesys_open (const char *name);
 bool filesys_remove (const char *name);
@@ -1,72 +1,185 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* The free map is split into allocation groups of
+   FREE_MAP_GROUP_SECTORS consecutive sectors, each with its own
+   lock and count of free sectors, so that threads allocating in
+   different groups do not contend.  Allocation starts at a hint
+   supplied by the caller, such as the parent directory's inode or
+   the last block of a file, and only moves on to other groups once
+   the hint's group is full.
+
+   A group covers whole bitmap words, so bits of different groups
+   never share a word, either in memory or when a changed range is
+   written back to the free map file. */
+struct free_map_group
+  {
+    struct lock lock;                /* Protects the group's bits. */
+    size_t free_cnt;                 /* Free sectors in the group. */
+  };
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
+static struct free_map_group *groups; /* Allocation groups. */
+static size_t group_cnt;             /* Number of GROUPS. */
+
+static block_sector_t group_start (size_t group);
+static block_sector_t group_end (size_t group);
+static void count_free (void);
+static block_sector_t scan_group (size_t group, block_sector_t start,
+                                  size_t cnt);
 
 /* Initializes the free map. */
 void
-free_map_init (void) 
+free_map_init (void)
 {
   free_map = bitmap_create (block_size (fs_device));
   if (free_map == NULL)
     PANIC ("bitmap creation failed--file system device is too large");
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  bitmap_set_multiple (free_map, JOURNAL_START, JOURNAL_SECTORS, true);
+
+  group_cnt = DIV_ROUND_UP (bitmap_size (free_map), FREE_MAP_GROUP_SECTORS);
+  groups = malloc (group_cnt * sizeof *groups);
+  if (groups == NULL)
+    PANIC ("can't allocate free map groups");
+  for (size_t i = 0; i < group_cnt; i++)
+    lock_init (&groups[i].lock);
+  count_free ();
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
-   the first into *SECTORP.
+   the first into *SECTORP.  The sectors are looked for at or after
+   HINT first, then in the rest of HINT's allocation group, then in
+   the following groups.  CNT may not exceed
+   FREE_MAP_GROUP_SECTORS.
    Returns true if successful, false if not enough consecutive
    sectors were available or if the free_map file could not be
    written. */
 bool
-free_map_allocate (size_t cnt, block_sector_t *sectorp)
+free_map_allocate (size_t cnt, block_sector_t hint, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR)
-    *sectorp = sector;
-  return sector != BITMAP_ERROR;
+  ASSERT (cnt > 0 && cnt <= FREE_MAP_GROUP_SECTORS);
+
+  if (hint >= bitmap_size (free_map))
+    hint = 0;
+  size_t first = hint / FREE_MAP_GROUP_SECTORS;
+  for (size_t i = 0; i < group_cnt; i++)
+    {
+      size_t group = (first + i) % group_cnt;
+      struct free_map_group *g = &groups[group];
+
+      /* The count is only a hint until the lock is held. */
+      if (g->free_cnt < cnt)
+        continue;
+
+      lock_acquire (&g->lock);
+      block_sector_t sector = BITMAP_ERROR;
+      if (g->free_cnt >= cnt)
+        {
+          if (i == 0)
+            sector = scan_group (group, hint, cnt);
+          if (sector == BITMAP_ERROR)
+            sector = scan_group (group, group_start (group), cnt);
+        }
+      if (sector != BITMAP_ERROR)
+        {
+          bitmap_set_multiple (free_map, sector, cnt, true);
+          if (free_map_file != NULL
+              && !bitmap_write_range (free_map, free_map_file, sector, cnt))
+            {
+              bitmap_set_multiple (free_map, sector, cnt, false);
+              lock_release (&g->lock);
+              return false;
+            }
+          g->free_cnt -= cnt;
+          lock_release (&g->lock);
+          *sectorp = sector;
+          return true;
+        }
+      lock_release (&g->lock);
+    }
+  return false;
 }
 
 /* Makes CNT sectors starting at SECTOR available for use. */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
-  ASSERT (bitmap_all (free_map, sector, cnt));
-  bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  while (cnt > 0)
+    {
+      size_t group = sector / FREE_MAP_GROUP_SECTORS;
+      struct free_map_group *g = &groups[group];
+      size_t n = group_end (group) - sector;
+      if (n > cnt)
+        n = cnt;
+
+      lock_acquire (&g->lock);
+      ASSERT (bitmap_all (free_map, sector, n));
+      bitmap_set_multiple (free_map, sector, n, false);
+      g->free_cnt += n;
+      if (free_map_file != NULL)
+        bitmap_write_range (free_map, free_map_file, sector, n);
+      lock_release (&g->lock);
+
+      sector += n;
+      cnt -= n;
+    }
+}
+
+/* Returns the sector where the data of the file whose inode is
+   at INODE_SECTOR should start.  Inodes created at the same time
+   get consecutive sectors, so consecutive inodes start their data
+   in consecutive allocation groups, beginning with the inode's
+   own.  Files written at the same time thus each have a group to
+   grow into without interleaving their sectors.  Files that share
+   a group start at evenly spaced points within it. */
+block_sector_t
+free_map_data_hint (block_sector_t inode_sector)
+{
+  size_t group = (inode_sector / FREE_MAP_GROUP_SECTORS + inode_sector)
+                 % group_cnt;
+  size_t slot = inode_sector / group_cnt % FREE_MAP_DATA_SLOTS;
+  return group_start (group)
+         + slot * (FREE_MAP_GROUP_SECTORS / FREE_MAP_DATA_SLOTS);
 }
 
 /* Opens the free map file and reads it from disk. */
 void
-free_map_open (void) 
+free_map_open (void)
 {
   free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
   if (free_map_file == NULL)
     PANIC ("can't open free map");
   if (!bitmap_read (free_map, free_map_file))
     PANIC ("can't read free map");
+  count_free ();
 }
 
-/* Writes the free map to disk and closes the free map file. */
+/* Closes the free map file.  Every change to the free map has
+   already been written to the file, as part of the journal
+   transaction that made it, so there is nothing left to write. */
 void
-free_map_close (void) 
+free_map_close (void)
 {
   ASSERT (free_map_file != NULL);
-  if (!bitmap_write (free_map, free_map_file))
-    PANIC ("free_map_close: fail to write back free_map to disk");
   file_close (free_map_file);
+  free_map_file = NULL;
 }
 
 /* Creates a new free map file on disk and writes the free map to
    it. */
 void
-free_map_create (void) 
+free_map_create (void)
 {
   /* Create inode. */
   if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map), false))
@@ -79,3 +192,45 @@ free_map_create (void)
   if (!bitmap_write (free_map, free_map_file))
     PANIC ("can't write free map");
 }
+
+/* Returns the first sector of GROUP. */
+static block_sector_t
+group_start (size_t group)
+{
+  return group * FREE_MAP_GROUP_SECTORS;
+}
+
+/* Returns the sector just past the end of GROUP.  The last group
+   may be shorter than the others. */
+static block_sector_t
+group_end (size_t group)
+{
+  size_t end = (group + 1) * FREE_MAP_GROUP_SECTORS;
+  return end < bitmap_size (free_map) ? end : bitmap_size (free_map);
+}
+
+/* Recomputes the free sector count of every group from the
+   bitmap. */
+static void
+count_free (void)
+{
+  for (size_t i = 0; i < group_cnt; i++)
+    groups[i].free_cnt = bitmap_count (free_map, group_start (i),
+                                       group_end (i) - group_start (i),
+                                       false);
+}
+
+/* Returns the first of CNT consecutive free sectors in GROUP at
+   or after START, or BITMAP_ERROR if there are none.  The group's
+   lock must be held. */
+static block_sector_t
+scan_group (size_t group, block_sector_t start, size_t cnt)
+{
+  ASSERT (lock_held_by_current_thread (&groups[group].lock));
+
+  block_sector_t end = group_end (group);
+  for (block_sector_t sector = start; sector + cnt <= end; sector++)
+    if (!bitmap_contains (free_map, sector, cnt, true))
+      return sector;
+  return BITMAP_ERROR;
+}
@@ -5,13 +5,22 @@
 #include <stddef.h>
 #include "devices/block.h"
 
+/* Sectors in an allocation group.  Must be a multiple of the
+   number of bits in a bitmap word. */
+#define FREE_MAP_GROUP_SECTORS 1024
+
+/* Starting points within a group for the data of files that
+   share it. */
+#define FREE_MAP_DATA_SLOTS 16
+
 void free_map_init (void);
 void free_map_read (void);
 void free_map_create (void);
 void free_map_open (void);
 void free_map_close (void);
 
-bool free_map_allocate (size_t, block_sector_t *);
+bool free_map_allocate (size_t, block_sector_t hint, block_sector_t *);
 void free_map_release (block_sector_t, size_t);
+block_sector_t free_map_data_hint (block_sector_t inode_sector);
 
 #endif /* filesys/free-map.h */
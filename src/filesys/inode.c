@@ -1,5 +1,6 @@
 #include "filesys/inode.h"
 #include <list.h>
+#include <hash.h>
 #include <debug.h>
 #include <round.h>
 #include <string.h>
@@ -7,7 +8,10 @@
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
 #include "filesys/cache.h"
+#include "filesys/journal.h"
+#include "threads/rw-lock.h"
 #include "stdio.h"
+#include <atomic-ops.h>
 
 #define NUM_DIRECT 123
 #define NUM_INDIRECT 128
@@ -31,10 +35,15 @@ struct inode_disk
     block_sector_t double_indirect;     /* Doubly indirect table. */
   };
 
-static block_sector_t lookup_direct_table (struct inode_disk *, int, bool);
-static block_sector_t lookup_indirect_table (struct inode_disk *, int, bool);
-static block_sector_t lookup_double_indirect_table (struct inode_disk *, int, bool);
-static block_sector_t access_indirect_block (block_sector_t, bool);
+struct inode;
+
+static block_sector_t lookup_direct_table (struct inode *, int, bool);
+static block_sector_t lookup_indirect_table (struct inode *, int, bool);
+static block_sector_t lookup_double_indirect_table (struct inode *, int, bool);
+static block_sector_t access_indirect_block (struct inode *, block_sector_t,
+                                              bool);
+static bool allocate_sector (struct inode *, block_sector_t *);
+static void inode_write_through (struct inode *);
 
 /* Returns the number of sectors to allocate for an inode SIZE
    bytes long. */
@@ -44,62 +53,110 @@ bytes_to_sectors (off_t size)
   return DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
 }
 
-/* In-memory inode. */
+/* In-memory inode.
+
+   DATA is a copy of the on-disk inode that is loaded once when
+   the inode is opened.  Readers look up the length, the type and
+   the direct and indirect pointers there without touching the
+   inode sector in the buffer cache.  Changes to DATA are made
+   with MAP_LOCK held and written through to the cached sector,
+   so the two copies never disagree.  Pointers only ever change
+   from -1 to a freshly initialized sector, and the length is
+   raised only after the data has been written, so lock-free
+   readers see either the old or the new value of a word, both of
+   which are consistent. */
 struct inode 
   {
-    struct list_elem elem;              /* Element in inode list. */
+    struct hash_elem elem;              /* Element in open inode table. */
     block_sector_t sector;              /* Sector number of disk location. */
-    int open_cnt;                       /* Number of openers. */
+    int open_cnt;                       /* Number of openers.
+                                           Only updated atomically. */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
-    struct lock dir_lock;               /* Lock for exclusive directory access */
+    struct rw_lock dir_lock;            /* Lock for directory access. */
+    struct lock map_lock;               /* Serializes changes to DATA. */
+    bool map_changed;                   /* DATA changed since last written
+                                           through to the buffer cache. */
+    bool map_unsynced;                  /* DATA changed since last
+                                           inode_sync(). */
+    block_sector_t alloc_hint;          /* Where to allocate the next
+                                           sector, under MAP_LOCK. */
+    struct inode_disk data;             /* Copy of the on-disk inode. */
+    struct list dirty_blocks;           /* Dirty data blocks in the buffer
+                                           cache, see cache_sync_blocks(). */
   };
 
 /* Returns the block device sector that contains byte offset POS
    within INODE.
    Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
+   POS. 
+   If WRITE is true, allocates the sector (and any indirect block
+   leading to it) if it is not allocated yet, returning -2 if the
+   disk is full. */
 static block_sector_t
-byte_to_sector (const struct inode *inode, off_t pos, bool write) 
+byte_to_sector (struct inode *inode, off_t pos, bool write) 
 {
   ASSERT (inode != NULL);
-  struct cache_block *block = cache_get_block (inode->sector, write);
-  struct inode_disk *data = (struct inode_disk *) cache_read_block (block);
 
   block_sector_t sector;
   /* Determine the sector mapping between given position and
      multi-level indices. */
   int mapping = pos / BLOCK_SECTOR_SIZE; 
+
+  if (write)
+    lock_acquire (&inode->map_lock);
+
   /* If position is less than 62 KB, then it must be
      located inside one of the direct blocks. */
   if (mapping < NUM_DIRECT)
-    sector = lookup_direct_table (data, mapping, write);
+    sector = lookup_direct_table (inode, mapping, write);
   /* Else, if position is less than 126 KB, then it must be
      located inside the indirect block. */
   else if (mapping < NUM_DIRECT + NUM_INDIRECT)
-    sector = lookup_indirect_table (data, mapping, write);
+    sector = lookup_indirect_table (inode, mapping, write);
   /* Else, if position is less than 8.12 MB, then it must be
      located inside the doubly indirect block. */
   else if (mapping < NUM_DIRECT + NUM_INDIRECT + NUM_DOUBLE_INDIRECT)
-    sector = lookup_double_indirect_table (data, mapping, write);
+    sector = lookup_double_indirect_table (inode, mapping, write);
   /* Otherwise, sector mapping (thus given position) is invalid. */
   else
     sector = -1;
 
-  /* Update inode block when new sector got added. */
-  if ((int32_t) sector != -1 && (int32_t) sector != -2)
-    cache_mark_block_dirty (block);
-
-  cache_put_block (block);
+  if (write)
+    {
+      /* Update inode block when new sector got added. */
+      inode_write_through (inode);
+      lock_release (&inode->map_lock);
+    }
 
   return sector;
 }
 
+/* Writes INODE's in-memory copy of the on-disk inode back to its
+   sector in the buffer cache, if it has changed.
+   Must be called with INODE's map_lock held. */
+static void
+inode_write_through (struct inode *inode)
+{
+  ASSERT (lock_held_by_current_thread (&inode->map_lock));
+  if (!inode->map_changed)
+    return;
+
+  struct cache_block *block = cache_get_block (inode->sector, true);
+  struct inode_disk *data = (struct inode_disk *) cache_read_block (block);
+  memcpy (data, &inode->data, BLOCK_SECTOR_SIZE);
+  cache_log_block (block);
+  cache_put_block (block);
+  inode->map_changed = false;
+  inode->map_unsynced = true;
+}
+
 /* Find the corresponding sector in sparse file 
    using the given sector mapping in the sets of direct blocks. */
 static block_sector_t 
-lookup_direct_table (struct inode_disk *data, int mapping, bool write)
+lookup_direct_table (struct inode *inode, int mapping, bool write)
 {
+  struct inode_disk *data = &inode->data;
   /* Locate the direct block in direct table. */
   block_sector_t sector = data->direct[mapping];
   /* Prefetch next sector. Next sector should not go beyond file length. */
@@ -113,10 +170,11 @@ lookup_direct_table (struct inode_disk *data, int mapping, bool write)
      (2) writing to the hole in sparse file fill in the hole with new sector. */
   else if (write && (int32_t) sector == -1)
     {
-      if (!free_map_allocate (1, &data->direct[mapping]))
+      if (!allocate_sector (inode, &sector))
         return -2;  /* Run out of space in free map. */
 
-      sector = data->direct[mapping];
+      data->direct[mapping] = sector;
+      inode->map_changed = true;
     }
 
   return sector;
@@ -125,14 +183,19 @@ lookup_direct_table (struct inode_disk *data, int mapping, bool write)
 /* Find the corresponding sector in sparse file 
    using the given sector mapping in the indirect block. */
 static block_sector_t
-lookup_indirect_table (struct inode_disk *data, int mapping, bool write)
+lookup_indirect_table (struct inode *inode, int mapping, bool write)
 {
+  struct inode_disk *data = &inode->data;
   /* First access the indirect block. */
-  block_sector_t indirect = access_indirect_block (data->indirect, write);
+  block_sector_t indirect = access_indirect_block (inode, data->indirect, write);
   if ((int32_t) indirect == -1 || (int32_t) indirect == -2)
     return indirect;
 
-  data->indirect = indirect;
+  if (data->indirect != indirect)
+    {
+      data->indirect = indirect;
+      inode->map_changed = true;
+    }
   /* From indirect table, locate direct block. */
   struct cache_block *indirect_block = cache_get_block (indirect, write);
   block_sector_t *indirect_table = (block_sector_t *) cache_read_block (indirect_block);
@@ -152,13 +215,13 @@ lookup_indirect_table (struct inode_disk *data, int mapping, bool write)
      (2) writing to the hole in sparse file fill in the hole with new sector. */
   else if (write && (int32_t) sector == -1)
     {
-      if (!free_map_allocate (1, &indirect_table[mapping - NUM_DIRECT]))
+      if (!allocate_sector (inode, &indirect_table[mapping - NUM_DIRECT]))
         {
           cache_put_block (indirect_block);
           return -2;  /* Run out of space in free map. */
         }
       sector = indirect_table[mapping - NUM_DIRECT];
-      cache_mark_block_dirty (indirect_block);
+      cache_log_block (indirect_block);
     }
 
   cache_put_block (indirect_block);
@@ -169,21 +232,28 @@ lookup_indirect_table (struct inode_disk *data, int mapping, bool write)
 /* Find the corresponding sector in sparse file 
    using the given sector mapping in the doubly indirect block. */
 static block_sector_t
-lookup_double_indirect_table (struct inode_disk *data, int mapping, bool write)
+lookup_double_indirect_table (struct inode *inode, int mapping, bool write)
 {
+  struct inode_disk *data = &inode->data;
   /* First access the doubly indirect block. */
-  block_sector_t double_indirect = access_indirect_block (data->double_indirect, write);
+  block_sector_t double_indirect = access_indirect_block (inode, data->double_indirect,
+                                                          write);
   if ((int32_t) double_indirect == -1 || (int32_t) double_indirect == -2)
     return double_indirect;
 
-  data->double_indirect = double_indirect;
+  if (data->double_indirect != double_indirect)
+    {
+      data->double_indirect = double_indirect;
+      inode->map_changed = true;
+    }
   struct cache_block *double_indirect_block = cache_get_block (double_indirect, write);
   block_sector_t *double_indirect_table 
       = (block_sector_t *) cache_read_block (double_indirect_block);
 
   /* From doubly indirect table, locate indirect table index. */
   int index = (mapping - NUM_DIRECT - NUM_INDIRECT) / NUM_INDIRECT;
-  block_sector_t indirect = access_indirect_block (double_indirect_table[index], write);
+  block_sector_t indirect = access_indirect_block (inode, double_indirect_table[index],
+                                                   write);
   if ((int32_t) indirect == -1 || (int32_t) indirect == -2)
     {
       cache_put_block (double_indirect_block);
@@ -193,7 +263,7 @@ lookup_double_indirect_table (struct inode_disk *data, int mapping, bool write)
   if (double_indirect_table[index] != indirect)
     {
       double_indirect_table[index] = indirect;
-      cache_mark_block_dirty (double_indirect_block);
+      cache_log_block (double_indirect_block);
     }
 
   cache_put_block (double_indirect_block);
@@ -217,14 +287,14 @@ lookup_double_indirect_table (struct inode_disk *data, int mapping, bool write)
      (2) writing to the hole in sparse file fill in the hole with new sector. */
   else if (write && (int32_t) sector == -1)
     {
-      if (!free_map_allocate (1, &indirect_table[index]))
+      if (!allocate_sector (inode, &indirect_table[index]))
         {
           cache_put_block (indirect_block);
           return -2;  /* Run out of space in free map. */
         }
 
       sector = indirect_table[index];
-      cache_mark_block_dirty (indirect_block);
+      cache_log_block (indirect_block);
     }
   cache_put_block (indirect_block);
 
@@ -235,7 +305,8 @@ lookup_double_indirect_table (struct inode_disk *data, int mapping, bool write)
    If empty and accessed while writing, 
    then allocate new indirect block that can hold 128 direct block. */
 static block_sector_t
-access_indirect_block (block_sector_t indirect, bool write)
+access_indirect_block (struct inode *inode, block_sector_t indirect,
+                       bool write)
 {
   /* Checks if reading pass the EOF or hole in sparse file. */
   if (!write && (int32_t) indirect == -1)
@@ -243,7 +314,7 @@ access_indirect_block (block_sector_t indirect, bool write)
   /* If write and block is empty, then allocate new indirect block (table). */
   else if (write && (int32_t) indirect == -1)
     {
-      if (!free_map_allocate (1, &indirect))
+      if (!allocate_sector (inode, &indirect))
         return -2;  /* Run out of space in free map. */
 
       /* Initialize all direct blocks within the indirect table to -1. */
@@ -251,25 +322,62 @@ access_indirect_block (block_sector_t indirect, bool write)
       int32_t *indirect_table = cache_zero_block (block);
       for (int i = 0; i < NUM_INDIRECT; i++)
         indirect_table[i] = -1;
+      cache_log_block (block);
       cache_put_block (block);
     }
 
   return indirect;
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+/* Allocates a sector for INODE's data or indirect blocks and
+   stores it in *SECTORP, placing it right after the sector
+   allocated last if possible, so that files stay contiguous.
+   Must be called with INODE's map_lock held. */
+static bool
+allocate_sector (struct inode *inode, block_sector_t *sectorp)
+{
+  ASSERT (lock_held_by_current_thread (&inode->map_lock));
+
+  if (!free_map_allocate (1, inode->alloc_hint, sectorp))
+    return false;
+  inode->alloc_hint = *sectorp + 1;
+  return true;
+}
+
+/* Table of open inodes, keyed by sector, so that opening a
+   single inode twice returns the same `struct inode'. */
+static struct hash open_inodes;
 static struct lock open_inodes_lock;
 
+static hash_hash_func inode_hash;
+static hash_less_func inode_less;
+
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
-  list_init (&open_inodes);
+  hash_init (&open_inodes, inode_hash, inode_less, NULL);
   lock_init (&open_inodes_lock);
 }
 
+/* Returns a hash value for the open inode E. */
+static unsigned
+inode_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct inode *inode = hash_entry (e, struct inode, elem);
+  return hash_int (inode->sector);
+}
+
+/* Returns true if open inode A precedes open inode B. */
+static bool
+inode_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  const struct inode *inode_a = hash_entry (a, struct inode, elem);
+  const struct inode *inode_b = hash_entry (b, struct inode, elem);
+  return inode_a->sector < inode_b->sector;
+}
+
 /* Initializes an inode with LENGTH bytes of data and
    writes the new inode to sector SECTOR on the file system
    device.
@@ -296,6 +404,7 @@ inode_create (block_sector_t sector, off_t length, int is_dir)
   disk_inode->double_indirect = -1;
   disk_inode->length = length;
   disk_inode->is_dir = is_dir;
+  cache_log_block (block);
   cache_put_block (block);
 
   if (length > 0)
@@ -330,21 +439,19 @@ create_done:
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
+  struct inode key;
+  struct hash_elem *e;
   struct inode *inode;
 
   lock_acquire (&open_inodes_lock);
   /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
+  key.sector = sector;
+  e = hash_find (&open_inodes, &key.elem);
+  if (e != NULL)
     {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
-        {
-          inode_reopen (inode);
-          lock_release (&open_inodes_lock);
-          return inode; 
-        }
+      inode = inode_reopen (hash_entry (e, struct inode, elem));
+      lock_release (&open_inodes_lock);
+      return inode;
     }
   lock_release (&open_inodes_lock);
 
@@ -353,20 +460,45 @@ inode_open (block_sector_t sector)
   if (inode == NULL)
     return NULL;
 
-  /* Initialize. */
-  lock_acquire (&open_inodes_lock);
-  list_push_front (&open_inodes, &inode->elem);
-  lock_release (&open_inodes_lock);
-
+  /* Initialize, loading the on-disk inode without holding
+     open_inodes_lock. */
   inode->sector = sector;
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  lock_init (&inode->dir_lock);
+  inode->map_changed = false;
+  inode->map_unsynced = false;
+  list_init (&inode->dirty_blocks);
+  rw_lock_init (&inode->dir_lock, RW_LOCK_FAIR);
+  lock_init (&inode->map_lock);
 
   struct cache_block *block = cache_get_block (inode->sector, false);
-  cache_read_block (block);
+  memcpy (&inode->data, cache_read_block (block), BLOCK_SECTOR_SIZE);
   cache_put_block (block);
+
+  /* Continue after the last direct block, or start a new file at
+     its own spot on the disk. */
+  inode->alloc_hint = free_map_data_hint (sector);
+  for (int i = NUM_DIRECT - 1; i >= 0; i--)
+    if ((int32_t) inode->data.direct[i] != -1)
+      {
+        inode->alloc_hint = inode->data.direct[i] + 1;
+        break;
+      }
+
+  /* Another opener may have inserted the same sector meanwhile.
+     The second lookup and the insertion happen under one
+     critical section, so concurrent openers always end up
+     sharing a single `struct inode'. */
+  lock_acquire (&open_inodes_lock);
+  e = hash_insert (&open_inodes, &inode->elem);
+  if (e != NULL)
+    {
+      free (inode);
+      inode = inode_reopen (hash_entry (e, struct inode, elem));
+    }
+  lock_release (&open_inodes_lock);
+
   return inode;
 }
 
@@ -374,11 +506,42 @@ inode_open (block_sector_t sector)
 struct inode *
 inode_reopen (struct inode *inode)
 {
+  /* The caller holds a reference or open_inodes_lock, so the
+     count cannot drop to zero meanwhile and nothing needs
+     ordering. */
   if (inode != NULL)
-    inode->open_cnt++;
+    atomic_fetch_add_explicit (&inode->open_cnt, 1, ATOMIC_RELAXED);
   return inode;
 }
 
+/* Drops one reference to INODE.  Returns true if it was the last
+   one, in which case INODE has been removed from the open inode
+   table and the caller must free it.
+
+   Only the final decrement is done under open_inodes_lock, so
+   that inode_open() can never revive an inode that is being
+   freed, while every other close is a single atomic operation. */
+static bool
+inode_put (struct inode *inode)
+{
+  /* Dropping a reference releases our accesses to INODE to
+     whoever frees it. */
+  int cnt = atomic_load_relaxed (&inode->open_cnt);
+  while (cnt > 1)
+    if (atomic_cmpxchg_explicit (&inode->open_cnt, &cnt, cnt - 1,
+                                 ATOMIC_RELEASE, ATOMIC_RELAXED))
+      return false;
+
+  lock_acquire (&open_inodes_lock);
+  bool last = atomic_fetch_sub_explicit (&inode->open_cnt, 1,
+                                         ATOMIC_ACQ_REL) == 1;
+  if (last)
+    hash_delete (&open_inodes, &inode->elem);
+  lock_release (&open_inodes_lock);
+
+  return last;
+}
+
 /* Returns INODE's inode number. */
 block_sector_t
 inode_get_inumber (const struct inode *inode)
@@ -397,53 +560,68 @@ inode_close (struct inode *inode)
     return;
 
   /* Release resources if this was the last opener. */
-  if (--inode->open_cnt == 0)
+  if (inode_put (inode))
     {
-      lock_acquire (&open_inodes_lock);
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
-      lock_release (&open_inodes_lock);
-
       /* Deallocate blocks if removed. */
       if (inode->removed) 
         {
+          /* A large file's sectors can span more free map sectors
+             than one handle may log, so the handle is restarted
+             as needed.  A crash in between only leaks the sectors
+             not yet released, because the inode goes last. */
+          journal_begin (JOURNAL_WRITE_CREDITS);
           /* Un-mark all data blocks associated with given inode. */
           for (off_t pos = 0; pos < inode_length(inode); pos += BLOCK_SECTOR_SIZE)
             {
               block_sector_t sector = byte_to_sector (inode, pos, false);
               if ((int32_t) sector != -1)
-                free_map_release (sector, 1); 
+                {
+                  journal_restart (1);
+                  free_map_release (sector, 1); 
+                }
             }
 
-          struct cache_block *block = cache_get_block (inode->sector, true); 
-          struct inode_disk *data = (struct inode_disk *) cache_read_block (block);
+          struct inode_disk *data = &inode->data;
         
           /* Un-mark indirect block. */
           if ((int32_t) data->indirect != -1)
-            free_map_release (data->indirect, 1);
+            {
+              journal_restart (1);
+              free_map_release (data->indirect, 1);
+            }
           /* Un-mark doubly indirect block. */
           if ((int32_t) data->double_indirect != -1)
             {
-              struct cache_block *double_indirect_block 
-                  = cache_get_block (data->double_indirect, true); 
-              block_sector_t *double_indirect_table 
-                  = (block_sector_t *) cache_read_block (double_indirect_block);
               /* Un-mark all non-empty indirect blocks 
-                 inside doubly indirect block. */
+                 inside doubly indirect block.  The table's block
+                 is not held across the restart, which may have to
+                 wait for a commit. */
               for (int i = 0; i < NUM_INDIRECT; i++)
                 {
-                  if ((int32_t) double_indirect_table[i] != -1)
-                    free_map_release (double_indirect_table[i], 1); 
+                  struct cache_block *double_indirect_block 
+                      = cache_get_block (data->double_indirect, false); 
+                  block_sector_t *double_indirect_table 
+                      = (block_sector_t *) cache_read_block (double_indirect_block);
+                  block_sector_t sector = double_indirect_table[i];
+                  cache_put_block (double_indirect_block);
+
+                  if ((int32_t) sector != -1)
+                    {
+                      journal_restart (1);
+                      free_map_release (sector, 1); 
+                    }
                 }
-              cache_put_block (double_indirect_block);
+              journal_restart (1);
               free_map_release (data->double_indirect, 1); 
             }
 
-          cache_put_block (block);
           /* Un-mark block that hold inode. */
+          journal_restart (1);
           free_map_release (inode->sector, 1);
+          journal_end ();
         }
 
+      cache_disown_blocks (&inode->dirty_blocks);
       free (inode); 
     }
 }
@@ -517,11 +695,19 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
   return bytes_read;
 }
 
+/* Returns true if the contents of INODE are file system metadata,
+   whose changes go through the journal. */
+static bool
+inode_is_metadata (const struct inode *inode)
+{
+  return inode_is_dir (inode) || inode->sector == FREE_MAP_SECTOR;
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
    less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   Each sector is written under its own journal handle, which
+   covers any blocks allocated for it. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
                 off_t offset) 
@@ -534,10 +720,15 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 
   while (size > 0) 
     {
+      journal_begin (JOURNAL_WRITE_CREDITS);
+
       /* Sector to write, starting byte offset within sector. */
       block_sector_t sector_idx = byte_to_sector (inode, offset, true);
       if ((int32_t) sector_idx == -2)
-        break;
+        {
+          journal_end ();
+          break;
+        }
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
@@ -547,7 +738,10 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       /* Number of bytes to actually write into this sector. */
       int chunk_size = size < min_left ? size : min_left;
       if (chunk_size <= 0)
-        break;
+        {
+          journal_end ();
+          break;
+        }
 
       struct cache_block *block = cache_get_block (sector_idx, true);
       if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
@@ -564,8 +758,15 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
           memcpy (data + sector_ofs, buffer + bytes_written, chunk_size);
         }
 
-      cache_mark_block_dirty (block);
+      bool metadata = inode_is_metadata (inode);
+      if (metadata)
+        cache_log_block (block);
+      else
+        cache_mark_block_dirty (block, &inode->dirty_blocks);
       cache_put_block (block);
+      journal_end ();
+      if (!metadata)
+        cache_throttle_writer ();
 
       /* Advance. */
       size -= chunk_size;
@@ -573,26 +774,53 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       bytes_written += chunk_size;
     }
 
-  /* Update the length of the file if extended. */
-  struct cache_block *block = cache_get_block (inode->sector, true);
-  struct inode_disk *data = (struct inode_disk *) cache_read_block (block);
-  if (data->length < offset)
+  /* Update the length of the file if extended.  This happens only
+     after the data is in place, so that readers checking the
+     length never see unwritten bytes. */
+  if (inode->data.length < offset)
     {
-      data->length = offset;
-      cache_mark_block_dirty (block);
+      journal_begin (JOURNAL_WRITE_CREDITS);
+      lock_acquire (&inode->map_lock);
+      if (inode->data.length < offset)
+        {
+          inode->data.length = offset;
+          inode->map_changed = true;
+          inode_write_through (inode);
+        }
+      lock_release (&inode->map_lock);
+      journal_end ();
     }
-  cache_put_block (block);
 
   return bytes_written;
 }
 
+/* Writes INODE's dirty data blocks to disk.  Unless DATA_ONLY is
+   true, also commits the journal, so that INODE's metadata and
+   directory entries are on disk as well.  If DATA_ONLY is true,
+   the journal is only committed if INODE's length or block map
+   changed since the last call, since the data could not be found
+   otherwise. */
+void
+inode_sync (struct inode *inode, bool data_only)
+{
+  cache_sync_blocks (&inode->dirty_blocks);
+
+  lock_acquire (&inode->map_lock);
+  bool commit = !data_only || inode->map_unsynced;
+  inode->map_unsynced = false;
+  lock_release (&inode->map_lock);
+
+  if (commit)
+    journal_commit ();
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 void
 inode_deny_write (struct inode *inode) 
 {
   inode->deny_write_cnt++;
-  ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  ASSERT (inode->deny_write_cnt <= atomic_load_relaxed (&inode->open_cnt));
 }
 
 /* Re-enables writes to INODE.
@@ -602,7 +830,7 @@ void
 inode_allow_write (struct inode *inode) 
 {
   ASSERT (inode->deny_write_cnt > 0);
-  ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  ASSERT (inode->deny_write_cnt <= atomic_load_relaxed (&inode->open_cnt));
   inode->deny_write_cnt--;
 }
 
@@ -610,22 +838,14 @@ inode_allow_write (struct inode *inode)
 off_t
 inode_length (const struct inode *inode)
 {
-  struct cache_block *block = cache_get_block (inode->sector, false);
-  struct inode_disk *data = (struct inode_disk *) cache_read_block (block);
-  off_t length = data->length;
-  cache_put_block (block);
-  return length;
+  return inode->data.length;
 }
 
 /* Checks if the given inode is a directory. */
 bool
 inode_is_dir (const struct inode *inode)
 {
-  struct cache_block *block = cache_get_block (inode->sector, false);
-  struct inode_disk *data = (struct inode_disk *) cache_read_block (block);
-  int is_dir = data->is_dir;
-  cache_put_block (block);
-  return is_dir == 1;
+  return inode->data.is_dir == 1;
 }
 
 /* Check if the given inode have been removed. */
@@ -635,16 +855,26 @@ inode_is_removed (const struct inode *inode)
   return inode->removed;
 }
 
-/* Acquire a directory lock from the underlying inode. */
+/* Acquire a directory lock from the underlying inode for
+   exclusive access. */
 void
 inode_lock_acquire (struct inode *inode)
 {
-  lock_acquire (&inode->dir_lock);
+  write_lock_acquire (&inode->dir_lock);
+}
+
+/* Acquire a directory lock from the underlying inode for shared
+   access, which lookups and listings may hold together. */
+void
+inode_lock_acquire_shared (struct inode *inode)
+{
+  read_lock_acquire (&inode->dir_lock);
 }
 
-/* Release a directory lock from the underlying inode. */
+/* Release a directory lock from the underlying inode, in whichever
+   mode it was acquired. */
 void
 inode_lock_release (struct inode *inode)
 {
-  lock_release (&inode->dir_lock);
+  rw_lock_release (&inode->dir_lock);
 }
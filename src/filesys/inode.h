@@ -17,12 +17,14 @@ void inode_close (struct inode *);
 void inode_remove (struct inode *);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
+void inode_sync (struct inode *, bool data_only);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
 off_t inode_length (const struct inode *);
 bool inode_is_dir (const struct inode *);
 bool inode_is_removed (const struct inode *);
 void inode_lock_acquire (struct inode *inode);
+void inode_lock_acquire_shared (struct inode *inode);
 void inode_lock_release (struct inode *inode);
 
 #endif /* filesys/inode.h */
@@ -0,0 +1,295 @@
+#include "filesys/journal.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Write-ahead journal for file system metadata.
+
+   Inode sectors, indirect tables, directory blocks and the free
+   map are metadata.  Changing them is bracketed by
+   journal_begin() and journal_end(); such a handle covers one
+   file system operation, such as creating a file or extending
+   one by a sector, and reserves room in the transaction for the
+   most blocks that operation logs, its credits.  All handles join the single running
+   transaction, whose modified blocks are logged by
+   cache_log_block() and stay pinned in the buffer cache, so that
+   none of them reaches its home location early.
+
+   A transaction is committed when it runs out of room, when
+   journal_commit() is called, or periodically by the commit
+   daemon, so that many operations share one commit.  Committing
+   copies the logged blocks into the journal and then writes the
+   journal header, which is the commit point.  The blocks are
+   then checkpointed straight from the buffer cache to their home
+   locations, after which the header is cleared again.  If the
+   system stops between the two header writes,
+   journal_recover() finds the committed transaction and copies
+   it home once more at the next boot.
+
+   File data is not journaled. */
+
+/* Identifies a journal header. */
+#define JOURNAL_MAGIC 0x4c4e524a
+
+/* Log blocks that follow the header. */
+#define JOURNAL_LOG_CNT (JOURNAL_SECTORS - 1)
+
+/* The first sector of the journal. */
+struct journal_header
+  {
+    uint32_t magic;                     /* JOURNAL_MAGIC. */
+    uint32_t seq;                       /* Transaction sequence number. */
+    uint32_t count;                     /* Committed log blocks, or 0. */
+    block_sector_t home[JOURNAL_LOG_CNT]; /* Home sector of each. */
+    uint8_t unused[BLOCK_SECTOR_SIZE - 3 * sizeof (uint32_t)
+                   - JOURNAL_LOG_CNT * sizeof (block_sector_t)];
+  };
+
+static struct journal_header header;    /* Used while committing. */
+
+static struct lock journal_lock;        /* Protects all of the below. */
+static struct condition journal_cond;   /* Signaled when handles end
+                                           or a commit finishes. */
+static int active_handles;              /* Handles in the running
+                                           transaction. */
+static int reserved;                    /* Credits they have left. */
+static bool committing;                 /* A commit is in progress. */
+static bool commit_requested;           /* journal_commit() waits. */
+static uint32_t seq;                    /* Running transaction. */
+static block_sector_t tx_blocks[JOURNAL_LOG_CNT]; /* Logged sectors. */
+static int tx_cnt;                      /* Number of TX_BLOCKS. */
+
+static void commit (void);
+
+/* Initializes the journal module. */
+void
+journal_init (void)
+{
+  ASSERT (sizeof (struct journal_header) == BLOCK_SECTOR_SIZE);
+
+  lock_init (&journal_lock);
+  cond_init (&journal_cond);
+  active_handles = 0;
+  reserved = 0;
+  committing = false;
+  commit_requested = false;
+  tx_cnt = 0;
+}
+
+/* Writes an empty journal to the file system device. */
+void
+journal_format (void)
+{
+  memset (&header, 0, sizeof header);
+  header.magic = JOURNAL_MAGIC;
+  block_write (fs_device, JOURNAL_START, &header);
+  seq = 1;
+}
+
+/* Completes the checkpoint of a transaction that was committed
+   but possibly not yet written to its home locations when the
+   system stopped. */
+void
+journal_recover (void)
+{
+  static uint8_t buffer[BLOCK_SECTOR_SIZE];
+
+  block_read (fs_device, JOURNAL_START, &header);
+  if (header.magic != JOURNAL_MAGIC)
+    PANIC ("no journal found, file system must be reformatted");
+
+  if (header.count > 0)
+    {
+      ASSERT (header.count <= JOURNAL_LOG_CNT);
+      printf ("journal: replaying transaction %"PRIu32" (%"PRIu32" blocks)\n",
+              header.seq, header.count);
+      for (uint32_t i = 0; i < header.count; i++)
+        {
+          block_read (fs_device, JOURNAL_START + 1 + i, buffer);
+          block_write (fs_device, header.home[i], buffer);
+        }
+      header.count = 0;
+      block_write (fs_device, JOURNAL_START, &header);
+    }
+  seq = header.seq + 1;
+}
+
+/* Starts a handle in the running transaction for the current
+   thread, which may log up to CREDITS blocks, waiting if
+   necessary for room in the transaction.  Handles nest, and only
+   the outermost one reserves room; nested handles share its
+   credits.  Must be called before acquiring any lock that a
+   commit might need, such as directory locks or cache blocks. */
+void
+journal_begin (int credits)
+{
+  ASSERT (credits > 0 && credits <= JOURNAL_TX_MAX);
+
+  struct thread *t = thread_current ();
+  if (t->journal_depth++ > 0)
+    return;
+
+  lock_acquire (&journal_lock);
+  while (committing || commit_requested
+         || tx_cnt + reserved + credits > JOURNAL_TX_MAX)
+    {
+      if (!committing && active_handles == 0)
+        commit ();
+      else
+        cond_wait (&journal_cond, &journal_lock);
+    }
+  active_handles++;
+  reserved += credits;
+  t->journal_credits = credits;
+  lock_release (&journal_lock);
+}
+
+/* Makes sure that the current thread's handle can log CREDITS
+   more blocks.  If it cannot, ends it and starts a new one with
+   CREDITS or JOURNAL_WRITE_CREDITS credits, whichever is more.
+   This splits an update too large for one handle.  The parts may
+   be committed in different transactions, so the caller must
+   restart only where a crash between them leaves the file system
+   consistent, and without holding any lock that a commit might
+   need.  A nested handle is left alone, because its outer handle
+   may not be at such a point. */
+void
+journal_restart (int credits)
+{
+  struct thread *t = thread_current ();
+  ASSERT (t->journal_depth > 0);
+  if (t->journal_depth == 1 && t->journal_credits < credits)
+    {
+      journal_end ();
+      journal_begin (credits > JOURNAL_WRITE_CREDITS
+                     ? credits : JOURNAL_WRITE_CREDITS);
+    }
+}
+
+/* Ends the current thread's handle started by journal_begin(). */
+void
+journal_end (void)
+{
+  struct thread *t = thread_current ();
+  ASSERT (t->journal_depth > 0);
+  if (--t->journal_depth > 0)
+    return;
+
+  lock_acquire (&journal_lock);
+  active_handles--;
+  reserved -= t->journal_credits;
+  t->journal_credits = 0;
+  cond_broadcast (&journal_cond, &journal_lock);
+  lock_release (&journal_lock);
+}
+
+/* Adds SECTOR to the running transaction, charging it to the
+   current thread's handle.  Called by cache_log_block() the first
+   time a cached block is logged in a transaction. */
+void
+journal_add (block_sector_t sector)
+{
+  struct thread *t = thread_current ();
+
+  lock_acquire (&journal_lock);
+  /* Blocks logged outside any handle, such as while formatting,
+     must not join a transaction that is being written out. */
+  while (committing)
+    cond_wait (&journal_cond, &journal_lock);
+  if (t->journal_depth > 0)
+    {
+      if (t->journal_credits == 0)
+        PANIC ("journal handle logged more blocks than it reserved");
+      t->journal_credits--;
+      reserved--;
+    }
+  /* Handles never take a transaction past JOURNAL_TX_MAX, and
+     nothing else logs that much.  Going past it could pin the
+     whole buffer cache. */
+  if (tx_cnt == JOURNAL_TX_MAX)
+    PANIC ("journal transaction overflow");
+  tx_blocks[tx_cnt++] = sector;
+  lock_release (&journal_lock);
+}
+
+/* Commits the running transaction, waiting for its handles to
+   end.  The caller must not be inside a handle. */
+void
+journal_commit (void)
+{
+  ASSERT (thread_current ()->journal_depth == 0);
+
+  lock_acquire (&journal_lock);
+  while (committing)
+    cond_wait (&journal_cond, &journal_lock);
+  commit_requested = true;
+  while (active_handles > 0)
+    cond_wait (&journal_cond, &journal_lock);
+  commit ();
+  lock_release (&journal_lock);
+}
+
+/* Commits the running transaction periodically, so that a burst
+   of operations shares a single commit. */
+void
+journal_commit_daemon (void *aux UNUSED)
+{
+  while (true)
+    {
+      timer_sleep (JOURNAL_COMMIT_TICKS);
+      journal_commit ();
+    }
+}
+
+/* Writes the running transaction to the journal, checkpoints it
+   and starts a new one.  Must be called with journal_lock held
+   and no handles active.  The lock is released while writing. */
+static void
+commit (void)
+{
+  ASSERT (lock_held_by_current_thread (&journal_lock));
+  ASSERT (active_handles == 0 && !committing);
+
+  int cnt = tx_cnt;
+  if (cnt > 0)
+    {
+      committing = true;
+      lock_release (&journal_lock);
+
+      /* Copy the logged blocks into the journal. */
+      for (int i = 0; i < cnt; i++)
+        {
+          struct cache_block *block = cache_get_block (tx_blocks[i], false);
+          block_write (fs_device, JOURNAL_START + 1 + i,
+                       cache_read_block (block));
+          cache_put_block (block);
+          header.home[i] = tx_blocks[i];
+        }
+
+      /* Commit point. */
+      header.magic = JOURNAL_MAGIC;
+      header.seq = seq;
+      header.count = cnt;
+      block_write (fs_device, JOURNAL_START, &header);
+
+      /* Checkpoint, then empty the journal. */
+      for (int i = 0; i < cnt; i++)
+        cache_checkpoint_block (tx_blocks[i]);
+      header.count = 0;
+      block_write (fs_device, JOURNAL_START, &header);
+
+      lock_acquire (&journal_lock);
+      tx_cnt = 0;
+      seq++;
+      committing = false;
+    }
+  commit_requested = false;
+  cond_broadcast (&journal_cond, &journal_lock);
+}
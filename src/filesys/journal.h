@@ -0,0 +1,38 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include "devices/block.h"
+
+/* On-disk location of the journal, right after the root
+   directory's inode. */
+#define JOURNAL_START 2
+#define JOURNAL_SECTORS 64      /* Header plus log blocks. */
+
+/* Credits, the most blocks a handle may add to the running
+   transaction.  A handle is only started when the transaction
+   has room for its credits.  Writing one sector of a file logs
+   at most the sector itself, the inode, two index tables and
+   three free map sectors.  Creating or removing a file or
+   directory also changes directory blocks, which may split. */
+#define JOURNAL_WRITE_CREDITS 8
+#define JOURNAL_OP_CREDITS 16
+
+/* Blocks logged by a running transaction before it is committed.
+   Logged blocks stay pinned in the buffer cache until then, so
+   this is kept below MAX_CACHE_SIZE. */
+#define JOURNAL_TX_MAX 48
+
+/* Ticks between commits of the running transaction. */
+#define JOURNAL_COMMIT_TICKS 1000
+
+void journal_init (void);
+void journal_format (void);
+void journal_recover (void);
+void journal_begin (int credits);
+void journal_restart (int credits);
+void journal_end (void);
+void journal_add (block_sector_t);
+void journal_commit (void);
+void journal_commit_daemon (void *);
+
+#endif /* filesys/journal.h */
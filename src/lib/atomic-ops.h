@@ -1,16 +1,188 @@
 #ifndef __LIB_ATOMIC_OPS_H
 #define __LIB_ATOMIC_OPS_H
 
+/* Atomic operations.
+
+   Everything here is inline, built on the GCC atomic builtins
+   https://gcc.gnu.org/onlinedocs/gcc/_005f_005fatomic-Builtins.html
+
+   The int functions atomic_xchg() through atomic_store() use
+   sequentially consistent ordering, the strongest and slowest.
+   If in doubt, use them.
+
+   The macros below them take an explicit memory order and work
+   on any integer or pointer object of at most 32 bits:
+
+     - ATOMIC_RELAXED makes only the access itself atomic.  Use
+       it for counters and for flags and estimates that are read
+       without a lock and that order nothing else.
+
+     - ATOMIC_ACQUIRE on a load keeps later memory accesses from
+       moving before it.  ATOMIC_RELEASE on a store keeps earlier
+       ones from moving after it.  A load-acquire that sees the
+       value of a store-release also sees everything written
+       before that store.
+
+     - ATOMIC_ACQ_REL on a read-modify-write is both.
+       ATOMIC_SEQ_CST additionally puts all such operations in a
+       single total order.
+
+   On x86, loads are already acquires and stores releases, so
+   acquire loads, release stores and all relaxed accesses compile
+   to plain moves; only read-modify-writes and seq_cst stores
+   need a locked instruction.  The orders still constrain the
+   compiler.
+
+   GCC cannot do 64-bit atomics inline on our 32-bit target, so
+   the atomic64_*() functions provide them with CMPXCHG8B.  They
+   are all full barriers.  Read more about memory ordering:
+   http://en.cppreference.com/w/c/atomic/memory_order
+   https://gcc.gnu.org/wiki/Atomic/GCCMM/AtomicSync */
+
+#include <debug.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
-int atomic_xchg (int *, int);
-int atomic_inci (int *);
-int atomic_deci (int *);
+/* Memory orders. */
+#define ATOMIC_RELAXED __ATOMIC_RELAXED
+#define ATOMIC_ACQUIRE __ATOMIC_ACQUIRE
+#define ATOMIC_RELEASE __ATOMIC_RELEASE
+#define ATOMIC_ACQ_REL __ATOMIC_ACQ_REL
+#define ATOMIC_SEQ_CST __ATOMIC_SEQ_CST
+
+/* Exchanges the value stored at addr with newval,
+   and return the old value. */
+static inline int
+atomic_xchg (int *addr, int newval)
+{
+  return __atomic_exchange_n (addr, newval, ATOMIC_SEQ_CST);
+}
+
+/* Atomically increment *NUM by one. Returns the new value. */
+static inline int
+atomic_inci (int *num)
+{
+  return __atomic_add_fetch (num, 1, ATOMIC_SEQ_CST);
+}
+
+/* Atomically decrement *NUM by one. Returns the new value. */
+static inline int
+atomic_deci (int *num)
+{
+  ASSERT (num != NULL);
+  return __atomic_sub_fetch (num, 1, ATOMIC_SEQ_CST);
+}
+
+/* Atomically add AMT to NUM. Returns the new value. */
+static inline int
+atomic_addi (int *num, int amt)
+{
+  return __atomic_add_fetch (num, amt, ATOMIC_SEQ_CST);
+}
+
+/* Compare-And-Swap (int): If *NUM == *OLD, set it to *NEW and return true.
+   Else return false. */
+static inline bool
+atomic_cmpxchg (int *num, int *old, int *new)
+{
+  return __atomic_compare_exchange (num, old, new, false,
+                                    ATOMIC_SEQ_CST, ATOMIC_SEQ_CST);
+}
+
+/* Atomic load. Returns *NUM */
+static inline int
+atomic_load (int *num)
+{
+  return __atomic_load_n (num, ATOMIC_SEQ_CST);
+}
+
+/* Atomic store. */
+static inline void
+atomic_store (int *num, int val)
+{
+  __atomic_store_n (num, val, ATOMIC_SEQ_CST);
+}
+
+/* Returns *PTR. */
+#define atomic_load_explicit(PTR, ORDER)                        \
+        __atomic_load_n ((PTR), (ORDER))
+#define atomic_load_relaxed(PTR) atomic_load_explicit (PTR, ATOMIC_RELAXED)
+#define atomic_load_acquire(PTR) atomic_load_explicit (PTR, ATOMIC_ACQUIRE)
+
+/* Sets *PTR to VAL. */
+#define atomic_store_explicit(PTR, VAL, ORDER)                  \
+        __atomic_store_n ((PTR), (VAL), (ORDER))
+#define atomic_store_relaxed(PTR, VAL)                          \
+        atomic_store_explicit (PTR, VAL, ATOMIC_RELAXED)
+#define atomic_store_release(PTR, VAL)                          \
+        atomic_store_explicit (PTR, VAL, ATOMIC_RELEASE)
+
+/* Sets *PTR to VAL and returns its old value. */
+#define atomic_exchange_explicit(PTR, VAL, ORDER)               \
+        __atomic_exchange_n ((PTR), (VAL), (ORDER))
+
+/* Applies an operation with VAL to *PTR and returns its old
+   value. */
+#define atomic_fetch_add_explicit(PTR, VAL, ORDER)              \
+        __atomic_fetch_add ((PTR), (VAL), (ORDER))
+#define atomic_fetch_sub_explicit(PTR, VAL, ORDER)              \
+        __atomic_fetch_sub ((PTR), (VAL), (ORDER))
+#define atomic_fetch_and_explicit(PTR, VAL, ORDER)              \
+        __atomic_fetch_and ((PTR), (VAL), (ORDER))
+#define atomic_fetch_or_explicit(PTR, VAL, ORDER)               \
+        __atomic_fetch_or ((PTR), (VAL), (ORDER))
+
+/* If *PTR equals *EXPECTED, sets *PTR to DESIRED with memory order
+   SUCCESS and returns true.  Otherwise, stores *PTR's value into
+   *EXPECTED with memory order FAILURE and returns false. */
+#define atomic_cmpxchg_explicit(PTR, EXPECTED, DESIRED, SUCCESS, FAILURE) \
+        __atomic_compare_exchange_n ((PTR), (EXPECTED), (DESIRED), false, \
+                                     (SUCCESS), (FAILURE))
+
+/* If *PTR equals *EXPECTED, sets *PTR to DESIRED and returns true.
+   Otherwise, stores *PTR's value into *EXPECTED and returns
+   false. */
+static inline bool
+atomic64_cmpxchg (int64_t *ptr, int64_t *expected, int64_t desired)
+{
+  bool success;
+  asm volatile ("lock cmpxchg8b %1"
+                : "=@ccz" (success), "+m" (*ptr), "+A" (*expected)
+                : "b" ((uint32_t) desired),
+                  "c" ((uint32_t) ((uint64_t) desired >> 32))
+                : "memory");
+  return success;
+}
+
+/* Returns *PTR. */
+static inline int64_t
+atomic64_load (int64_t *ptr)
+{
+  /* Compares *PTR with an arbitrary value and, if they happen to
+     be equal, stores that same value back. */
+  int64_t val = 0;
+  atomic64_cmpxchg (ptr, &val, 0);
+  return val;
+}
+
+/* Sets *PTR to VAL. */
+static inline void
+atomic64_store (int64_t *ptr, int64_t val)
+{
+  int64_t old = *ptr;
+  while (!atomic64_cmpxchg (ptr, &old, val))
+    continue;
+}
 
-int atomic_addi (int *, int);
-bool atomic_cmpxchg (int *, int *, int *);
-int atomic_load (int *);
-void atomic_store (int *, int);
+/* Adds VAL to *PTR and returns the old value. */
+static inline int64_t
+atomic64_fetch_add (int64_t *ptr, int64_t val)
+{
+  int64_t old = *ptr;
+  while (!atomic64_cmpxchg (ptr, &old, old + val))
+    continue;
+  return old;
+}
 
 #endif /* lib/atomic-ops.h */
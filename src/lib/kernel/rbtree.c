@@ -0,0 +1,371 @@
+#include "rbtree.h"
+#include "../debug.h"
+
+/* Red-black tree.
+
+   Every element is red or black, the root is black, a red
+   element has no red children, and every path from an element
+   down to a leaf passes the same number of black elements.  Thus
+   no path is more than twice as long as any other, and the tree
+   has height O(log n).  The algorithms follow [CLRS], chapter 13,
+   using null pointers instead of a sentinel leaf. */
+
+static void rotate_left (struct rbtree *, struct rb_elem *);
+static void rotate_right (struct rbtree *, struct rb_elem *);
+static void replace_child (struct rbtree *, struct rb_elem *old,
+                           struct rb_elem *new);
+static void insert_fixup (struct rbtree *, struct rb_elem *);
+static void remove_fixup (struct rbtree *, struct rb_elem *,
+                          struct rb_elem *parent);
+
+/* Returns true if E is a red element.  Leaves are black. */
+static inline bool
+is_red (const struct rb_elem *e)
+{
+  return e != NULL && e->red;
+}
+
+/* Initializes TREE as an empty tree ordered by LESS given
+   auxiliary data AUX. */
+void
+rb_init (struct rbtree *tree, rb_less_func *less, void *aux)
+{
+  ASSERT (tree != NULL);
+  ASSERT (less != NULL);
+
+  tree->root = NULL;
+  tree->leftmost = NULL;
+  tree->elem_cnt = 0;
+  tree->less = less;
+  tree->aux = aux;
+}
+
+/* Inserts NEW into TREE, after any elements equal to it. */
+void
+rb_insert (struct rbtree *tree, struct rb_elem *new)
+{
+  struct rb_elem *parent = NULL;
+  struct rb_elem **link = &tree->root;
+  bool leftmost = true;
+
+  ASSERT (new != NULL);
+
+  while (*link != NULL)
+    {
+      parent = *link;
+      if (tree->less (new, parent, tree->aux))
+        link = &parent->left;
+      else
+        {
+          link = &parent->right;
+          leftmost = false;
+        }
+    }
+
+  new->parent = parent;
+  new->left = new->right = NULL;
+  new->red = true;
+  *link = new;
+  if (leftmost)
+    tree->leftmost = new;
+  tree->elem_cnt++;
+
+  insert_fixup (tree, new);
+}
+
+/* Removes E from TREE. */
+void
+rb_remove (struct rbtree *tree, struct rb_elem *e)
+{
+  struct rb_elem *child, *parent;
+  bool removed_red;
+
+  ASSERT (e != NULL);
+  ASSERT (tree->elem_cnt > 0);
+
+  if (tree->leftmost == e)
+    tree->leftmost = rb_next (e);
+
+  if (e->left == NULL || e->right == NULL)
+    {
+      /* E has at most one child, which takes its place. */
+      child = e->left != NULL ? e->left : e->right;
+      parent = e->parent;
+      removed_red = e->red;
+      replace_child (tree, e, child);
+      if (child != NULL)
+        child->parent = parent;
+    }
+  else
+    {
+      /* E's successor has no left child.  Unlink the successor
+         from its position, then put it in E's place. */
+      struct rb_elem *next = e->right;
+      while (next->left != NULL)
+        next = next->left;
+
+      child = next->right;
+      removed_red = next->red;
+      if (next->parent == e)
+        parent = next;
+      else
+        {
+          parent = next->parent;
+          parent->left = child;
+          if (child != NULL)
+            child->parent = parent;
+          next->right = e->right;
+          e->right->parent = next;
+        }
+
+      replace_child (tree, e, next);
+      next->parent = e->parent;
+      next->left = e->left;
+      e->left->parent = next;
+      next->red = e->red;
+    }
+  tree->elem_cnt--;
+
+  if (!removed_red)
+    remove_fixup (tree, child, parent);
+}
+
+/* Returns the smallest element in TREE, or a null pointer if
+   TREE is empty.  Takes constant time. */
+struct rb_elem *
+rb_min (const struct rbtree *tree)
+{
+  return tree->leftmost;
+}
+
+/* Returns the largest element in TREE, or a null pointer if TREE
+   is empty. */
+struct rb_elem *
+rb_max (const struct rbtree *tree)
+{
+  struct rb_elem *e = tree->root;
+  if (e != NULL)
+    while (e->right != NULL)
+      e = e->right;
+  return e;
+}
+
+/* Returns the element that follows E in its tree, or a null
+   pointer if E is the largest element. */
+struct rb_elem *
+rb_next (const struct rb_elem *e)
+{
+  if (e->right != NULL)
+    {
+      e = e->right;
+      while (e->left != NULL)
+        e = e->left;
+      return (struct rb_elem *) e;
+    }
+  while (e->parent != NULL && e == e->parent->right)
+    e = e->parent;
+  return e->parent;
+}
+
+/* Returns the element that precedes E in its tree, or a null
+   pointer if E is the smallest element. */
+struct rb_elem *
+rb_prev (const struct rb_elem *e)
+{
+  if (e->left != NULL)
+    {
+      e = e->left;
+      while (e->right != NULL)
+        e = e->right;
+      return (struct rb_elem *) e;
+    }
+  while (e->parent != NULL && e == e->parent->left)
+    e = e->parent;
+  return e->parent;
+}
+
+/* Returns the number of elements in TREE. */
+size_t
+rb_size (const struct rbtree *tree)
+{
+  return tree->elem_cnt;
+}
+
+/* Returns true if TREE contains no elements, false otherwise. */
+bool
+rb_empty (const struct rbtree *tree)
+{
+  return tree->root == NULL;
+}
+
+/* Makes NEW take OLD's place as the child of OLD's parent, or as
+   the root of TREE.  Does not update NEW's parent pointer. */
+static void
+replace_child (struct rbtree *tree, struct rb_elem *old,
+               struct rb_elem *new)
+{
+  if (old->parent == NULL)
+    tree->root = new;
+  else if (old == old->parent->left)
+    old->parent->left = new;
+  else
+    old->parent->right = new;
+}
+
+/* Rotates E's right child into E's place. */
+static void
+rotate_left (struct rbtree *tree, struct rb_elem *e)
+{
+  struct rb_elem *r = e->right;
+
+  e->right = r->left;
+  if (r->left != NULL)
+    r->left->parent = e;
+  replace_child (tree, e, r);
+  r->parent = e->parent;
+  r->left = e;
+  e->parent = r;
+}
+
+/* Rotates E's left child into E's place. */
+static void
+rotate_right (struct rbtree *tree, struct rb_elem *e)
+{
+  struct rb_elem *l = e->left;
+
+  e->left = l->right;
+  if (l->right != NULL)
+    l->right->parent = e;
+  replace_child (tree, e, l);
+  l->parent = e->parent;
+  l->right = e;
+  e->parent = l;
+}
+
+/* Restores the red-black properties after inserting red element
+   E. */
+static void
+insert_fixup (struct rbtree *tree, struct rb_elem *e)
+{
+  while (is_red (e->parent))
+    {
+      struct rb_elem *parent = e->parent;
+      struct rb_elem *grandparent = parent->parent;
+
+      if (parent == grandparent->left)
+        {
+          struct rb_elem *uncle = grandparent->right;
+          if (is_red (uncle))
+            {
+              parent->red = uncle->red = false;
+              grandparent->red = true;
+              e = grandparent;
+              continue;
+            }
+          if (e == parent->right)
+            {
+              rotate_left (tree, parent);
+              e = parent;
+              parent = e->parent;
+            }
+          parent->red = false;
+          grandparent->red = true;
+          rotate_right (tree, grandparent);
+        }
+      else
+        {
+          struct rb_elem *uncle = grandparent->left;
+          if (is_red (uncle))
+            {
+              parent->red = uncle->red = false;
+              grandparent->red = true;
+              e = grandparent;
+              continue;
+            }
+          if (e == parent->left)
+            {
+              rotate_right (tree, parent);
+              e = parent;
+              parent = e->parent;
+            }
+          parent->red = false;
+          grandparent->red = true;
+          rotate_left (tree, grandparent);
+        }
+    }
+  tree->root->red = false;
+}
+
+/* Restores the red-black properties after removing a black
+   element.  E, which may be null, took the removed element's
+   place as a child of PARENT and is short one black element on
+   its paths. */
+static void
+remove_fixup (struct rbtree *tree, struct rb_elem *e,
+              struct rb_elem *parent)
+{
+  while (e != tree->root && !is_red (e))
+    {
+      if (e == parent->left)
+        {
+          struct rb_elem *sibling = parent->right;
+          if (is_red (sibling))
+            {
+              sibling->red = false;
+              parent->red = true;
+              rotate_left (tree, parent);
+              sibling = parent->right;
+            }
+          if (!is_red (sibling->left) && !is_red (sibling->right))
+            {
+              sibling->red = true;
+              e = parent;
+              parent = e->parent;
+              continue;
+            }
+          if (!is_red (sibling->right))
+            {
+              sibling->left->red = false;
+              sibling->red = true;
+              rotate_right (tree, sibling);
+              sibling = parent->right;
+            }
+          sibling->red = parent->red;
+          parent->red = false;
+          sibling->right->red = false;
+          rotate_left (tree, parent);
+        }
+      else
+        {
+          struct rb_elem *sibling = parent->left;
+          if (is_red (sibling))
+            {
+              sibling->red = false;
+              parent->red = true;
+              rotate_right (tree, parent);
+              sibling = parent->left;
+            }
+          if (!is_red (sibling->left) && !is_red (sibling->right))
+            {
+              sibling->red = true;
+              e = parent;
+              parent = e->parent;
+              continue;
+            }
+          if (!is_red (sibling->left))
+            {
+              sibling->right->red = false;
+              sibling->red = true;
+              rotate_left (tree, sibling);
+              sibling = parent->left;
+            }
+          sibling->red = parent->red;
+          parent->red = false;
+          sibling->left->red = false;
+          rotate_right (tree, parent);
+        }
+      e = tree->root;
+    }
+  if (e != NULL)
+    e->red = false;
+}
@@ -0,0 +1,77 @@
+#ifndef __LIB_KERNEL_RBTREE_H
+#define __LIB_KERNEL_RBTREE_H
+
+/* Red-black tree.
+
+   A balanced binary search tree: insertion and removal take
+   O(log n) time.  The tree also caches its leftmost element, so
+   that finding the smallest element takes O(1) time, which makes
+   it suitable as a priority queue that is also searchable.
+
+   Like lists and hash tables, the tree does not use dynamic
+   allocation.  Each structure that can be in a tree embeds a
+   struct rb_elem member, and rb_entry converts a pointer to that
+   member back into a pointer to the structure.  The tree is
+   ordered by a comparison function supplied to rb_init().
+   Elements that compare equal are kept in insertion order.
+
+   Callers that need a search the comparison function cannot
+   express may walk the tree themselves, starting from `root' and
+   following the `left' and `right' members, which are null at
+   the leaves. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Tree element. */
+struct rb_elem
+  {
+    struct rb_elem *parent;     /* Parent, or null at the root. */
+    struct rb_elem *left;       /* Smaller elements, or null. */
+    struct rb_elem *right;      /* Larger elements, or null. */
+    bool red;                   /* Red or black node? */
+  };
+
+/* Converts pointer to tree element RB_ELEM into a pointer to the
+   structure that RB_ELEM is embedded inside.  Supply the name of
+   the outer structure STRUCT and the member name MEMBER of the
+   tree element. */
+#define rb_entry(RB_ELEM, STRUCT, MEMBER)                       \
+        ((STRUCT *) ((uint8_t *) &(RB_ELEM)->parent             \
+                     - offsetof (STRUCT, MEMBER.parent)))
+
+/* Compares the value of two tree elements A and B, given
+   auxiliary data AUX.  Returns true if A is less than B, or
+   false if A is greater than or equal to B. */
+typedef bool rb_less_func (const struct rb_elem *a,
+                           const struct rb_elem *b,
+                           void *aux);
+
+/* Red-black tree. */
+struct rbtree
+  {
+    struct rb_elem *root;       /* Root element, or null if empty. */
+    struct rb_elem *leftmost;   /* Smallest element, or null. */
+    size_t elem_cnt;            /* Number of elements in tree. */
+    rb_less_func *less;         /* Comparison function. */
+    void *aux;                  /* Auxiliary data for `less'. */
+  };
+
+void rb_init (struct rbtree *, rb_less_func *, void *aux);
+
+/* Insertion and removal. */
+void rb_insert (struct rbtree *, struct rb_elem *);
+void rb_remove (struct rbtree *, struct rb_elem *);
+
+/* Traversal. */
+struct rb_elem *rb_min (const struct rbtree *);
+struct rb_elem *rb_max (const struct rbtree *);
+struct rb_elem *rb_next (const struct rb_elem *);
+struct rb_elem *rb_prev (const struct rb_elem *);
+
+/* Information. */
+size_t rb_size (const struct rbtree *);
+bool rb_empty (const struct rbtree *);
+
+#endif /* lib/kernel/rbtree.h */
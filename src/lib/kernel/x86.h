@@ -127,4 +127,32 @@ flushtlb (void)
   asm volatile("movl %%eax,%%cr3"::: "memory");
 }
 
+/* Invalidates the TLB entry for the page containing ADDR.  See
+   [IA32-v2a] "INVLPG". */
+static inline void
+invlpg (const void *addr)
+{
+  asm volatile("invlpg (%0)" : : "r" (addr) : "memory");
+}
+
+/* Tells the processor that we are in a spin-wait loop.  This
+   saves power, avoids a memory-order violation when the loop
+   exits, and gives a sibling hyperthread the core's resources.
+   See [IA32-v2b] "PAUSE". */
+static inline void
+cpu_relax (void)
+{
+  asm volatile("pause" : : : "memory");
+}
+
+/* Returns the processor's time-stamp counter, which counts clock
+   cycles since reset.  See [IA32-v2b] "RDTSC". */
+static inline uint64_t
+rdtsc (void)
+{
+  uint64_t val;
+  asm volatile("rdtsc" : "=A" (val));
+  return val;
+}
+
 #endif /* LIB_KERNEL_X86_H_ */
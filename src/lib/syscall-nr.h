@@ -38,6 +38,13 @@ enum
     SYS_SBRK,
     SYS_TIMES,
     SYS_SLEEP,
+    SYS_READV,                  /* Read into multiple buffers. */
+    SYS_WRITEV,                 /* Write from multiple buffers. */
+    SYS_PREAD,                  /* Read at a given file offset. */
+    SYS_PWRITE,                 /* Write at a given file offset. */
+    SYS_GETDENTS,               /* Read many directory entries. */
+    SYS_FSYNC,                  /* Write a file's data and metadata. */
+    SYS_FDATASYNC,              /* Write a file's data. */
   };
 
 #endif /* lib/syscall-nr.h */
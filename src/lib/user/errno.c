@@ -15,10 +15,26 @@ perror (const char *s)
         printf ("Success");
         break;
 
+      case ENOMEM:
+        printf ("Cannot allocate memory");
+        break;
+
       case EINVF:
         printf ("Invalid file descriptor");
         break;
 
+      case ENOTDIR:
+        printf ("Not a directory");
+        break;
+
+      case EINVAL:
+        printf ("Invalid argument");
+        break;
+
+      case ESPIPE:
+        printf ("Illegal seek");
+        break;
+
       case EBADF:
         printf ("Bad file descriptor");
         break;
@@ -1,7 +1,11 @@
 #ifndef __LIB_USER_ERRNO_H
 #define __LIB_USER_ERRNO_H
 
+#define ENOMEM 12
 #define EINVF 13
+#define ENOTDIR 20
+#define EINVAL 22
+#define ESPIPE 29
 #define EBADF 113
 #define EISDIR 123
 #define EMFILE 124
@@ -62,6 +62,25 @@
           retval < 0 ? errno=-retval, -1 : retval;              \
         })
 
+/* Invokes syscall NUMBER, passing arguments ARG0, ARG1, ARG2,
+   and ARG3, and returns the return value as an `int'. */
+#define syscall4(NUMBER, ARG0, ARG1, ARG2, ARG3)                \
+        ({                                                      \
+          int retval;                                           \
+          asm volatile                                          \
+            ("pushl %[arg3]; pushl %[arg2]; "                   \
+             "pushl %[arg1]; pushl %[arg0]; "                   \
+             "pushl %[number]; int $0x30; addl $20, %%esp"      \
+               : "=a" (retval)                                  \
+               : [number] "i" (NUMBER),                         \
+                 [arg0] "r" (ARG0),                             \
+                 [arg1] "r" (ARG1),                             \
+                 [arg2] "r" (ARG2),                             \
+                 [arg3] "r" (ARG3)                              \
+               : "memory");                                     \
+          retval < 0 ? errno=-retval, -1 : retval;              \
+        })
+
 void
 halt (void) 
 {
@@ -229,3 +248,45 @@ sleep (int64_t ticks)
 {
   syscall1 (SYS_SLEEP, ticks);
 }
+
+int
+readv (int fd, const struct iovec *iov, int iovcnt)
+{
+  return syscall3 (SYS_READV, fd, iov, iovcnt);
+}
+
+int
+writev (int fd, const struct iovec *iov, int iovcnt)
+{
+  return syscall3 (SYS_WRITEV, fd, iov, iovcnt);
+}
+
+int
+pread (int fd, void *buffer, unsigned length, unsigned offset)
+{
+  return syscall4 (SYS_PREAD, fd, buffer, length, offset);
+}
+
+int
+pwrite (int fd, const void *buffer, unsigned length, unsigned offset)
+{
+  return syscall4 (SYS_PWRITE, fd, buffer, length, offset);
+}
+
+int
+getdents (int fd, void *buffer, unsigned size)
+{
+  return syscall3 (SYS_GETDENTS, fd, buffer, size);
+}
+
+int
+fsync (int fd)
+{
+  return syscall1 (SYS_FSYNC, fd);
+}
+
+int
+fdatasync (int fd)
+{
+  return syscall1 (SYS_FDATASYNC, fd);
+}
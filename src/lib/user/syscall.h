@@ -2,6 +2,7 @@
 #define __LIB_USER_SYSCALL_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <debug.h>
 
 /* Process identifier. */
@@ -13,7 +14,33 @@ typedef int mapid_t;
 #define MAP_FAILED ((mapid_t) -1)
 
 /* Maximum characters in a filename written by readdir(). */
-#define READDIR_MAX_LEN 14
+#define READDIR_MAX_LEN 255
+
+/* A directory entry as stored by getdents().  Entries are packed
+   one after another in the caller's buffer, D_RECLEN bytes
+   apart. */
+struct dirent
+  {
+    int d_ino;                  /* Inode number. */
+    unsigned short d_reclen;    /* Bytes up to the next entry. */
+    unsigned char d_type;       /* DT_REG or DT_DIR. */
+    char d_name[];              /* Null-terminated file name. */
+  };
+
+/* Values of d_type. */
+#define DT_REG 1                /* Ordinary file. */
+#define DT_DIR 2                /* Directory. */
+
+/* Maximum number of buffers passed to readv() or writev().
+   The whole iovec array must fit in a single page. */
+#define IOV_MAX 512
+
+/* One buffer of a vectored read or write. */
+struct iovec
+  {
+    void *iov_base;             /* Start of the buffer. */
+    size_t iov_len;             /* Size of the buffer in bytes. */
+  };
 
 /* Typical return values from main() and arguments to exit(). */
 #define EXIT_SUCCESS 0          /* Successful execution. */
@@ -53,5 +80,12 @@ void exec2 (const char *file);
 void *sbrk (intptr_t increment);
 int64_t times (void);
 void sleep (int64_t ticks);
+int readv (int fd, const struct iovec *iov, int iovcnt);
+int writev (int fd, const struct iovec *iov, int iovcnt);
+int pread (int fd, void *buffer, unsigned length, unsigned offset);
+int pwrite (int fd, const void *buffer, unsigned length, unsigned offset);
+int getdents (int fd, void *buffer, unsigned size);
+int fsync (int fd);
+int fdatasync (int fd);
 
 #endif /* lib/user/syscall.h */
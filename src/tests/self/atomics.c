@@ -61,5 +61,34 @@ test_atomics (void)
   atomic_store (&var, store);
   check_value (var, store);
 
+  var = 3;
+  check_value (atomic_fetch_sub_explicit (&var, 1, ATOMIC_ACQ_REL), 3);
+  check_value (atomic_load_acquire (&var), 2);
+  atomic_store_release (&var, 7);
+  check_value (atomic_load_relaxed (&var), 7);
+
+  int *ptr = NULL;
+  int *expected = &var;
+  fail_if_false (!atomic_cmpxchg_explicit (&ptr, &expected, &val,
+                                           ATOMIC_ACQUIRE, ATOMIC_RELAXED)
+                 && expected == NULL, "pointer cmpxchg succeeded");
+  fail_if_false (atomic_cmpxchg_explicit (&ptr, &expected, &val,
+                                          ATOMIC_ACQUIRE, ATOMIC_RELAXED)
+                 && ptr == &val, "pointer cmpxchg failed");
+
+  /* Carries between the halves of 64-bit values. */
+  int64_t var64 = 0xffffffffLL;
+  fail_if_false (atomic64_fetch_add (&var64, 1) == 0xffffffffLL
+                 && atomic64_load (&var64) == 0x100000000LL,
+                 "64-bit add gave %llx", var64);
+  int64_t old64 = 0;
+  fail_if_false (!atomic64_cmpxchg (&var64, &old64, -1)
+                 && old64 == 0x100000000LL,
+                 "64-bit cmpxchg succeeded");
+  fail_if_false (atomic64_cmpxchg (&var64, &old64, -1) && var64 == -1,
+                 "64-bit cmpxchg failed");
+  atomic64_store (&var64, 0x123456789LL);
+  fail_if_false (var64 == 0x123456789LL, "64-bit store gave %llx", var64);
+
   pass ();
 }
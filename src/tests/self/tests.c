@@ -24,6 +24,7 @@ static const struct test tests[] =
     { "savecallerinfo", test_savecallerinfo },
     { "console", test_console },
     { "realclock", test_realclock },
+    { "tlb-shootdown", test_tlb_shootdown },
   };
 
 static const char *test_name;
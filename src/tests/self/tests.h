@@ -21,6 +21,7 @@ extern test_func test_cli_print;
 extern test_func test_savecallerinfo;
 extern test_func test_console;
 extern test_func test_realclock;
+extern test_func test_tlb_shootdown;
 
 void msg (const char *, ...);
 void fail_if_false (bool truth, const char *, ...);
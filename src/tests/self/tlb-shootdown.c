@@ -0,0 +1,147 @@
+/*
+ * Test that changing the mappings of a page directory invalidates
+ * the stale TLB entries of the other CPUs on which it is active.
+ *
+ * Two other CPUs load a page directory and read a run of user
+ * pages through it, which caches their translations.  This CPU
+ * then unmaps the pages and maps them to a different frame, and
+ * the other CPUs must read the new frame's contents.  This is done
+ * once for a single page, which the other CPUs invalidate with
+ * invlpg, and once for more than TLB_FLUSH_MAX_PAGES pages, for
+ * which they reload CR3 instead.
+ *
+ * The other CPUs read the pages in an interrupt handler, so that
+ * they cannot be preempted or migrated in between.  The test
+ * borrows the IPI_DEBUG vector for it.
+ */
+#include <debug.h>
+#include <stdint.h>
+#include "tests.h"
+#include "devices/lapic.h"
+#include "lib/atomic-ops.h"
+#include "lib/kernel/x86.h"
+#include "threads/cpu.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+
+/* CPUs other than this one that load the page directory. */
+#define REMOTE_CNT 2
+
+/* User address of the first page. */
+#define UPAGE ((uint8_t *) 0x10000000)
+
+/* Contents of the frames mapped before and after the change. */
+#define OLD_VALUE 0x01d01d01
+#define NEW_VALUE 0x0e90e90e
+
+/* What the other CPUs do when interrupted. */
+enum request
+  {
+    LOAD_PD,            /* Load SHARED_PD, then read the pages. */
+    CHECK_PD            /* Read the pages, then unload SHARED_PD. */
+  };
+
+static enum request request;
+static uint32_t *shared_pd;     /* Page directory under test. */
+static size_t page_cnt;         /* Number of pages to read. */
+static uint32_t expected;       /* Value each page must hold. */
+static int stale_cnt;           /* Pages that held something else. */
+static int done_cnt;            /* CPUs that handled REQUEST. */
+static unsigned int remote[REMOTE_CNT];  /* Indexes into cpus[]. */
+
+static void
+read_pages (struct intr_frame *f UNUSED)
+{
+  if (request == LOAD_PD)
+    pagedir_activate (shared_pd);
+  for (size_t i = 0; i < page_cnt; i++)
+    if (*(volatile uint32_t *) (UPAGE + i * PGSIZE) != expected)
+      atomic_inci (&stale_cnt);
+  if (request == CHECK_PD)
+    pagedir_activate (NULL);
+  atomic_inci (&done_cnt);
+}
+
+/* Has the other CPUs carry out REQ, and waits until they have. */
+static void
+send_request (enum request req)
+{
+  request = req;
+  atomic_store (&done_cnt, 0);
+  for (int i = 0; i < REMOTE_CNT; i++)
+    lapic_send_ipi_to (IPI_DEBUG, cpus[remote[i]].id);
+  while (atomic_load (&done_cnt) < REMOTE_CNT)
+    cpu_relax ();
+}
+
+/* Maps the CNT pages at UPAGE in SHARED_PD to KPAGE. */
+static void
+map_pages (void *kpage, size_t cnt)
+{
+  for (size_t i = 0; i < cnt; i++)
+    fail_if_false (pagedir_set_page (shared_pd, UPAGE + i * PGSIZE,
+                                     kpage, false),
+                   "out of memory mapping page %zu", i);
+}
+
+/* Maps CNT pages to OLD_KPAGE, has the other CPUs cache them,
+   and then remaps them to NEW_KPAGE.  The other CPUs must only
+   see the new mapping. */
+static void
+check_remap (size_t cnt, void *old_kpage, void *new_kpage)
+{
+  page_cnt = cnt;
+  map_pages (old_kpage, cnt);
+  expected = OLD_VALUE;
+  send_request (LOAD_PD);
+  fail_if_false (stale_cnt == 0, "%d pages not mapped to the old frame",
+                 stale_cnt);
+
+  if (cnt == 1)
+    pagedir_clear_page (shared_pd, UPAGE);
+  else
+    pagedir_clear_pages (shared_pd, UPAGE, cnt);
+  map_pages (new_kpage, cnt);
+  expected = NEW_VALUE;
+  send_request (CHECK_PD);
+  fail_if_false (stale_cnt == 0,
+                 "%d of %zu pages still mapped to the old frame "
+                 "on another CPU", stale_cnt, cnt);
+
+  /* No CPU has SHARED_PD loaded any more, so this sends no
+     IPIs. */
+  pagedir_clear_pages (shared_pd, UPAGE, cnt);
+}
+
+void
+test_tlb_shootdown (void)
+{
+  fail_if_false (ncpu > REMOTE_CNT, "This test needs > %d cpus running",
+                 REMOTE_CNT);
+  intr_register_ipi (T_IPI + IPI_DEBUG, read_pages, "#IPI TEST");
+
+  intr_disable_push ();
+  struct cpu *self = get_cpu ();
+  int cnt = 0;
+  for (unsigned int i = 0; i < ncpu && cnt < REMOTE_CNT; i++)
+    if (&cpus[i] != self)
+      remote[cnt++] = i;
+  intr_enable_pop ();
+
+  uint32_t *old_kpage = palloc_get_page (PAL_ASSERT);
+  uint32_t *new_kpage = palloc_get_page (PAL_ASSERT);
+  *old_kpage = OLD_VALUE;
+  *new_kpage = NEW_VALUE;
+  shared_pd = pagedir_create ();
+  fail_if_false (shared_pd != NULL, "out of memory creating page directory");
+
+  check_remap (1, old_kpage, new_kpage);
+  check_remap (TLB_FLUSH_MAX_PAGES + 1, old_kpage, new_kpage);
+
+  pagedir_destroy (shared_pd);
+  palloc_free_page (old_kpage);
+  palloc_free_page (new_kpage);
+  pass ();
+}
@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(tlb-shootdown) begin
+(tlb-shootdown) PASS
+(tlb-shootdown) end
+EOF
+pass;
@@ -0,0 +1,76 @@
+/* Adds thousands of kernel timers at once, cancels some of them,
+   and checks that each of the others runs exactly once, never
+   before its expiry tick. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "devices/ktimer.h"
+#include "devices/timer.h"
+
+/* Number of timers. */
+#define TIMER_CNT 5000
+/* Timers expire within this many ticks. */
+#define MAX_DELAY 500
+
+struct alarm
+  {
+    struct ktimer timer;
+    int64_t expires;            /* Tick the timer was added for. */
+    int64_t ran;                /* Tick it ran at, or 0. */
+    int run_cnt;                /* Number of times it ran. */
+    bool cancelled;             /* Was it cancelled? */
+  };
+
+static void alarm_func (struct ktimer *, void *alarm);
+
+void
+test_alarm_many (void)
+{
+  struct alarm *alarms = malloc (TIMER_CNT * sizeof *alarms);
+  ASSERT (alarms != NULL);
+
+  int64_t start = timer_ticks ();
+  for (int i = 0; i < TIMER_CNT; i++)
+    {
+      struct alarm *a = &alarms[i];
+      a->expires = start + 1 + i * 7919 % MAX_DELAY;
+      a->ran = 0;
+      a->run_cnt = 0;
+      a->cancelled = false;
+      ktimer_init (&a->timer, alarm_func, a);
+      ktimer_add (&a->timer, a->expires);
+    }
+
+  /* Cancel every third timer that is still pending. */
+  for (int i = 0; i < TIMER_CNT; i += 3)
+    alarms[i].cancelled = ktimer_cancel (&alarms[i].timer);
+
+  timer_sleep (MAX_DELAY + 10);
+
+  for (int i = 0; i < TIMER_CNT; i++)
+    {
+      struct alarm *a = &alarms[i];
+      if (a->cancelled)
+        {
+          if (a->run_cnt != 0)
+            fail ("timer %d ran after being cancelled", i);
+        }
+      else if (a->run_cnt != 1)
+        fail ("timer %d ran %d times", i, a->run_cnt);
+      else if (a->ran < a->expires)
+        fail ("timer %d for tick %lld ran early, at tick %lld",
+              i, a->expires, a->ran);
+    }
+  free (alarms);
+  pass ();
+}
+
+static void
+alarm_func (struct ktimer *t UNUSED, void *alarm_)
+{
+  struct alarm *a = alarm_;
+  a->ran = timer_ticks ();
+  a->run_cnt++;
+}
@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(alarm-many) begin
+(alarm-many) PASS
+(alarm-many) end
+EOF
+pass;
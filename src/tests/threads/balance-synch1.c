@@ -9,6 +9,7 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include "tests.h"
+#include "balancetest.h"
 #include "threads/thread.h"
 #include <debug.h>
 #include "threads/synch.h"
@@ -81,12 +82,14 @@ test_balance_synch1 (void)
 
   msg ("Running %d tests.", NUM_TESTS);
   int i;
+  balancetest_start ();
   for (i = 0; i < NUM_TESTS; i++)
     {
       test_fib ();
       if (i % 10 == 0)
         msg ("Finished test %d", i);
     }
+  balancetest_report_idle ();
   pass ();
 }
 
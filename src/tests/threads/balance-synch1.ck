@@ -20,7 +20,10 @@ foreach (@output) {
 load_balance_check (@kernel_ticks);
 idle_check (\@idle_ticks, \@kernel_ticks);
 
-check_expected ([<<'EOF']);
+# Idle time during the workload is only reported: the threads are
+# too short-lived to require a limit.
+@output = workload_idle_check (100, @output);
+compare_output ("run", \@output, [<<'EOF']);
 (balance-synch1) begin
 (balance-synch1) Load balancing test is run multiple times.
 (balance-synch1) to look for race conditions that may occur during.
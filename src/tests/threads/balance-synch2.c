@@ -8,6 +8,7 @@
  */
 #include "threads/synch.h"
 #include "tests/threads/tests.h"
+#include "tests/threads/balancetest.h"
 #include "threads/cpu.h"
 #include "threads/interrupt.h"
 #include "lib/kernel/list.h"
@@ -108,11 +109,13 @@ test_balance_sleepers (void)
   msg("It will not run fast!.");
   msg ("Running %d tests.", NUM_TESTS);
   int i;
+  balancetest_start ();
   for (i = 0;i<NUM_TESTS;i++) {
       test_inc_shared ();   
       if (i % 10 == 0)
         msg("Finished test %d", i);
   }
+  balancetest_report_idle ();
   
   pass ();
 }
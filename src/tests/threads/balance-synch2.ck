@@ -20,7 +20,10 @@ foreach (@output) {
 load_balance_check (@kernel_ticks);
 idle_check (\@idle_ticks, \@kernel_ticks);
 
-check_expected ([<<'EOF']);
+# Idle time during the workload is only reported: the threads are
+# too short-lived to require a limit.
+@output = workload_idle_check (100, @output);
+compare_output ("run", \@output, [<<'EOF']);
 (balance-synch2) begin
 (balance-synch2) This test is very unforgiving of race conditions.
 (balance-synch2) It will not run fast!.
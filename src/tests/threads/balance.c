@@ -6,6 +6,7 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include "tests.h"
+#include "balancetest.h"
 #include "threads/thread.h"
 #include <debug.h>
 #include "threads/synch.h"
@@ -60,6 +61,7 @@ balance (void)
   sema_init (&finished_sema, 0);
   unsigned int i;
 
+  balancetest_start ();
   for (i = 0; i < NUM_THREADS_PER_CPU * ncpu; i++)
     {
       thread_func *func = i % 2 == 0 ? fibtest : NOP;
@@ -70,6 +72,7 @@ balance (void)
     {
       sema_down (&finished_sema);
     }
+  balancetest_report_idle ();
   pass ();
 }
 
@@ -19,8 +19,9 @@ foreach (@output) {
 
 load_balance_check (@kernel_ticks);
 idle_check (\@idle_ticks, \@kernel_ticks);
+@output = workload_idle_check (25, @output);
 
-check_expected ([<<'EOF']);
+compare_output ("run", \@output, [<<'EOF']);
 (balance) begin
 (balance) This test creates short-running threads on one CPU.
 (balance) and long-running threads on the other..
@@ -33,4 +33,23 @@ sub idle_check {
 	}		
 }
 
+# Check the idle time that balancetest_report_idle() reported for
+# each CPU during the workload, which may not exceed MAX_PERCENT
+# of the workload's duration.  Returns OUTPUT without the report.
+sub workload_idle_check {
+	my ($max_percent, @output) = @_;
+	my ($found) = 0;
+	foreach (@output) {
+		my ($cpu, $idle, $elapsed) = /CPU(\d+) idle for (\d+) of (\d+) ticks$/
+		  or next;
+		$found = 1;
+		if ($idle * 100 > $elapsed * $max_percent) {
+			fail "CPU $cpu was idle for $idle of $elapsed ticks ",
+			"while there was work to pull\n";
+		}
+	}
+	fail "No idle time report found\n" if !$found;
+	return grep (!/CPU\d+ idle for \d+ of \d+ ticks$/, @output);
+}
+
 1;
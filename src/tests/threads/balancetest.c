@@ -0,0 +1,35 @@
+#include "tests/threads/balancetest.h"
+#include <stdint.h>
+#include "tests/threads/tests.h"
+#include "threads/cpu.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* Idle time measurement for the load balancing tests.
+
+   balancetest_start() is called before a test's workload and
+   balancetest_report_idle() after it.  The report prints, for
+   each CPU, how many of the ticks in between it spent idle, in
+   lines that balance.pm's workload_idle_check() understands. */
+
+static int64_t start_ticks;
+static uint64_t start_idle[NCPU_MAX];
+
+/* Records the current idle tick counts. */
+void
+balancetest_start (void)
+{
+  start_ticks = timer_ticks ();
+  for (unsigned int i = 0; i < ncpu; i++)
+    start_idle[i] = thread_idle_ticks (&cpus[i]);
+}
+
+/* Reports how long each CPU was idle since balancetest_start(). */
+void
+balancetest_report_idle (void)
+{
+  int64_t elapsed = timer_elapsed (start_ticks);
+  for (unsigned int i = 0; i < ncpu; i++)
+    msg ("CPU%u idle for %llu of %lld ticks",
+         i, thread_idle_ticks (&cpus[i]) - start_idle[i], elapsed);
+}
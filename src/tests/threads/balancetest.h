@@ -0,0 +1,7 @@
+#ifndef TESTS_THREADS_BALANCETEST_H_
+#define TESTS_THREADS_BALANCETEST_H_
+
+void balancetest_start (void);
+void balancetest_report_idle (void);
+
+#endif /* TESTS_THREADS_BALANCETEST_H_ */
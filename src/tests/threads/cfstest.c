@@ -15,8 +15,6 @@
 static struct cpu *real_cpu;
 static struct cpu vcpu;
 
-static uint64_t real_time;
-
 /*
    Tests have the general format:
    1) Setup initial thread
@@ -51,7 +49,7 @@ static uint64_t real_time;
 
 /*
  * How to deal with time?
- * In testing mode, timer_clock() doesnt look at jiffies but rather returns time that is set by the driver
+ * In testing mode, timer_gettime() doesnt look at the clock but rather returns time that is set by the driver
  */
 
 /* Make cpu local variable point to cpu by reloading the gdt and gs register*/
@@ -91,7 +89,6 @@ cfstest_set_up (void)
 {
   /* Must come before switch_cpu so stats are recorded on the right CPU */
   intr_disable_push ();
-  real_time = timer_gettime ();
   real_cpu = get_cpu ();
   memset (&vcpu, 0, sizeof(struct cpu));
   switch_cpu (&vcpu);
@@ -104,6 +101,6 @@ void
 cfstest_tear_down (void)
 {
   switch_cpu (real_cpu);
-  timer_settime (real_time);
+  timer_cleartime ();
   intr_enable_pop ();
 }
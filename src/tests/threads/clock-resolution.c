@@ -0,0 +1,50 @@
+/* Checks that the scheduler clock is monotonic, advances between
+   timer ticks, and keeps pace with the timer. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* Ticks over which the clock is read. */
+#define TEST_TICKS 20
+
+void
+test_clock_resolution (void)
+{
+  int64_t start_tick, elapsed_ticks;
+  uint64_t start, prev, now;
+  int distinct = 0;
+
+  /* Wait for a tick to start from a tick boundary. */
+  start_tick = timer_ticks ();
+  while (timer_ticks () == start_tick)
+    continue;
+
+  start_tick = timer_ticks ();
+  start = prev = timer_gettime ();
+  while (timer_elapsed (start_tick) < TEST_TICKS)
+    {
+      now = timer_gettime ();
+      if (now < prev)
+        fail ("clock went backward from %llu to %llu ns", prev, now);
+      if (now != prev)
+        distinct++;
+      prev = now;
+    }
+  elapsed_ticks = timer_elapsed (start_tick);
+
+  /* A clock that advances only on ticks would show one distinct
+     value per tick. */
+  if (distinct <= elapsed_ticks * 2)
+    fail ("clock took only %d values in %lld ticks",
+          distinct, elapsed_ticks);
+
+  /* The clock and the timer are driven by different hardware, so
+     allow generous slack. */
+  uint64_t tick_ns = (uint64_t) elapsed_ticks * NSEC_PER_SEC / TIMER_FREQ;
+  uint64_t clock_ns = prev - start;
+  if (clock_ns < tick_ns / 2 || clock_ns > tick_ns * 2)
+    fail ("clock advanced %llu ns in %lld ticks", clock_ns, elapsed_ticks);
+  pass ();
+}
@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(clock-resolution) begin
+(clock-resolution) PASS
+(clock-resolution) end
+EOF
+pass;
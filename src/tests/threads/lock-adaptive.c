@@ -0,0 +1,112 @@
+/* Measures how many context switches adaptive locks save.
+
+   Runs two threads per CPU that take turns at a shared struct
+   lock, holding it briefly.  This runs first with lock_spin
+   false, so that every contended acquire sleeps, as it would on a
+   semaphore, and then with lock spinning enabled.  Spinning while
+   the holder runs on another CPU should avoid most of the context
+   switches.  The test checks that the lock kept the threads out
+   of each other's critical sections and that the adaptive run
+   took fewer context switches than the sleeping one.
+
+   Context switches are counted over all CPUs.  Timings are
+   printed in ticks and are not checked. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/cpu.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* Threads per CPU. */
+#define THREADS_PER_CPU 2
+/* Lock acquisitions per thread. */
+#define ITERATIONS 5000
+/* Loop iterations spent inside and outside the critical
+   section. */
+#define HOLD_LOOPS 50
+#define IDLE_LOOPS 200
+
+static struct lock lock;
+static struct semaphore finished_sema;
+
+/* Shared data, incremented under LOCK. */
+static int64_t counter;
+
+static uint64_t run_threads (const char *name, bool spin);
+static void worker (void *);
+static void spin_loops (int loops);
+
+void
+test_lock_adaptive (void)
+{
+  bool saved_spin = lock_spin;
+
+  uint64_t sleeping_cs = run_threads ("sleeping", false);
+  uint64_t adaptive_cs = run_threads ("adaptive", true);
+  lock_spin = saved_spin;
+
+  fail_if_false (adaptive_cs < sleeping_cs,
+                 "adaptive run took %llu context switches, "
+                 "sleeping run only %llu", adaptive_cs, sleeping_cs);
+  pass ();
+}
+
+/* Runs THREADS_PER_CPU threads per CPU to completion, with
+   lock_spin set to SPIN, and prints the results under NAME.
+   Returns the number of context switches they took. */
+static uint64_t
+run_threads (const char *name, bool spin)
+{
+  int cnt = THREADS_PER_CPU * ncpu;
+  uint64_t start_cs = 0;
+
+  lock_init (&lock);
+  sema_init (&finished_sema, 0);
+  counter = 0;
+  lock_spin = spin;
+
+  for (unsigned int i = 0; i < ncpu; i++)
+    start_cs += cpus[i].cs;
+  int64_t start = timer_ticks ();
+  for (int i = 0; i < cnt; i++)
+    thread_create ("worker", NICE_DEFAULT, worker, NULL);
+  for (int i = 0; i < cnt; i++)
+    sema_down (&finished_sema);
+  int64_t ticks = timer_elapsed (start);
+  uint64_t cs = 0;
+  for (unsigned int i = 0; i < ncpu; i++)
+    cs += cpus[i].cs;
+
+  fail_if_false (counter == (int64_t) cnt * ITERATIONS,
+                 "%s: counter is %lld, expected %d",
+                 name, counter, cnt * ITERATIONS);
+  msg ("%s: %d threads, %llu context switches in %lld ticks",
+       name, cnt, cs - start_cs, ticks);
+  return cs - start_cs;
+}
+
+static void
+worker (void *aux UNUSED)
+{
+  for (int i = 0; i < ITERATIONS; i++)
+    {
+      lock_acquire (&lock);
+      int64_t c = counter;
+      spin_loops (HOLD_LOOPS);
+      counter = c + 1;
+      lock_release (&lock);
+
+      spin_loops (IDLE_LOOPS);
+    }
+  sema_up (&finished_sema);
+}
+
+/* Busy-waits for LOOPS iterations. */
+static void
+spin_loops (int loops)
+{
+  for (volatile int i = 0; i < loops; i++)
+    continue;
+}
@@ -0,0 +1,85 @@
+/* Measures the cost of scheduling as the number of ready threads
+   grows.
+
+   Fills a private ready queue with idle thread structures and
+   then repeatedly runs the scheduler's hot path on it: pick the
+   next thread, run a timer tick for it and put it back with a
+   yield, as if it had used up its time slice.  With a tree-based
+   ready queue the time per round should grow only
+   logarithmically with the queue depth, instead of linearly.
+
+   Timings are printed in ticks and are not checked. */
+
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/palloc.h"
+#include "threads/scheduler.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* Deepest queue measured. */
+#define MAX_DEPTH 256
+/* Scheduling rounds per depth. */
+#define ROUNDS 50000
+
+static struct ready_queue rq;
+static struct thread *threads[MAX_DEPTH];
+
+static int64_t run_rounds (int depth);
+
+void
+test_rq_depth (void)
+{
+  for (int i = 0; i < MAX_DEPTH; i++)
+    {
+      threads[i] = palloc_get_page (PAL_ZERO);
+      fail_if_false (threads[i] != NULL, "out of memory");
+    }
+
+  for (int depth = 1; depth <= MAX_DEPTH; depth *= 4)
+    msg ("%d ready threads: %d rounds in %lld ticks",
+         depth, ROUNDS, run_rounds (depth));
+
+  for (int i = 0; i < MAX_DEPTH; i++)
+    palloc_free_page (threads[i]);
+  pass ();
+}
+
+/* Runs ROUNDS scheduling rounds on a ready queue holding DEPTH
+   threads and returns the elapsed ticks. */
+static int64_t
+run_rounds (int depth)
+{
+  sched_init (&rq);
+  rq.curr = NULL;
+  for (int i = 0; i < depth; i++)
+    {
+      struct thread *t = threads[i];
+      memset (t, 0, sizeof *t);
+      t->tid = i + 1;
+      t->nice = NICE_DEFAULT;
+      t->vruntime = i + 1;
+      t->status = THREAD_READY;
+      sched_unblock (&rq, t, 1);
+    }
+  fail_if_false ((int) rq.nr_ready == depth, "%lu threads in queue, "
+                 "expected %d", rq.nr_ready, depth);
+
+  int64_t start = timer_ticks ();
+  for (int i = 0; i < ROUNDS; i++)
+    {
+      struct thread *t = sched_pick_next (&rq);
+      fail_if_false (t != NULL, "ready queue is empty");
+      rq.curr = t;
+      sched_tick (&rq, t);
+      t->status = THREAD_READY;
+      sched_yield (&rq, t);
+      rq.curr = NULL;
+    }
+  int64_t ticks = timer_elapsed (start);
+
+  fail_if_false ((int) rq.nr_ready == depth, "%lu threads in queue, "
+                 "expected %d", rq.nr_ready, depth);
+  return ticks;
+}
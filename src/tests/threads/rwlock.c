@@ -0,0 +1,164 @@
+/* Contention microbenchmarks for readers-writer locks.
+
+   rwlock-read runs an increasing number of threads that only
+   read a shared value, first under a struct rw_lock and then
+   under a plain struct lock.  Readers should scale with the
+   number of CPUs under the rw_lock and serialize under the lock.
+
+   rwlock-mixed runs readers and writers together under each
+   rw_lock policy and checks that writers are exclusive and that
+   readers never see a half-done update.
+
+   Timings are printed in ticks and are not checked. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/mp.h"
+#include "threads/rw-lock.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+#include <atomic-ops.h>
+#include <debug.h>
+
+/* Lock acquisitions per thread. */
+#define ITERATIONS 20000
+/* Loop iterations spent inside each critical section. */
+#define HOLD_LOOPS 50
+/* In rwlock-mixed, one thread in WRITER_RATIO is a writer. */
+#define WRITER_RATIO 4
+
+static struct rw_lock rw;
+static struct lock mutex;
+static struct semaphore finished_sema;
+static bool use_mutex;
+
+/* Shared data.  A writer increments both values, so readers must
+   always find them equal. */
+static int value_a, value_b;
+
+/* Threads currently inside a critical section. */
+static int readers_inside;
+static int writers_inside;
+
+static int64_t run_threads (int cnt, thread_func *, thread_func *, int);
+static void reader (void *);
+static void writer (void *);
+static void hold (void);
+
+void
+test_rwlock_read (void)
+{
+  lock_init (&mutex);
+  for (int cnt = 1; cnt <= 2 * (int) ncpu; cnt *= 2)
+    {
+      rw_lock_init (&rw, RW_LOCK_FAIR);
+      use_mutex = false;
+      int64_t rw_ticks = run_threads (cnt, reader, NULL, 0);
+      use_mutex = true;
+      int64_t mutex_ticks = run_threads (cnt, reader, NULL, 0);
+      msg ("%d readers: rw_lock %lld ticks, lock %lld ticks",
+           cnt, rw_ticks, mutex_ticks);
+    }
+  pass ();
+}
+
+void
+test_rwlock_mixed (void)
+{
+  static const char *names[] = { "fair", "prefer-writers" };
+  enum rw_lock_policy policies[] = { RW_LOCK_FAIR, RW_LOCK_PREFER_WRITERS };
+  int cnt = 2 * WRITER_RATIO * ncpu;
+
+  use_mutex = false;
+  for (int i = 0; i < 2; i++)
+    {
+      rw_lock_init (&rw, policies[i]);
+      value_a = value_b = 0;
+      int64_t ticks = run_threads (cnt, reader, writer, WRITER_RATIO);
+      fail_if_false (value_a == value_b
+                     && value_a == cnt / WRITER_RATIO * ITERATIONS,
+                     "writers made %d and %d updates", value_a, value_b);
+      msg ("%s: %d threads %lld ticks", names[i], cnt, ticks);
+    }
+  pass ();
+}
+
+/* Runs CNT threads to completion and returns the elapsed ticks.
+   Every RATIO'th thread runs WRITER_FUNC, the others run
+   READER_FUNC; RATIO 0 means no writers. */
+static int64_t
+run_threads (int cnt, thread_func *reader_func, thread_func *writer_func,
+             int ratio)
+{
+  sema_init (&finished_sema, 0);
+  readers_inside = writers_inside = 0;
+
+  int64_t start = timer_ticks ();
+  for (int i = 0; i < cnt; i++)
+    {
+      bool is_writer = ratio != 0 && i % ratio == 0;
+      thread_create (is_writer ? "writer" : "reader", NICE_DEFAULT,
+                     is_writer ? writer_func : reader_func, NULL);
+    }
+  for (int i = 0; i < cnt; i++)
+    sema_down (&finished_sema);
+  return timer_elapsed (start);
+}
+
+static void
+reader (void *aux UNUSED)
+{
+  for (int i = 0; i < ITERATIONS; i++)
+    {
+      if (use_mutex)
+        lock_acquire (&mutex);
+      else if (i % 2 == 0 || !read_lock_try_acquire (&rw))
+        read_lock_acquire (&rw);
+
+      atomic_inci (&readers_inside);
+      fail_if_false (atomic_load (&writers_inside) == 0,
+                     "reader runs concurrently with a writer");
+      int a = value_a;
+      hold ();
+      fail_if_false (a == value_b, "reader saw a partial update");
+      atomic_deci (&readers_inside);
+
+      if (use_mutex)
+        lock_release (&mutex);
+      else
+        rw_lock_release (&rw);
+    }
+  sema_up (&finished_sema);
+}
+
+static void
+writer (void *aux UNUSED)
+{
+  for (int i = 0; i < ITERATIONS; i++)
+    {
+      if (i % 2 == 0 || !write_lock_try_acquire (&rw))
+        write_lock_acquire (&rw);
+      fail_if_false (rw_lock_held_by_current_thread (&rw),
+                     "writer does not hold the lock");
+
+      fail_if_false (atomic_inci (&writers_inside) == 1
+                     && atomic_load (&readers_inside) == 0,
+                     "writer is not exclusive");
+      value_a++;
+      hold ();
+      value_b++;
+      atomic_deci (&writers_inside);
+
+      rw_lock_release (&rw);
+    }
+  sema_up (&finished_sema);
+}
+
+/* Spends a little time inside a critical section. */
+static void
+hold (void)
+{
+  for (volatile int i = 0; i < HOLD_LOOPS; i++)
+    continue;
+}
@@ -0,0 +1,172 @@
+/* Measures spinlock throughput and fairness under contention.
+
+   Starts one thread per CPU.  Each thread acquires a shared lock,
+   updates shared data and releases it again, as often as it can
+   for a fixed time.  This runs first with a struct spinlock, as
+   chosen by SPINLOCK in Make.config, and then with a bare
+   test-and-set lock that spins on an atomic exchange, for
+   comparison.  Afterward, the test checks that the locks kept the
+   threads out of each other's critical sections.
+
+   For each lock, the test prints the total number of
+   acquisitions and the fewest and most made by a single thread.
+   A fair lock keeps the two close together.  Timings are printed
+   in ticks and are not checked. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/cpu.h"
+#include "threads/interrupt.h"
+#include "threads/spinlock.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+#include <atomic-ops.h>
+
+/* Ticks to run each lock for. */
+#define RUN_TICKS 200
+/* Loop iterations spent inside and outside the critical
+   section. */
+#define HOLD_LOOPS 20
+#define IDLE_LOOPS 20
+
+/* A lock under test. */
+struct lock_ops
+  {
+    const char *name;
+    void (*acquire) (void);
+    void (*release) (void);
+  };
+
+static struct spinlock spinlock;
+static int tas_word;
+
+static struct semaphore finished_sema;
+static const struct lock_ops *ops;
+static int stop;
+
+/* Shared data.  Each holder increments both values, so they must
+   stay equal to each other and to the sum of the threads'
+   acquisitions. */
+static volatile int64_t shared_a, shared_b;
+
+/* Acquisitions made by each thread. */
+static int64_t counts[NCPU_MAX];
+
+static void run_lock (const struct lock_ops *);
+static void worker (void *);
+static void spin (int loops);
+
+static void
+spinlock_ops_acquire (void)
+{
+  spinlock_acquire (&spinlock);
+}
+
+static void
+spinlock_ops_release (void)
+{
+  spinlock_release (&spinlock);
+}
+
+static void
+tas_acquire (void)
+{
+  intr_disable_push ();
+  while (atomic_xchg (&tas_word, 1) != 0)
+    continue;
+}
+
+static void
+tas_release (void)
+{
+  atomic_xchg (&tas_word, 0);
+  intr_enable_pop ();
+}
+
+void
+test_spinlock_contention (void)
+{
+  static const struct lock_ops locks[] =
+    {
+      { "spinlock", spinlock_ops_acquire, spinlock_ops_release },
+      { "test-and-set", tas_acquire, tas_release },
+    };
+
+  spinlock_init (&spinlock);
+  tas_word = 0;
+  for (size_t i = 0; i < sizeof locks / sizeof *locks; i++)
+    run_lock (&locks[i]);
+  pass ();
+}
+
+/* Runs one thread per CPU on LOCK for RUN_TICKS and prints the
+   results. */
+static void
+run_lock (const struct lock_ops *lock)
+{
+  int cnt = ncpu;
+
+  ops = lock;
+  shared_a = shared_b = 0;
+  atomic_store (&stop, 0);
+  sema_init (&finished_sema, 0);
+
+  int64_t start = timer_ticks ();
+  for (int i = 0; i < cnt; i++)
+    {
+      counts[i] = 0;
+      thread_create ("worker", NICE_DEFAULT, worker, &counts[i]);
+    }
+  timer_sleep (RUN_TICKS);
+  atomic_store (&stop, 1);
+  for (int i = 0; i < cnt; i++)
+    sema_down (&finished_sema);
+  int64_t ticks = timer_elapsed (start);
+
+  int64_t total = 0, min = INT64_MAX, max = 0;
+  for (int i = 0; i < cnt; i++)
+    {
+      total += counts[i];
+      if (counts[i] < min)
+        min = counts[i];
+      if (counts[i] > max)
+        max = counts[i];
+    }
+  fail_if_false (shared_a == total && shared_b == total,
+                 "%s: %lld acquisitions made %lld and %lld updates",
+                 lock->name, total, shared_a, shared_b);
+
+  msg ("%s: %d threads, %lld acquisitions, %lld to %lld per thread, "
+       "in %lld ticks", lock->name, cnt, total, min, max, ticks);
+}
+
+/* Acquires and releases the lock under test until told to stop,
+   counting acquisitions in the int64_t that COUNT points to. */
+static void
+worker (void *count_)
+{
+  int64_t *count = count_;
+
+  while (atomic_load (&stop) == 0)
+    {
+      ops->acquire ();
+      int64_t a = shared_a;
+      spin (HOLD_LOOPS);
+      shared_a = a + 1;
+      shared_b++;
+      ops->release ();
+
+      (*count)++;
+      spin (IDLE_LOOPS);
+    }
+  sema_up (&finished_sema);
+}
+
+/* Busy-waits for LOOPS iterations. */
+static void
+spin (int loops)
+{
+  for (volatile int i = 0; i < loops; i++)
+    continue;
+}
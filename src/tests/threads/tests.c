@@ -37,6 +37,15 @@ static const struct test tests[] =
   { "balance", balance },
   { "balance-synch1", test_balance_synch1 },
   { "balance-synch2", test_balance_sleepers },
+  { "rwlock-read", test_rwlock_read },
+  { "rwlock-mixed", test_rwlock_mixed },
+  { "rq-depth", test_rq_depth },
+  { "clock-resolution", test_clock_resolution },
+  { "tickless-idle", test_tickless_idle },
+  { "alarm-many", test_alarm_many },
+  { "spinlock-contention", test_spinlock_contention },
+  { "lock-overhead", test_lock_overhead },
+  { "lock-adaptive", test_lock_adaptive },
   };
 
 static const char *test_name;
@@ -32,6 +32,15 @@ extern test_func test_cfs_sleepers;
 extern test_func balance;
 extern test_func test_balance_synch1;
 extern test_func test_balance_sleepers;
+extern test_func test_rwlock_read;
+extern test_func test_rwlock_mixed;
+extern test_func test_rq_depth;
+extern test_func test_clock_resolution;
+extern test_func test_tickless_idle;
+extern test_func test_alarm_many;
+extern test_func test_spinlock_contention;
+extern test_func test_lock_overhead;
+extern test_func test_lock_adaptive;
 
 void msg (const char *, ...);
 void fail_if_false (bool truth, const char *, ...);
@@ -0,0 +1,43 @@
+/* Checks that idle CPUs stop their timer tick.
+
+   While the test sleeps, every CPU but CPU 0, which keeps time,
+   has nothing to run, so it should take hardly any timer
+   interrupts.  Idle time must still be accounted for. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/cpu.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* Ticks to sleep. */
+#define SLEEP_TICKS 200
+
+void
+test_tickless_idle (void)
+{
+  uint64_t start_intrs[NCPU_MAX];
+  uint64_t start_idle[NCPU_MAX];
+
+  for (unsigned int i = 0; i < ncpu; i++)
+    {
+      start_intrs[i] = cpus[i].timer_interrupts;
+      start_idle[i] = thread_idle_ticks (&cpus[i]);
+    }
+  int64_t start = timer_ticks ();
+  timer_sleep (SLEEP_TICKS);
+  int64_t elapsed = timer_elapsed (start);
+
+  for (unsigned int i = 1; i < ncpu; i++)
+    {
+      uint64_t intrs = cpus[i].timer_interrupts - start_intrs[i];
+      uint64_t idle = thread_idle_ticks (&cpus[i]) - start_idle[i];
+      if (intrs * 4 > (uint64_t) elapsed)
+        fail ("CPU%u took %llu timer interrupts in %lld idle ticks",
+              i, intrs, elapsed);
+      if (idle * 2 < (uint64_t) elapsed)
+        fail ("CPU%u was idle for only %llu of %lld ticks",
+              i, idle, elapsed);
+    }
+  pass ();
+}
@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(tickless-idle) begin
+(tickless-idle) PASS
+(tickless-idle) end
+EOF
+pass;
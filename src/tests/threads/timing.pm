@@ -0,0 +1,17 @@
+# Checks a test that prints timings.  Lines ending in "ticks" vary
+# from run to run and are dropped; the rest must be exactly the
+# test's begin, PASS and end lines.
+sub check_timing {
+    our ($test);
+    my ($name) = $test;
+    $name =~ s%.*/%%;
+
+    my (@output) = read_text_file ("$test.output");
+    common_checks ("run", @output);
+
+    @output = grep (!/^\(\Q$name\E\) .* ticks$/, @output);
+    compare_output ("run", \@output,
+		    ["($name) begin\n($name) PASS\n($name) end\n"]);
+}
+
+1;
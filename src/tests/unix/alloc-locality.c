@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "syscall_wrapper.h"
+
+/* Processes writing files at the same time. */
+#define WRITERS 4
+/* Size of each file, in sectors. */
+#define FILE_SECTORS 200
+
+static char block[512];
+
+static void write_file (int id);
+static void read_file (int id);
+static void make_name (char *name, int id);
+
+int
+main (void)
+{
+  printf ("alloc-locality begin\n");
+
+  /* Each writer appends to its own file one sector at a time, so
+     the file system sees the allocations of all files
+     interleaved.  With allocation groups the writers do not
+     serialize on the free map.  Where the sectors end up cannot
+     be seen from here; the timings only hint at it, through the
+     read-ahead below, and are not checked. */
+  int64_t start = times ();
+  int pids[WRITERS];
+  for (int i = 0; i < WRITERS; i++)
+    {
+      pids[i] = Fork ();
+      if (pids[i] == 0)
+        {
+          write_file (i);
+          exit (0);
+        }
+    }
+  for (int i = 0; i < WRITERS; i++)
+    if (wait (pids[i]) != 0)
+      {
+        printf ("writer %d failed\n", i);
+        exit (-1);
+      }
+  printf ("write %d files in parallel: %lld ticks\n",
+          WRITERS, times () - start);
+
+  /* Reading a file back sequentially benefits from read-ahead
+     only if its sectors are close together on disk. */
+  start = times ();
+  for (int i = 0; i < WRITERS; i++)
+    read_file (i);
+  printf ("read %d files sequentially: %lld ticks\n",
+          WRITERS, times () - start);
+
+  char name[16];
+  for (int i = 0; i < WRITERS; i++)
+    {
+      make_name (name, i);
+      remove (name);
+    }
+  printf ("alloc-locality end\n");
+  return EXIT_SUCCESS;
+}
+
+/* Creates file ID and fills it with FILE_SECTORS sectors. */
+static void
+write_file (int id)
+{
+  char name[16];
+  make_name (name, id);
+  Create (name, 0);
+  int fd = Open (name);
+  memset (block, 'a' + id, sizeof block);
+  for (int i = 0; i < FILE_SECTORS; i++)
+    Write (fd, block, sizeof block);
+  close (fd);
+}
+
+/* Reads file ID back and checks its contents. */
+static void
+read_file (int id)
+{
+  char name[16];
+  make_name (name, id);
+  int fd = Open (name);
+  for (int i = 0; i < FILE_SECTORS; i++)
+    if (read (fd, block, sizeof block) != sizeof block
+        || block[0] != 'a' + id || block[sizeof block - 1] != 'a' + id)
+      {
+        printf ("%s: bad data in sector %d\n", name, i);
+        exit (-1);
+      }
+  close (fd);
+}
+
+/* Stores the name of file ID in NAME. */
+static void
+make_name (char *name, int id)
+{
+  snprintf (name, 16, "locality%d", id);
+}
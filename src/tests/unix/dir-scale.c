@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <syscall.h>
+#include "syscall_wrapper.h"
+
+/* Entries created in the test directory.  Every file takes an
+   inode sector, so run this with a file system disk of at least
+   8 MB. */
+#define NUM_ENTRIES 10000
+/* Entries per timed step. */
+#define STEP 1000
+
+static const char *dir_name = "scale";
+
+static void make_name (char *name, int i);
+static void list_entries (void);
+
+int
+main (void)
+{
+  char name[16];
+
+  printf ("dir-scale begin\n");
+  if (!mkdir (dir_name))
+    {
+      printf ("mkdir failed\n");
+      exit (-1);
+    }
+  Chdir (dir_name);
+
+  /* With an indexed directory every step should take about as
+     long as the first one instead of growing with the number of
+     entries already present. */
+  for (int i = 0; i < NUM_ENTRIES; i += STEP)
+    {
+      int64_t start = times ();
+      for (int j = i; j < i + STEP; j++)
+        {
+          make_name (name, j);
+          Create (name, 0);
+        }
+      int64_t create_ticks = times () - start;
+
+      /* Look up a spread of existing names, most of which are not
+         in the dentry cache any more. */
+      start = times ();
+      for (int j = 0; j < STEP; j++)
+        {
+          make_name (name, (j * 7919) % (i + STEP));
+          close (Open (name));
+        }
+      int64_t open_ticks = times () - start;
+
+      printf ("%5d entries: create %lld ticks, open %lld ticks\n",
+              i + STEP, create_ticks, open_ticks);
+    }
+
+  list_entries ();
+
+  int64_t start = times ();
+  for (int i = 0; i < NUM_ENTRIES; i++)
+    {
+      make_name (name, i);
+      if (!remove (name))
+        {
+          printf ("remove %s failed\n", name);
+          exit (-1);
+        }
+    }
+  printf ("remove %d entries: %lld ticks\n", NUM_ENTRIES, times () - start);
+
+  Chdir ("..");
+  if (!remove (dir_name))
+    {
+      printf ("directory not empty after removing all entries\n");
+      exit (-1);
+    }
+
+  printf ("dir-scale end\n");
+  return EXIT_SUCCESS;
+}
+
+/* Stores the name of entry I in NAME. */
+static void
+make_name (char *name, int i)
+{
+  snprintf (name, 16, "file%d", i);
+}
+
+/* Lists the current directory once with readdir() and once with
+   getdents() and checks that both see every entry. */
+static void
+list_entries (void)
+{
+  static int buf[1024];
+  char name[READDIR_MAX_LEN + 1];
+  int cnt, n;
+
+  int fd = Open (".");
+  int64_t start = times ();
+  for (cnt = 0; readdir (fd, name); cnt++)
+    continue;
+  int64_t readdir_ticks = times () - start;
+  close (fd);
+  if (cnt != NUM_ENTRIES)
+    {
+      printf ("readdir returned %d entries\n", cnt);
+      exit (-1);
+    }
+
+  fd = Open (".");
+  start = times ();
+  cnt = 0;
+  while ((n = getdents (fd, buf, sizeof buf)) > 0)
+    for (int ofs = 0; ofs < n; cnt++)
+      ofs += ((struct dirent *) ((char *) buf + ofs))->d_reclen;
+  int64_t getdents_ticks = times () - start;
+  close (fd);
+  if (n < 0 || cnt != NUM_ENTRIES)
+    {
+      printf ("getdents returned %d entries\n", cnt);
+      exit (-1);
+    }
+
+  printf ("list %d entries: readdir %lld ticks, getdents %lld ticks\n",
+          NUM_ENTRIES, readdir_ticks, getdents_ticks);
+}
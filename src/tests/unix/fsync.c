@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "syscall_wrapper.h"
+
+/* Sectors of unrelated dirty data left in the buffer cache. */
+#define BULK_SECTORS 24
+/* Synced writes to the small file. */
+#define ITERATIONS 200
+
+static char block[512];
+
+static int64_t sync_loop (int fd, int (*sync) (int));
+
+int
+main (void)
+{
+  printf ("fsync begin\n");
+  Create ("bulk", 0);
+  Create ("log", 0);
+
+  /* Dirty many blocks of another file that are never synced.
+     With per-inode dirty lists syncing the log must not write
+     them back, so its cost does not depend on BULK_SECTORS. */
+  int bulk = Open ("bulk");
+  memset (block, 'b', sizeof block);
+  for (int i = 0; i < BULK_SECTORS; i++)
+    Write (bulk, block, sizeof block);
+
+  int fd = Open ("log");
+  printf ("fdatasync: %lld ticks for %d writes\n",
+          sync_loop (fd, fdatasync), ITERATIONS);
+  printf ("fsync: %lld ticks for %d writes\n",
+          sync_loop (fd, fsync), ITERATIONS);
+
+  /* The synced data must read back intact. */
+  char buf[sizeof block];
+  if (pread (fd, buf, sizeof buf, 0) != sizeof buf
+      || memcmp (buf, block, sizeof buf))
+    {
+      printf ("synced data does not match\n");
+      exit (-1);
+    }
+  if (fsync (bulk) != 0 || fsync (-1) != -1 || errno != EBADF)
+    {
+      printf ("unexpected fsync result\n");
+      exit (-1);
+    }
+
+  close (fd);
+  close (bulk);
+  printf ("fsync end\n");
+  return EXIT_SUCCESS;
+}
+
+/* Overwrites the first sector of FD ITERATIONS times, calling
+   SYNC after each write, and returns the elapsed ticks.  Only
+   the first write extends the file. */
+static int64_t
+sync_loop (int fd, int (*sync) (int))
+{
+  int64_t start = times ();
+  for (int i = 0; i < ITERATIONS; i++)
+    {
+      memset (block, 'a' + i % 26, sizeof block);
+      if (pwrite (fd, block, sizeof block, 0) != sizeof block
+          || sync (fd) != 0)
+        {
+          printf ("write or sync failed\n");
+          exit (-1);
+        }
+    }
+  return times () - start;
+}
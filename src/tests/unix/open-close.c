@@ -0,0 +1,70 @@
+#include <stdio.h>
+#include <syscall.h>
+#include "syscall_wrapper.h"
+
+#define MAX_WORKER 8
+/* Open/close pairs performed by every worker. */
+#define ITERATIONS 500
+
+static const char *file_name = "open_close";
+
+static void open_close_worker (void);
+static int64_t run_workers (int num_workers);
+
+int
+main (void)
+{
+  printf ("open-close begin\n");
+  Create (file_name, 0);
+
+  /* Each worker does the same amount of work, so with open and
+     close scaling across CPUs the elapsed time should stay flat
+     as workers are added instead of growing with their number. */
+  for (int n = 1; n <= MAX_WORKER; n *= 2)
+    {
+      int64_t ticks = run_workers (n);
+      printf ("%d worker(s), %d open/close each: %lld ticks\n",
+              n, ITERATIONS, ticks);
+    }
+
+  printf ("open-close end\n");
+  return EXIT_SUCCESS;
+}
+
+/* Repeatedly opens and closes the shared file, also duplicating
+   the descriptor so that the reference count is exercised. */
+static void
+open_close_worker (void)
+{
+  for (int i = 0; i < ITERATIONS; i++)
+    {
+      int fd = Open ((char *) file_name);
+      Dup2 (fd, fd + 1);
+      close (fd + 1);
+      close (fd);
+    }
+}
+
+/* Forks NUM_WORKERS workers, waits for all of them and returns
+   the elapsed clock ticks. */
+static int64_t
+run_workers (int num_workers)
+{
+  int pids[MAX_WORKER];
+
+  int64_t start = times ();
+  for (int i = 0; i < num_workers; i++)
+    {
+      pids[i] = Fork ();
+      if (pids[i] == 0)
+        {
+          open_close_worker ();
+          exit (0);
+        }
+    }
+
+  for (int i = 0; i < num_workers; i++)
+    Wait (pids[i]);
+
+  return times () - start;
+}
@@ -0,0 +1,211 @@
+#include <syscall.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Number of records written by each pass of the benchmark. */
+#define NUM_RECORDS 2000
+/* Records gathered by one writev() call in the batched pass. */
+#define BATCH 32
+
+#define HEADER_LEN 8
+#define PAYLOAD_LEN 56
+#define RECORD_LEN (HEADER_LEN + PAYLOAD_LEN)
+
+static char headers[BATCH][HEADER_LEN];
+static char payload[PAYLOAD_LEN];
+
+static int64_t write_records (const char *file_name);
+static int64_t writev_records (const char *file_name);
+static int64_t writev_batched_records (const char *file_name);
+static void make_header (char *header, int record);
+static void compare_files (const char *a, const char *b);
+static void check_pread_after_fork (const char *file_name);
+
+int
+main (void)
+{
+  printf ("writev begin.\n");
+
+  memset (payload, 'x', PAYLOAD_LEN);
+  payload[PAYLOAD_LEN - 1] = '\n';
+
+  int64_t single = write_records ("rec_write");
+  int64_t vectored = writev_records ("rec_writev");
+  int64_t batched = writev_batched_records ("rec_batch");
+
+  printf ("%d records of %d bytes\n", NUM_RECORDS, RECORD_LEN);
+  printf ("write (header, payload): %lld ticks\n", single);
+  printf ("writev per record:       %lld ticks\n", vectored);
+  printf ("writev %d records/call:  %lld ticks\n", BATCH, batched);
+
+  compare_files ("rec_write", "rec_writev");
+  compare_files ("rec_write", "rec_batch");
+  check_pread_after_fork ("rec_write");
+
+  printf ("writev end.\n");
+  return EXIT_SUCCESS;
+}
+
+/* Single-buffer path: each record costs two write() calls. */
+static int64_t
+write_records (const char *file_name)
+{
+  create (file_name, 0);
+  int fd = open (file_name);
+
+  int64_t start = times ();
+  for (int i = 0; i < NUM_RECORDS; i++)
+    {
+      make_header (headers[0], i);
+      write (fd, headers[0], HEADER_LEN);
+      write (fd, payload, PAYLOAD_LEN);
+    }
+  int64_t end = times ();
+
+  close (fd);
+  return end - start;
+}
+
+/* Each record is gathered into a single writev() call. */
+static int64_t
+writev_records (const char *file_name)
+{
+  struct iovec iov[2];
+  create (file_name, 0);
+  int fd = open (file_name);
+
+  int64_t start = times ();
+  for (int i = 0; i < NUM_RECORDS; i++)
+    {
+      make_header (headers[0], i);
+      iov[0].iov_base = headers[0];
+      iov[0].iov_len = HEADER_LEN;
+      iov[1].iov_base = payload;
+      iov[1].iov_len = PAYLOAD_LEN;
+      if (writev (fd, iov, 2) != RECORD_LEN)
+        {
+          printf ("writev: short write at record %d\n", i);
+          exit (-1);
+        }
+    }
+  int64_t end = times ();
+
+  close (fd);
+  return end - start;
+}
+
+/* BATCH records are gathered into each writev() call. */
+static int64_t
+writev_batched_records (const char *file_name)
+{
+  struct iovec iov[BATCH * 2];
+  create (file_name, 0);
+  int fd = open (file_name);
+
+  int64_t start = times ();
+  for (int i = 0; i < NUM_RECORDS; i += BATCH)
+    {
+      int cnt = NUM_RECORDS - i < BATCH ? NUM_RECORDS - i : BATCH;
+      for (int j = 0; j < cnt; j++)
+        {
+          make_header (headers[j], i + j);
+          iov[2 * j].iov_base = headers[j];
+          iov[2 * j].iov_len = HEADER_LEN;
+          iov[2 * j + 1].iov_base = payload;
+          iov[2 * j + 1].iov_len = PAYLOAD_LEN;
+        }
+      if (writev (fd, iov, 2 * cnt) != cnt * RECORD_LEN)
+        {
+          printf ("writev: short write at record %d\n", i);
+          exit (-1);
+        }
+    }
+  int64_t end = times ();
+
+  close (fd);
+  return end - start;
+}
+
+/* Formats the fixed-size header of RECORD. */
+static void
+make_header (char *header, int record)
+{
+  char buf[HEADER_LEN + 1];
+  snprintf (buf, sizeof buf, "r%06d", record);
+  memcpy (header, buf, HEADER_LEN - 1);
+  header[HEADER_LEN - 1] = ' ';
+}
+
+/* Reads both files record by record with readv() and exits
+   if they differ. */
+static void
+compare_files (const char *a, const char *b)
+{
+  char head_a[HEADER_LEN], head_b[HEADER_LEN];
+  char body_a[PAYLOAD_LEN], body_b[PAYLOAD_LEN];
+  struct iovec iov_a[2] = { { head_a, HEADER_LEN }, { body_a, PAYLOAD_LEN } };
+  struct iovec iov_b[2] = { { head_b, HEADER_LEN }, { body_b, PAYLOAD_LEN } };
+  int fd_a = open (a);
+  int fd_b = open (b);
+
+  if (filesize (fd_a) != NUM_RECORDS * RECORD_LEN
+      || filesize (fd_a) != filesize (fd_b))
+    {
+      printf ("%s and %s have different sizes\n", a, b);
+      exit (-1);
+    }
+
+  for (int i = 0; i < NUM_RECORDS; i++)
+    {
+      if (readv (fd_a, iov_a, 2) != RECORD_LEN
+          || readv (fd_b, iov_b, 2) != RECORD_LEN
+          || memcmp (head_a, head_b, HEADER_LEN)
+          || memcmp (body_a, body_b, PAYLOAD_LEN))
+        {
+          printf ("%s and %s differ at record %d\n", a, b, i);
+          exit (-1);
+        }
+    }
+
+  close (fd_a);
+  close (fd_b);
+}
+
+/* Parent and child share one open file after fork() and read
+   disjoint records with pread() without touching the shared
+   position. */
+static void
+check_pread_after_fork (const char *file_name)
+{
+  char header[HEADER_LEN];
+  char expected[HEADER_LEN];
+  int fd = open (file_name);
+
+  int pid = fork ();
+  if (pid < 0)
+    {
+      printf ("fork error.\n");
+      exit (-1);
+    }
+
+  for (int i = pid == 0 ? 0 : 1; i < NUM_RECORDS; i += 2)
+    {
+      make_header (expected, i);
+      if (pread (fd, header, HEADER_LEN, i * RECORD_LEN) != HEADER_LEN
+          || memcmp (header, expected, HEADER_LEN))
+        {
+          printf ("pread: wrong header for record %d\n", i);
+          exit (-1);
+        }
+    }
+
+  if (pid == 0)
+    exit (EXIT_SUCCESS);
+
+  if (wait (pid) != EXIT_SUCCESS || tell (fd) != 0)
+    {
+      printf ("pread: shared position was modified\n");
+      exit (-1);
+    }
+  close (fd);
+}
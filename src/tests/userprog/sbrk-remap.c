@@ -0,0 +1,86 @@
+/* Shrinks and regrows the heap over and over while other
+   processes keep the CPUs busy, so that the process moves
+   between CPUs, and checks that it always sees its current
+   mappings.  A stale TLB entry would show the contents of a
+   freed page instead of a fresh zeroed one, or let the process
+   touch a page after it was unmapped.  Alternates between
+   ranges small enough to invalidate page by page and ranges
+   large enough to flush the whole TLB. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+/* Processes that compete with us for the CPUs. */
+#define WORKERS 3
+/* Ticks for which the workers keep their CPUs busy. */
+#define WORK_TICKS 2000
+/* Shrink and regrow rounds. */
+#define ROUNDS 100
+
+static void check_pages (char *base, int page_cnt, char value);
+
+void
+test_main (void)
+{
+  pid_t workers[WORKERS];
+  int64_t deadline = times () + WORK_TICKS;
+  for (int i = 0; i < WORKERS; i++)
+    {
+      workers[i] = fork ();
+      if (workers[i] == 0)
+        {
+          while (times () < deadline)
+            continue;
+          exit (0);
+        }
+      if (workers[i] < 0)
+        fail ("fork failed");
+    }
+
+  /* Report failures only.  The workers' exit messages go out
+     while we run. */
+  char *base = sbrk (0);
+  for (int round = 0; round < ROUNDS; round++)
+    {
+      int page_cnt = round % 2 ? 40 : 3;
+      intptr_t size = page_cnt * PAGE_SIZE;
+      char value = 'a' + round % 26;
+
+      if (sbrk (size) != base)
+        fail ("round %d: heap did not grow at the old break", round);
+      check_pages (base, page_cnt, 0);
+      for (int i = 0; i < page_cnt; i++)
+        base[i * PAGE_SIZE] = base[i * PAGE_SIZE + PAGE_SIZE - 1] = value;
+      check_pages (base, page_cnt, value);
+      if (sbrk (-size) != base + size)
+        fail ("round %d: heap did not shrink", round);
+      sleep (round % 5);
+    }
+
+  for (int i = 0; i < WORKERS; i++)
+    if (wait (workers[i]) != 0)
+      fail ("worker %d failed", i);
+  msg ("%d rounds done", ROUNDS);
+
+  /* After shrinking, the page is gone on every CPU. */
+  sbrk (PAGE_SIZE);
+  base[0] = 'z';
+  sbrk (-PAGE_SIZE);
+  msg ("touching unmapped heap page");
+  msg ("read '%c' from unmapped heap page", base[0]);
+  fail ("should have exited with -1");
+}
+
+/* Fails unless the first and last byte of each of the PAGE_CNT
+   pages starting at BASE are VALUE. */
+static void
+check_pages (char *base, int page_cnt, char value)
+{
+  for (int i = 0; i < page_cnt; i++)
+    if (base[i * PAGE_SIZE] != value
+        || base[i * PAGE_SIZE + PAGE_SIZE - 1] != value)
+      fail ("page %d holds %d, expected %d",
+            i, base[i * PAGE_SIZE], value);
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_USER_FAULTS => 1, [<<'EOF']);
+(sbrk-remap) begin
+sbrk-remap: exit(0)
+sbrk-remap: exit(0)
+sbrk-remap: exit(0)
+(sbrk-remap) 100 rounds done
+(sbrk-remap) touching unmapped heap page
+sbrk-remap: exit(-1)
+EOF
+pass;
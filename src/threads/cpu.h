@@ -6,6 +6,7 @@
 #include "threads/scheduler.h"
 #include <stdint.h>
 #include "threads/interrupt.h"
+#include "devices/ktimer.h"
 
 #define NCPU_MAX 8      /* Max number of cpus */
 
@@ -32,7 +33,24 @@ struct cpu
   uint64_t user_ticks;
   uint64_t kernel_ticks;
   uint64_t cs;          /* Number of context switches */
+  uint64_t migrations;  /* Threads pulled from other CPUs */
+  unsigned balance_ticks; /* Ticks since the last periodic load balance */
   
+  /* Clock. Owned by timer.c */
+  uint64_t tsc_base;        /* TSC when the clock was started */
+  uint64_t clock_base;      /* Clock time at tsc_base, in ns */
+  bool tick_stopped;        /* Is the timer tick stopped? */
+  uint64_t tick_stop_time;  /* Clock time up to which ticks missed
+                               while stopped are accounted for */
+  uint64_t timer_interrupts; /* Number of timer interrupts taken */
+  int64_t next_event;       /* Tick of the next timer interrupt while
+                               the tick is stopped */
+  struct timer_wheel wheel; /* Pending kernel timers */
+
+  /* Paging. Owned by pagedir.c */
+  uint32_t *pagedir;        /* Page directory loaded in CR3, or null
+                               before the first pagedir_activate() */
+
   /* Ready queue. Owned by scheduler.c */
   struct ready_queue rq;
   
@@ -42,6 +42,7 @@
 #include "tests/threads/tests.h"
 #ifdef SELFTEST
 #include "tests/self/tests.h"
+#include "userprog/pagedir.h"
 #endif /* SELFTEST */
 #endif
 #ifdef FILESYS
@@ -49,6 +50,7 @@
 #include "devices/ide.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
+#include "filesys/cache.h"
 #endif
 #include "lib/kernel/x86.h"
 #include "lib/atomic-ops.h"
@@ -140,6 +142,8 @@ main (void)
   exception_init ();
   syscall_init ();
   pagedir_init ();
+#elif SELFTEST
+  pagedir_init ();
 #endif
 
   serial_init_queue ();
@@ -283,15 +287,18 @@ ap_main (void)
   /* Load IDT (shared among CPUs). */
   intr_load_idt ();
 
+  /* Start this CPU's clock. */
+  timer_init_on_ap ();
+
   printf ("CPU %"PRIu8" is up\n", get_cpu ()->id);
   thread_start_idle_thread ();
 
   /* Signal successful start to BSP. */
-  atomic_xchg (&get_cpu ()->started, 1);
+  atomic_store_release (&get_cpu ()->started, 1);
 
   /* Wait for remaining CPUs to start up */
-  while (!atomic_load (&cpu_started_others))
-    ;
+  while (!atomic_load_acquire (&cpu_started_others))
+    cpu_relax ();
 
   /*
    * Once this AP has finished its initial configuration,
@@ -357,14 +364,14 @@ start_other_cpus (void)
       lapic_start_ap (c->id, vtop (code));
 
       /* wait for cpu to start up */
-      while (!atomic_load (&c->started))
-        ;
+      while (!atomic_load_acquire (&c->started))
+        cpu_relax ();
 
       num_started++;
     }
 
-  atomic_store (&cpu_can_acquire_spinlock, 1);
-  atomic_store (&cpu_started_others, 1);
+  atomic_store_release (&cpu_can_acquire_spinlock, 1);
+  atomic_store_release (&cpu_started_others, 1);
   intr_enable_pop ();
   return num_started;
 }
@@ -428,11 +435,23 @@ parse_options (char **argv)
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
         scratch_bdev_name = value;
+      else if (!strcmp (name, "-dirty-bg"))
+        cache_dirty_background_ratio = atoi (value);
+      else if (!strcmp (name, "-dirty-max"))
+        cache_dirty_ratio = atoi (value);
+      else if (!strcmp (name, "-dirty-expire"))
+        cache_dirty_expire = atoi (value);
+      else if (!strcmp (name, "-wb-interval"))
+        cache_writeback_interval = atoi (value);
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
 #endif
 #endif
+      else if (!strcmp (name, "-periodic-tick"))
+        timer_nohz = false;
+      else if (!strcmp (name, "-no-lock-spin"))
+        lock_spin = false;
       else if (!strcmp (name, "-rs"))
         random_init (atoi (value));
 #ifdef USERPROG
@@ -554,10 +573,16 @@ usage (void)
           "  -f                 Format file system device during startup.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+          "  -dirty-bg=PCT      Start write-behind at PCT%% of cache dirty.\n"
+          "  -dirty-max=PCT     Make writers write back above PCT%% dirty.\n"
+          "  -dirty-expire=TICKS  Write back blocks dirty for TICKS.\n"
+          "  -wb-interval=TICKS Check for expired dirty blocks every TICKS.\n"
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
 #endif
 #endif
+          "  -periodic-tick     Keep the timer tick on idle CPUs.\n"
+          "  -no-lock-spin      Sleep on contended locks without spinning.\n"
           "  -rs=SEED           Set random number seed to SEED.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
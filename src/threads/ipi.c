@@ -10,7 +10,7 @@
 #include "lib/atomic-ops.h"
 #include "threads/mp.h"
 #include "devices/shutdown.h"
-#ifdef USERPROG
+#if defined USERPROG || defined SELFTEST
 #include "userprog/pagedir.h"
 #endif
 
@@ -18,6 +18,7 @@ static void ipi_debug (struct intr_frame *f UNUSED);
 static void ipi_schedule (struct intr_frame *f UNUSED);
 static void ipi_tlbflush (struct intr_frame *f UNUSED);
 static void ipi_shutdown (struct intr_frame *f UNUSED);
+static void ipi_tick (struct intr_frame *f UNUSED);
 
 /* Register interrupt handlers for the inter-processor
    interrupts that we support */
@@ -32,6 +33,8 @@ ipi_init ()
                      "#IPI DEBUG");
   intr_register_ipi (T_IPI + IPI_SCHEDULE, ipi_schedule,
                      "#IPI SCHEDULE");
+  intr_register_ipi (T_IPI + IPI_TICK, ipi_tick,
+                     "#IPI TICK");
 }
 
 /* Received a shutdown signal from another CPU. */
@@ -45,7 +48,7 @@ ipi_shutdown (struct intr_frame *f UNUSED)
 static void
 ipi_tlbflush (struct intr_frame *f UNUSED)
 {
-#ifdef USERPROG
+#if defined USERPROG || defined SELFTEST
   pagedir_handle_tlbflush_request ();
 #endif
 }
@@ -58,6 +61,14 @@ ipi_schedule (struct intr_frame *f UNUSED)
   intr_yield_on_return ();
 }
 
+/* Another CPU added work to this CPU while its tick was
+   stopped. */
+static void
+ipi_tick (struct intr_frame *f UNUSED)
+{
+  thread_update_tick ();
+}
+
 /* For debugging. Prints the backtrace of the thread running on the current CPU  */
 static void
 ipi_debug (struct intr_frame *f UNUSED)
@@ -0,0 +1,183 @@
+#include "threads/rw-lock.h"
+#include <atomic-ops.h>
+#include <debug.h>
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+
+static bool read_trylock (struct rw_lock *);
+static bool write_trylock (struct rw_lock *);
+static void read_lock_release (struct rw_lock *);
+static void write_lock_release (struct rw_lock *);
+
+/* Initializes RW_LOCK, which favors waiting threads according to
+   POLICY when a writer releases it. */
+void
+rw_lock_init (struct rw_lock *rw_lock, enum rw_lock_policy policy)
+{
+  ASSERT (rw_lock != NULL);
+
+  rw_lock->state = 0;
+  rw_lock->writer = NULL;
+  rw_lock->policy = policy;
+  rw_lock->waiting_readers = 0;
+  rw_lock->waiting_writers = 0;
+  rw_lock->readers_turn = false;
+  lock_init (&rw_lock->monitor_lock);
+  cond_init (&rw_lock->can_read);
+  cond_init (&rw_lock->can_write);
+}
+
+/* Adds a reader to RW_LOCK if no writer holds it.
+   Returns true if successful. */
+static bool
+read_trylock (struct rw_lock *rw_lock)
+{
+  int state = atomic_load (&rw_lock->state);
+  while (state >= 0)
+    {
+      int new_state = state + 1;
+      if (atomic_cmpxchg (&rw_lock->state, &state, &new_state))
+        return true;
+    }
+  return false;
+}
+
+/* Makes the current thread the writer of RW_LOCK if nobody holds
+   it.  Returns true if successful. */
+static bool
+write_trylock (struct rw_lock *rw_lock)
+{
+  int unlocked = 0;
+  int locked = -1;
+  if (!atomic_cmpxchg (&rw_lock->state, &unlocked, &locked))
+    return false;
+  rw_lock->writer = thread_current ();
+  return true;
+}
+
+/* Acquires RW_LOCK for reading, sleeping until no writer holds
+   it or waits for it.  Other readers may hold the lock at the
+   same time. */
+void 
+read_lock_acquire (struct rw_lock *rw_lock)
+{
+  ASSERT (!intr_context ());
+  ASSERT (!rw_lock_held_by_current_thread (rw_lock));
+
+  /* Fast path: no writer holds or waits for the lock. */
+  if (read_lock_try_acquire (rw_lock))
+    return;
+
+  lock_acquire (&rw_lock->monitor_lock);
+  rw_lock->waiting_readers++;
+  while ((rw_lock->waiting_writers > 0 && !rw_lock->readers_turn)
+         || !read_trylock (rw_lock))
+    cond_wait (&rw_lock->can_read, &rw_lock->monitor_lock);
+  if (--rw_lock->waiting_readers == 0)
+    rw_lock->readers_turn = false;
+  lock_release (&rw_lock->monitor_lock);
+}
+
+/* Tries to acquire RW_LOCK for reading without sleeping.
+   Fails if a writer holds or waits for the lock.
+   Returns true if successful. */
+bool
+read_lock_try_acquire (struct rw_lock *rw_lock)
+{
+  return (atomic_load (&rw_lock->waiting_writers) == 0
+          && read_trylock (rw_lock));
+}
+
+/* Acquires RW_LOCK for writing, sleeping until no other thread
+   holds it. */
+void 
+write_lock_acquire (struct rw_lock *rw_lock)
+{
+  ASSERT (!intr_context ());
+  ASSERT (!rw_lock_held_by_current_thread (rw_lock));
+
+  /* Fast path: nobody holds the lock. */
+  if (write_trylock (rw_lock))
+    return;
+
+  lock_acquire (&rw_lock->monitor_lock);
+  rw_lock->waiting_writers++;
+  while (rw_lock->readers_turn || !write_trylock (rw_lock))
+    cond_wait (&rw_lock->can_write, &rw_lock->monitor_lock);
+  rw_lock->waiting_writers--;
+  lock_release (&rw_lock->monitor_lock);
+}
+
+/* Tries to acquire RW_LOCK for writing without sleeping.
+   Returns true if successful, false if any thread holds it,
+   including the current thread.  The buffer cache's eviction
+   sweep relies on the latter, because it may pass blocks that
+   the sweeping thread itself holds. */
+bool
+write_lock_try_acquire (struct rw_lock *rw_lock)
+{
+  return write_trylock (rw_lock);
+}
+
+/* Releases RW_LOCK, which the current thread must hold, in
+   whichever mode the current thread acquired it. */
+void
+rw_lock_release (struct rw_lock *rw_lock)
+{
+  if (rw_lock_held_by_current_thread (rw_lock))
+    write_lock_release (rw_lock);
+  else
+    read_lock_release (rw_lock);
+}
+
+/* Returns true if the current thread holds RW_LOCK for writing.
+   (Readers are not tracked, so it is not possible to tell whether
+   the current thread holds it for reading.) */
+bool
+rw_lock_held_by_current_thread (const struct rw_lock *rw_lock)
+{
+  ASSERT (rw_lock != NULL);
+  return rw_lock->writer == thread_current ();
+}
+
+/* Drops a reader from RW_LOCK.  The last reader hands the lock
+   to a waiting writer. */
+static void 
+read_lock_release (struct rw_lock *rw_lock)
+{
+  ASSERT (atomic_load (&rw_lock->state) > 0);
+
+  if (atomic_deci (&rw_lock->state) == 0
+      && atomic_load (&rw_lock->waiting_writers) > 0)
+    {
+      lock_acquire (&rw_lock->monitor_lock);
+      cond_signal (&rw_lock->can_write, &rw_lock->monitor_lock);
+      lock_release (&rw_lock->monitor_lock);
+    }
+}
+
+/* Releases RW_LOCK from its writer and wakes the threads that the
+   lock's policy favors. */
+static void 
+write_lock_release (struct rw_lock *rw_lock)
+{
+  ASSERT (atomic_load (&rw_lock->state) == -1);
+
+  rw_lock->writer = NULL;
+  atomic_store (&rw_lock->state, 0);
+  if (atomic_load (&rw_lock->waiting_readers) == 0
+      && atomic_load (&rw_lock->waiting_writers) == 0)
+    return;
+
+  lock_acquire (&rw_lock->monitor_lock);
+  if (rw_lock->waiting_readers > 0
+      && (rw_lock->policy == RW_LOCK_FAIR || rw_lock->waiting_writers == 0))
+    {
+      /* Let all waiting readers in before the next writer. */
+      rw_lock->readers_turn = true;
+      cond_broadcast (&rw_lock->can_read, &rw_lock->monitor_lock);
+    }
+  else
+    cond_signal (&rw_lock->can_write, &rw_lock->monitor_lock);
+  lock_release (&rw_lock->monitor_lock);
+}
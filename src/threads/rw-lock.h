@@ -0,0 +1,45 @@
+#ifndef THREADS_RW_LOCK_H
+#define THREADS_RW_LOCK_H
+
+#include <stdbool.h>
+#include "threads/synch.h"
+
+/* Which waiting threads a released rw_lock favors. */
+enum rw_lock_policy
+  {
+    RW_LOCK_FAIR,               /* Readers that waited for a writer go
+                                   before the next writer. */
+    RW_LOCK_PREFER_WRITERS      /* Waiting writers always go first. */
+  };
+
+/* Readers-writer lock.
+
+   STATE is updated atomically and is the number of readers
+   holding the lock, or -1 while a writer holds it.  Acquiring
+   and releasing an uncontended lock is a single atomic
+   operation on STATE.  Threads that have to wait do so on the
+   monitor, and a releaser only takes the monitor lock if
+   WAITING_READERS or WAITING_WRITERS is nonzero.  New readers
+   never pass a waiting writer. */
+struct rw_lock
+  {
+    int state;                  /* Readers holding the lock, or -1. */
+    struct thread *writer;      /* Thread holding the lock exclusively. */
+    enum rw_lock_policy policy; /* Who goes first after a writer. */
+    int waiting_readers;        /* Readers waiting on CAN_READ. */
+    int waiting_writers;        /* Writers waiting on CAN_WRITE. */
+    bool readers_turn;          /* Waiting readers go before writers. */
+    struct lock monitor_lock;   /* Monitor lock for waiting threads. */
+    struct condition can_read;  /* Signaled for waiting readers. */
+    struct condition can_write; /* Signaled for waiting writers. */
+  };
+
+void rw_lock_init (struct rw_lock *, enum rw_lock_policy);
+void read_lock_acquire (struct rw_lock *);
+bool read_lock_try_acquire (struct rw_lock *);
+void write_lock_acquire (struct rw_lock *);
+bool write_lock_try_acquire (struct rw_lock *);
+void rw_lock_release (struct rw_lock *);
+bool rw_lock_held_by_current_thread (const struct rw_lock *);
+
+#endif /* threads/rw-lock.h */
@@ -1,8 +1,9 @@
 #include "threads/scheduler.h"
 #include "threads/cpu.h"
 #include "threads/interrupt.h"
-#include "list.h"
+#include "rbtree.h"
 #include "threads/spinlock.h"
+#include <atomic-ops.h>
 #include <debug.h>
 #include "devices/timer.h"
 
@@ -21,9 +22,10 @@ static inline int64_t min (int64_t x, int64_t y) {
 
 static int64_t calc_ideal_runtime(struct ready_queue *, struct thread *);
 static int64_t calc_vruntime(struct thread * t, int64_t bonus); 
+static int64_t charge_curr (struct ready_queue *);
 
 static int64_t queue_total_weight (struct ready_queue *);
-static struct thread *find_thread (struct ready_queue *);
+static rb_less_func vruntime_less;
 
 /* Table used to map a nice value to weight */
 static const uint32_t prio_to_weight[40] =
@@ -39,14 +41,13 @@ static const uint32_t prio_to_weight[40] =
   };
 
 /*
- * In the provided baseline implementation, threads are kept in an unsorted list.
- *
- * Threads are added to the back of the list upon creation.
- * The thread at the front is picked for scheduling.
- * Upon preemption, the current thread is added to the end of the queue
- * (in sched_yield), creating a round-robin policy if multiple threads
- * are in the ready queue.
- * Preemption occurs every TIME_SLICE ticks.
+ * Ready threads are kept in a red-black tree ordered by vruntime,
+ * with ties broken by the lower tid.  The thread to run next is the
+ * tree's leftmost element, which the tree caches, and the total
+ * weight of the ready threads is kept up to date as threads are
+ * added and removed.  Thus picking the next thread and the
+ * computations on every timer tick take constant time, while
+ * adding or removing a thread takes O(log n) time.
  */
 
 /* Called from thread_init () and thread_init_on_ap ().
@@ -58,7 +59,9 @@ static const uint32_t prio_to_weight[40] =
 void
 sched_init (struct ready_queue *curr_rq)
 {
-  list_init (&curr_rq->ready_list);
+  rb_init (&curr_rq->ready_tree, vruntime_less, NULL);
+  curr_rq->nr_ready = 0;
+  curr_rq->ready_weight = 0;
   curr_rq->min_vruntime = 0;
   curr_rq->last_time = 0;
   curr_rq->active = 1;
@@ -79,31 +82,31 @@ sched_init (struct ready_queue *curr_rq)
 enum sched_return_action
 sched_unblock (struct ready_queue *rq_to_add, struct thread *t, int initial UNUSED)
 {
+  /* The running thread's start time was taken on its own CPU's
+     clock, which this CPU's clock may trail, so only that CPU
+     charges it for the time it has run. */
+  bool local = rq_to_add->curr != NULL && rq_to_add == &get_cpu ()->rq;
+
   if (!initial && rq_to_add->curr != NULL)
     {
-      rq_to_add->curr->timer_stop = timer_gettime ();
-      rq_to_add->curr->vruntime = calc_vruntime (rq_to_add->curr, 20);
-      rq_to_add->curr->timer_start = timer_gettime ();
+      if (local)
+        charge_curr (rq_to_add);
       set_min_vruntime (rq_to_add);
       t->vruntime = calc_vruntime (t, 0);
       t->vruntime = max(t->vruntime, rq_to_add->min_vruntime - 20000000);
     }
   else if (initial && rq_to_add->curr != NULL)
     {
-      rq_to_add->curr->timer_stop = timer_gettime ();
-      rq_to_add->curr->vruntime = calc_vruntime (rq_to_add->curr, 20);
-      if (rq_to_add->curr->timer_stop - rq_to_add->curr->timer_start)
+      if (!local || charge_curr (rq_to_add) != 0)
         {
           set_min_vruntime (rq_to_add);
         }
-      rq_to_add->curr->timer_start = timer_gettime ();
       t->vruntime = rq_to_add->min_vruntime ? 
                     rq_to_add->min_vruntime : 
                     rq_to_add->curr->vruntime;
     }
 
-  list_push_back (&rq_to_add->ready_list, &t->elem);
-  rq_to_add->nr_ready++;
+  sched_enqueue (rq_to_add, t);
 
   /* CPU is idle */
   if (!rq_to_add->curr || initial == 0)
@@ -114,25 +117,25 @@ sched_unblock (struct ready_queue *rq_to_add, struct thread *t, int initial UNUS
 }
 
 /* Called from thread_yield ().
-   Current thread is about to yield.  Add it to the ready list
+   Current thread is about to yield.  Add it to the ready queue
 
    Current ready queue is locked upon entry.
  */
 void
 sched_yield (struct ready_queue *curr_rq, struct thread *current)
 {
-  list_push_back (&curr_rq->ready_list, &current->elem);
-  curr_rq->nr_ready ++;
   current->timer_stop = timer_gettime ();
-
   current->vruntime = calc_vruntime(current, 20); 
 
+  /* The tree is ordered by vruntime, so insert only after updating
+     it. */
+  sched_enqueue (curr_rq, current);
 }
 
 
 /* Called from next_thread_to_run ().
-   Find the next thread to run and remove it from the ready list
-   Return NULL if the ready list is empty.
+   Find the next thread to run and remove it from the ready queue
+   Return NULL if the ready queue is empty.
 
    If the thread returned is different from the thread currently
    running, a context switch will take place.
@@ -142,13 +145,13 @@ sched_yield (struct ready_queue *curr_rq, struct thread *current)
 struct thread *
 sched_pick_next (struct ready_queue *curr_rq)
 {
-  if (list_empty (&curr_rq->ready_list))
+  struct rb_elem *e = rb_min (&curr_rq->ready_tree);
+  if (e == NULL)
     return NULL;
 
-  struct thread *ret = find_thread (curr_rq);
-  list_remove (&ret->elem);
+  struct thread *ret = rb_entry (e, struct thread, rq_elem);
+  sched_dequeue (curr_rq, ret);
   ret->timer_start = timer_gettime ();
-  curr_rq->nr_ready--;
   return ret;
 }
 
@@ -190,7 +193,58 @@ sched_block (struct ready_queue *rq UNUSED, struct thread *current UNUSED)
   current->timer_stop = timer_gettime ();
 }
 
-/* Function that sets the min_vruntime */
+/* Adds ready thread T to RQ.  T's vruntime must not change until
+ * it is removed again with sched_dequeue ().
+ */
+void
+sched_enqueue (struct ready_queue *rq, struct thread *t)
+{
+  rb_insert (&rq->ready_tree, &t->rq_elem);
+  rq->nr_ready++;
+  atomic64_store (&rq->ready_weight,
+                  rq->ready_weight + prio_to_weight[t->nice + 20]);
+}
+
+/* Removes ready thread T from RQ. */
+void
+sched_dequeue (struct ready_queue *rq, struct thread *t)
+{
+  rb_remove (&rq->ready_tree, &t->rq_elem);
+  rq->nr_ready--;
+  atomic64_store (&rq->ready_weight,
+                  rq->ready_weight - prio_to_weight[t->nice + 20]);
+}
+
+/* Moves ready thread T from FROM to TO, both of which must be
+ * locked.  T keeps its vruntime relative to the queue's
+ * min_vruntime, so that it neither jumps ahead of the threads on
+ * TO nor falls behind them.
+ */
+void
+sched_migrate (struct ready_queue *from, struct ready_queue *to,
+               struct thread *t)
+{
+  sched_dequeue (from, t);
+  t->vruntime = max (t->vruntime - from->min_vruntime + to->min_vruntime, 0);
+  sched_enqueue (to, t);
+}
+
+/* Returns the load of RQ, which is the weight of its ready
+ * threads plus that of its running thread.  RQ must be locked.
+ */
+int64_t
+sched_load (struct ready_queue *rq)
+{
+  int64_t load = rq->ready_weight;
+  if (rq->curr != NULL)
+    load += prio_to_weight[rq->curr->nice + 20];
+  return load;
+}
+
+/* Function that sets the min_vruntime.
+ * A vruntime of 0 marks a thread that has not run yet and is
+ * skipped, so the result is the smallest nonzero vruntime of
+ * the running and ready threads, or 0 if there is none. */
 void
 set_min_vruntime (struct ready_queue *rq)
 {
@@ -201,68 +255,62 @@ set_min_vruntime (struct ready_queue *rq)
       min_vruntime = min (rq->curr->vruntime, min_vruntime);
     }
 
-  struct thread * t;
-  list_for_each_entry(t, &rq->ready_list.head, elem)  
+  /* Find the leftmost ready thread with a nonzero vruntime.  It
+   * is the cached leftmost thread unless that one is 0, in which
+   * case all ready threads are at 0 or above and the search
+   * descends to the first thread above 0. */
+  struct rb_elem *e = rb_min (&rq->ready_tree);
+  if (e != NULL && rb_entry (e, struct thread, rq_elem)->vruntime == 0)
     {
-      min_vruntime = min (t->vruntime, min_vruntime);
+      struct rb_elem *found = NULL;
+      for (e = rq->ready_tree.root; e != NULL; )
+        if (rb_entry (e, struct thread, rq_elem)->vruntime > 0)
+          {
+            found = e;
+            e = e->left;
+          }
+        else
+          e = e->right;
+      e = found;
     }
+  if (e != NULL)
+    min_vruntime = min (rb_entry (e, struct thread, rq_elem)->vruntime,
+                        min_vruntime);
 
   rq->min_vruntime = min_vruntime == INT64_MAX ? 0 : min_vruntime;
 }
 
 /* Gets the weight of the ready queue, not including the
- * running thread.
+ * running thread.  May be called without holding RQ's lock,
+ * which is why the weight is written atomically: a plain 64-bit
+ * access takes two instructions, so a reader could see half an
+ * update.
  */
 int64_t
 queue_weight (struct ready_queue *rq)
 {
-  int64_t total_weight = 0;
-  struct thread * t;
-  list_for_each_entry(t, &rq->ready_list.head, elem)
-    {
-      total_weight += prio_to_weight[t->nice + 20];
-    }
-  return total_weight;
+  return atomic64_load (&rq->ready_weight);
 }
 
 /* Called from calc_ideal_runtime ().
  * Gets the weight of the ready queue, including the
  * running thread. */
 static int64_t 
-queue_total_weight (struct ready_queue *rq) {   
-    int64_t total_weight = 0;   
-    if (rq->curr != NULL)     
-      {       
-        total_weight += prio_to_weight[rq->curr->nice + 20];     
-      }   
-    struct thread * t;   
-    list_for_each_entry(t, &rq->ready_list.head, elem)     
-      {       
-        total_weight += prio_to_weight[t->nice + 20];     
-      }   
-    return total_weight == 0 ? 1 : total_weight; 
+queue_total_weight (struct ready_queue *rq)
+{
+  int64_t total_weight = sched_load (rq);
+  return total_weight == 0 ? 1 : total_weight; 
 }
-/* Called from sched_pick_next (). 
- * Finds a thread in the ready queue that has the
- * lowest vruntime and lowest tid. */
-static struct thread *
-find_thread (struct ready_queue * rq)
+
+/* Orders ready threads by vruntime, then by tid. */
+static bool
+vruntime_less (const struct rb_elem *a_, const struct rb_elem *b_,
+               void *aux UNUSED)
 {
-  struct thread * t_front = list_entry(
-                                list_front (&rq->ready_list), 
-                                struct thread, 
-                                elem
-                            );
-  struct thread * t;
-  list_for_each_entry(t, &rq->ready_list.head, elem) 
-    {
-      if (t->vruntime < t_front->vruntime ||
-         (t->vruntime == t_front->vruntime && t->tid < t_front->tid)) 
-        {
-          t_front = t;
-        }
-    }
-  return t_front;
+  const struct thread *a = rb_entry (a_, struct thread, rq_elem);
+  const struct thread *b = rb_entry (b_, struct thread, rq_elem);
+  return a->vruntime < b->vruntime
+         || (a->vruntime == b->vruntime && a->tid < b->tid);
 }
 /* Called from sched_unblock () as well as sched_yield ().
  * Calculates the vruntime of a given thread.
@@ -270,10 +318,28 @@ find_thread (struct ready_queue * rq)
 static int64_t calc_vruntime(struct thread * t, int64_t bonus)
 {
   int64_t d = t->timer_stop - t->timer_start;
+  /* Stop and start times taken on different CPUs' clocks can be
+   * out of order, by as much as the clocks differ. */
+  if (d < 0)
+    d = 0;
   int64_t w0 = prio_to_weight[NICE_DEFAULT + bonus];
   int64_t w = prio_to_weight[t->nice + bonus];
   return t->vruntime + d * w0 / w;
 }
+/* Charges RQ's running thread, which must be running on this
+ * CPU, for the time it has run since it was last charged.  Returns
+ * that time.
+ */
+static int64_t
+charge_curr (struct ready_queue *rq)
+{
+  struct thread *curr = rq->curr;
+  curr->timer_stop = timer_gettime ();
+  int64_t d = curr->timer_stop - curr->timer_start;
+  curr->vruntime = calc_vruntime (curr, 20);
+  curr->timer_start = timer_gettime ();
+  return d;
+}
 /* Called from sched_next_tick ().
  * Calculates the ideal runtime of a given thread.
  */
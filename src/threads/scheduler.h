@@ -2,9 +2,13 @@
 #define THREADS_SCHEDULER_H_
 
 #include <stdint.h>
+#include <rbtree.h>
 #include "threads/thread.h"
 #include "threads/synch.h"
 
+/* Weight of a thread at NICE_DEFAULT. */
+#define NICE_DEFAULT_WEIGHT 1024
+
 enum sched_return_action {
   RETURN_NONE,
   RETURN_YIELD,
@@ -35,9 +39,12 @@ struct ready_queue
    * scheduling policy.  You may need to change them in your
    * implementation of project 1. */
   unsigned thread_ticks;      /* Number of ticks since last preemption */
-  struct list ready_list;     /* List of ready threads. */
-  unsigned long nr_ready;     /* number of elements in ready_list.
+  struct rbtree ready_tree;   /* Ready threads, ordered by vruntime
+                                 and then tid. */
+  unsigned long nr_ready;     /* number of elements in ready_tree.
                                  Allows O(1) access. */
+  int64_t ready_weight;       /* Sum of the weights of the threads
+                                 in ready_tree. */
 
   /* OUR CODE */
   int64_t min_vruntime; /* Stores the lowest vruntime of the ready queue. */
@@ -53,6 +60,11 @@ enum sched_return_action sched_tick (struct ready_queue *, struct thread *);
 void sched_block (struct ready_queue *, struct thread *);
 
 /* OUR CODE */
+void sched_enqueue (struct ready_queue *rq, struct thread *t);
+void sched_dequeue (struct ready_queue *rq, struct thread *t);
+void sched_migrate (struct ready_queue *from, struct ready_queue *to,
+                    struct thread *t);
+int64_t sched_load (struct ready_queue *rq);
 int64_t queue_weight (struct ready_queue *rq);
 void set_min_vruntime (struct ready_queue *rq);
 uint32_t get_thread_weight(struct thread* t);
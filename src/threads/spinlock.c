@@ -35,16 +35,144 @@
 #include "threads/cpu.h"
 #include "lib/atomic-ops.h"
 #include "lib/kernel/console.h"
+#include "lib/kernel/x86.h"
 
-static void panic_on_already_acquired_lock (struct callerinfo *info);
-static void panic_on_non_acquired_lock (struct callerinfo *info);
+static void panic_on_already_acquired_lock (struct spinlock *);
+static void panic_on_non_acquired_lock (struct spinlock *);
+
+/* The lock word operations below implement the spinlock chosen
+   by SPINLOCK in Make.config.
+
+   With SPINLOCK_TAS, waiting CPUs spin on an atomic exchange.
+   Each exchange is a locked write that takes the cache line away
+   from the holder and from the other waiters, so the lock gets
+   slower the more CPUs wait for it.
+
+   With SPINLOCK_TTAS, waiting CPUs spin reading the lock, which
+   they can do in their own caches, and only try the exchange
+   once the lock looks free.  Still, every waiter tries at once
+   on release, and an unlucky CPU may lose every time.
+
+   With SPINLOCK_TICKET, a CPU takes a ticket with one atomic
+   add and then spins reading until its number is served.  The
+   lock is granted in the order the tickets were taken, so no
+   CPU waits for more than the CPUs ahead of it, and releasing
+   the lock is a plain store. */
+
+#ifdef SPINLOCK_TICKET
+#define TICKET_SHIFT 16
+#define TICKET_MASK 0xffff
+
+/* Spins until LOCK is acquired. */
+static inline void
+lock_word_acquire (struct spinlock *lock)
+{
+  uint16_t ticket = atomic_fetch_add_explicit (&lock->ticket.tickets.next, 1,
+                                               ATOMIC_RELAXED);
+  while (atomic_load_acquire (&lock->ticket.tickets.owner) != ticket)
+    cpu_relax ();
+}
+
+/* Acquires LOCK if no one holds or waits for it.  Returns true if
+   successful. */
+static inline bool
+lock_word_try_acquire (struct spinlock *lock)
+{
+  uint32_t old = atomic_load_relaxed (&lock->ticket.word);
+  if ((old & TICKET_MASK) != old >> TICKET_SHIFT)
+    return false;
+
+  /* Take the next ticket, which is the one being served.  A carry
+     out of `next' falls off the end of the word. */
+  return atomic_cmpxchg_explicit (&lock->ticket.word, &old,
+                                  old + (1u << TICKET_SHIFT),
+                                  ATOMIC_ACQUIRE, ATOMIC_RELAXED);
+}
+
+/* Releases LOCK by serving the next ticket.  Only the holder
+   writes `owner', so no atomic read-modify-write is needed. */
+static inline void
+lock_word_release (struct spinlock *lock)
+{
+  uint16_t owner = lock->ticket.tickets.owner;
+  atomic_store_release (&lock->ticket.tickets.owner, (uint16_t) (owner + 1));
+}
+
+/* Returns true if some CPU holds LOCK. */
+static inline bool
+lock_word_is_locked (const struct spinlock *lock)
+{
+  uint32_t word = atomic_load_relaxed (&lock->ticket.word);
+  return (word & TICKET_MASK) != word >> TICKET_SHIFT;
+}
+#else /* SPINLOCK_TAS or SPINLOCK_TTAS */
+/* Spins until LOCK is acquired. */
+static inline void
+lock_word_acquire (struct spinlock *lock)
+{
+  /* The xchg is atomic.
+     It also serializes, so that reads after acquire are not
+     reordered before it. */
+  while (atomic_xchg (&lock->locked, 1) != 0)
+    {
+#ifdef SPINLOCK_TTAS
+      while (atomic_load_relaxed (&lock->locked) != 0)
+        cpu_relax ();
+#endif
+    }
+}
+
+/* Acquires LOCK if it is free.  Returns true if successful. */
+static inline bool
+lock_word_try_acquire (struct spinlock *lock)
+{
+#ifdef SPINLOCK_TTAS
+  if (atomic_load_relaxed (&lock->locked) != 0)
+    return false;
+#endif
+  return atomic_xchg (&lock->locked, 1) == 0;
+}
+
+/* Releases LOCK. */
+static inline void
+lock_word_release (struct spinlock *lock)
+{
+#ifdef SPINLOCK_TTAS
+  atomic_store_release (&lock->locked, 0);
+#else
+  /* The xchg serializes, so that reads before release are
+     not reordered after it.  The 1996 PentiumPro manual (Volume 3,
+     7.2) says reads can be carried out speculatively and in
+     any order, which implies we need to serialize here.
+     But the 2007 Intel 64 Architecture Memory Ordering White
+     Paper says that Intel 64 and IA-32 will not move a load
+     after a store. So lock->locked = 0 would work here.
+     The xchg being asm volatile ensures gcc emits it after
+     the above assignments (and after the critical section). */
+  atomic_xchg (&lock->locked, 0);
+#endif
+}
+
+/* Returns true if some CPU holds LOCK. */
+static inline bool
+lock_word_is_locked (const struct spinlock *lock)
+{
+  return lock->locked != 0;
+}
+#endif /* SPINLOCK_TICKET */
 
 void
 spinlock_init (struct spinlock *spinlock)
 {
+#ifdef SPINLOCK_TICKET
+  spinlock->ticket.word = 0;
+#else
   spinlock->locked = 0;
+#endif
   spinlock->cpu = NULL;
+#ifdef LOCK_DEBUG
   debug_init_callerinfo (&spinlock->debuginfo);
+#endif
 }
 
 /* Acquire the spinlock.
@@ -56,17 +184,15 @@ spinlock_acquire (struct spinlock *spinlock)
 {
   intr_disable_push ();     /* disable interrupts to avoid race conditions from interrupts */
   if (spinlock_held_by_current_cpu (spinlock))
-    panic_on_already_acquired_lock (&spinlock->debuginfo);
+    panic_on_already_acquired_lock (spinlock);
 
-  /* The xchg is atomic.
-     It also serializes, so that reads after acquire are not
-     reordered before it. */
-  while (atomic_xchg (&spinlock->locked, 1) != 0)
-    ;
+  lock_word_acquire (spinlock);
 
   /* Record info about lock acquisition for debugging. */
   spinlock->cpu = get_cpu ();
+#ifdef LOCK_DEBUG
   debug_save_callerinfo (&spinlock->debuginfo);
+#endif
 }
 
 /* Release the lock. */
@@ -74,21 +200,14 @@ void
 spinlock_release (struct spinlock *spinlock)
 {
   if (!spinlock_held_by_current_cpu (spinlock))
-    panic_on_non_acquired_lock (&spinlock->debuginfo);
+    panic_on_non_acquired_lock (spinlock);
 
   spinlock->cpu = NULL;
+#ifdef LOCK_DEBUG
   debug_save_callerinfo (&spinlock->debuginfo);
+#endif
 
-  /* The xchg serializes, so that reads before release are
-     not reordered after it.  The 1996 PentiumPro manual (Volume 3,
-     7.2) says reads can be carried out speculatively and in
-     any order, which implies we need to serialize here.
-     But the 2007 Intel 64 Architecture Memory Ordering White
-     Paper says that Intel 64 and IA-32 will not move a load
-     after a store. So lock->locked = 0 would work here.
-     The xchg being asm volatile ensures gcc emits it after
-     the above assignments (and after the critical section). */
-  atomic_xchg (&spinlock->locked, 0);
+  lock_word_release (spinlock);
 
   intr_enable_pop ();
 }
@@ -98,9 +217,9 @@ spinlock_try_acquire (struct spinlock *spinlock)
 {
   intr_disable_push ();     /* disable interrupts to avoid race conditions from interrupts */
   if (spinlock_held_by_current_cpu (spinlock))
-    panic_on_already_acquired_lock (&spinlock->debuginfo);
+    panic_on_already_acquired_lock (spinlock);
 
-  if (atomic_xchg (&spinlock->locked, 1) != 0)
+  if (!lock_word_try_acquire (spinlock))
     {
       intr_enable_pop ();
       return false;
@@ -108,7 +227,9 @@ spinlock_try_acquire (struct spinlock *spinlock)
   else
     {
       spinlock->cpu = get_cpu ();
+#ifdef LOCK_DEBUG
       debug_save_callerinfo (&spinlock->debuginfo);
+#endif
       return true;
     }
 }
@@ -117,27 +238,35 @@ spinlock_try_acquire (struct spinlock *spinlock)
 bool
 spinlock_held_by_current_cpu (const struct spinlock *lock)
 {
-  return lock->locked && lock->cpu == get_cpu ();
+  return lock_word_is_locked (lock) && lock->cpu == get_cpu ();
 }
 
 static void
-panic_on_already_acquired_lock (struct callerinfo *info)
+panic_on_already_acquired_lock (struct spinlock *lock UNUSED)
 {
   console_set_mode (EMERGENCY_MODE);
   printf ("ERROR: Tried to acquire an already held spinlock!\n");
+#ifdef LOCK_DEBUG
   printf ("Lock last acquired by: ");
-  debug_print_callerinfo (info);
+  debug_print_callerinfo (&lock->debuginfo);
   printf ("\n");
+#else
+  printf ("Build with LOCK_DEBUG=1 to see who acquired it.\n");
+#endif
   PANIC ("acquire");
 }
 
 static void
-panic_on_non_acquired_lock (struct callerinfo *info)
+panic_on_non_acquired_lock (struct spinlock *lock UNUSED)
 {
   console_set_mode (EMERGENCY_MODE);
   printf ("ERROR: Tried to release an unacquired spinlock!\n");
+#ifdef LOCK_DEBUG
   printf ("Lock last released by: ");
-  debug_print_callerinfo (info);
+  debug_print_callerinfo (&lock->debuginfo);
   printf ("\n");
+#else
+  printf ("Build with LOCK_DEBUG=1 to see who released it.\n");
+#endif
   PANIC ("release");
 }
@@ -3,19 +3,37 @@
 
 #include <debug.h>
 #include <stdbool.h>
+#include <stdint.h>
 
-/* A spinlock. */
+/* A spinlock.
+
+   The implementation is chosen at build time by SPINLOCK in
+   Make.config; see spinlock.c. */
 struct spinlock
 {
+#ifdef SPINLOCK_TICKET
+  union
+    {
+      uint32_t word;            /* Both tickets, for try-acquire. */
+      struct
+        {
+          uint16_t owner;       /* Ticket being served. */
+          uint16_t next;        /* Next ticket to hand out. */
+        } tickets;
+    } ticket;
+#else
   int locked;           /* Is the lock held? */
+#endif
   struct cpu *cpu;      /* CPU that acquired the lock, or NULL 
                            if spinlock is not held */
-  
+
+#ifdef LOCK_DEBUG
   /* For debugging. If the lock is held, then debuginfo
      contains the call stack of the thread when the lock
      was acquired. If lock is not held, contains the
      call stack of the last thread that released the lock */
   struct callerinfo debuginfo;
+#endif
 };
 
 void spinlock_acquire (struct spinlock *);
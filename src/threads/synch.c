@@ -32,9 +32,22 @@
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "lib/kernel/console.h"
+#include "lib/kernel/x86.h"
+#include <atomic-ops.h>
 
-static void panic_on_already_acquired_lock (struct callerinfo *info);
-static void panic_on_non_acquired_lock (struct callerinfo *info);
+/* Times to check whether a lock's holder is still running before
+   going to sleep. */
+#define LOCK_SPIN_MAX 10000
+
+/* Spin while a lock's holder is running?  If false, contended
+   locks always sleep. */
+bool lock_spin = true;
+
+static bool lock_try_take (struct lock *, struct thread *);
+static bool lock_spin_on_holder (struct lock *, struct thread *);
+static void lock_sleep (struct lock *, struct thread *);
+static void panic_on_already_acquired_lock (struct lock *);
+static void panic_on_non_acquired_lock (struct lock *);
 
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
@@ -165,24 +178,43 @@ sema_test_helper (void *sema_)
    is, it is an error for the thread currently holding a lock to
    try to acquire that lock.
 
-   A lock is a specialization of a semaphore with an initial
-   value of 1.  The difference between a lock and such a
-   semaphore is twofold.  First, a semaphore can have a value
-   greater than 1, but a lock can only be owned by a single
-   thread at a time.  Second, a semaphore does not have an owner,
-   meaning that one thread can "down" the semaphore and then
-   another one "up" it, but with a lock the same thread must both
-   acquire and release it.  When these restrictions prove
-   onerous, it's a good sign that a semaphore should be used,
-   instead of a lock. */
+   A lock is like a semaphore with an initial value of 1.  The
+   difference between a lock and such a semaphore is twofold.
+   First, a semaphore can have a value greater than 1, but a lock
+   can only be owned by a single thread at a time.  Second, a
+   semaphore does not have an owner, meaning that one thread can
+   "down" the semaphore and then another one "up" it, but with a
+   lock the same thread must both acquire and release it.  When
+   these restrictions prove onerous, it's a good sign that a
+   semaphore should be used, instead of a lock.
+
+   Locks are adaptive.  Most critical sections are short, so a
+   thread that finds the lock held by a thread running on another
+   CPU spins for a while, expecting the lock to be released soon,
+   instead of paying for two context switches.  It goes to sleep
+   only if the holder is not running or does not release the lock
+   within LOCK_SPIN_MAX iterations.
+
+   A thread woken up by lock_release() must compete for the lock
+   with threads that just arrived and are spinning or running,
+   which usually win, since they are already on a CPU.  That keeps
+   the lock busy, but it could starve the sleeper.  So a woken
+   thread that loses puts the lock into handoff mode, in which the
+   next lock_release() passes the lock directly to the first
+   sleeper. */
 void
 lock_init (struct lock *lock)
 {
   ASSERT (lock != NULL);
 
   lock->holder = NULL;
-  sema_init (&lock->semaphore, 1);
+  spinlock_init (&lock->wait_lock);
+  list_init (&lock->waiters);
+  lock->waiter_cnt = 0;
+  lock->handoff = false;
+#ifdef LOCK_DEBUG
   debug_init_callerinfo (&lock->debuginfo);
+#endif
 }
 
 /* Acquires LOCK, sleeping until it becomes available if
@@ -200,11 +232,14 @@ lock_acquire (struct lock *lock)
   ASSERT (!intr_context ());
 
   if (lock_held_by_current_thread (lock))
-    panic_on_already_acquired_lock (&lock->debuginfo);
+    panic_on_already_acquired_lock (lock);
 
-  sema_down (&lock->semaphore);
-  lock->holder = thread_current ();
+  struct thread *cur = thread_current ();
+  if (!lock_try_take (lock, cur) && !lock_spin_on_holder (lock, cur))
+    lock_sleep (lock, cur);
+#ifdef LOCK_DEBUG
   debug_save_callerinfo (&lock->debuginfo);
+#endif
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -216,19 +251,16 @@ lock_acquire (struct lock *lock)
 bool
 lock_try_acquire (struct lock *lock)
 {
-  bool success;
-
   ASSERT (lock != NULL);
   if (lock_held_by_current_thread (lock))
-    panic_on_already_acquired_lock (&lock->debuginfo);
+    panic_on_already_acquired_lock (lock);
 
-  success = sema_try_down (&lock->semaphore);
-  if (success) 
-    {    
-      lock->holder = thread_current ();
-      debug_save_callerinfo (&lock->debuginfo);
-    }
-  return success;
+  if (!lock_try_take (lock, thread_current ()))
+    return false;
+#ifdef LOCK_DEBUG
+  debug_save_callerinfo (&lock->debuginfo);
+#endif
+  return true;
 }
 
 /* Releases LOCK, which must be owned by the current thread.
@@ -241,11 +273,50 @@ lock_release (struct lock *lock)
 {
   ASSERT (lock != NULL);
   if (!lock_held_by_current_thread (lock))
-    panic_on_non_acquired_lock (&lock->debuginfo);
+    panic_on_non_acquired_lock (lock);
 
-  lock->holder = NULL;
+#ifdef LOCK_DEBUG
   debug_save_callerinfo (&lock->debuginfo);
-  sema_up (&lock->semaphore);
+#endif
+
+  if (!atomic_load_relaxed (&lock->handoff))
+    {
+      /* Free the lock, then wake up a sleeper, if there is one, to
+         compete for it.  A thread going to sleep first counts
+         itself in `waiter_cnt' and then tries to take the lock
+         once more, so either it sees the lock free or we see it
+         counted. */
+      atomic_store_explicit (&lock->holder, NULL, ATOMIC_SEQ_CST);
+      if (atomic_load_explicit (&lock->waiter_cnt, ATOMIC_SEQ_CST) != 0)
+        {
+          spinlock_acquire (&lock->wait_lock);
+          if (!list_empty (&lock->waiters))
+            thread_unblock (list_entry (list_pop_front (&lock->waiters),
+                                        struct thread, elem));
+          spinlock_release (&lock->wait_lock);
+        }
+    }
+  else
+    {
+      /* Pass the lock to the first sleeper.  Only sleepers set
+         `handoff', so there is one unless it took the lock
+         itself meanwhile. */
+      spinlock_acquire (&lock->wait_lock);
+      lock->handoff = false;
+      if (!list_empty (&lock->waiters))
+        {
+          struct thread *t = list_entry (list_pop_front (&lock->waiters),
+                                         struct thread, elem);
+          atomic_store_release (&lock->holder, t);
+          thread_unblock (t);
+        }
+      else
+        atomic_store_explicit (&lock->holder, NULL, ATOMIC_SEQ_CST);
+      spinlock_release (&lock->wait_lock);
+    }
+
+  /* Preempt the current CPU if the scheduler requested it. */
+  intr_yield_if_requested ();
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -256,9 +327,81 @@ lock_held_by_current_thread (const struct lock *lock)
 {
   ASSERT (lock != NULL);
 
-  return lock->holder == thread_current ();
+  return atomic_load_relaxed (&lock->holder) == thread_current ();
 }
-
+
+/* Makes CUR the holder of LOCK if LOCK is free.  Returns true if
+   successful. */
+static bool
+lock_try_take (struct lock *lock, struct thread *cur)
+{
+  struct thread *holder = NULL;
+  return atomic_cmpxchg_explicit (&lock->holder, &holder, cur,
+                                  ATOMIC_SEQ_CST, ATOMIC_RELAXED);
+}
+
+/* Spins, trying to take LOCK for CUR, as long as LOCK's holder
+   is running on another CPU, up to LOCK_SPIN_MAX times.  Returns
+   true if successful, false if CUR should go to sleep.
+
+   The holder's struct thread is read without synchronization.
+   The holder cannot exit while it holds the lock, and if it
+   released the lock and exited meanwhile, its page is at worst
+   reused, so we only misjudge whether to keep spinning. */
+static bool
+lock_spin_on_holder (struct lock *lock, struct thread *cur)
+{
+  if (!lock_spin)
+    return false;
+
+  for (int i = 0; i < LOCK_SPIN_MAX; i++)
+    {
+      struct thread *holder = atomic_load_relaxed (&lock->holder);
+      if (holder == NULL)
+        {
+          if (lock_try_take (lock, cur))
+            return true;
+        }
+      else if (atomic_load_relaxed (&lock->handoff)
+               || atomic_load_relaxed (&holder->status) != THREAD_RUNNING)
+        return false;
+      cpu_relax ();
+    }
+  return false;
+}
+
+/* Sleeps until CUR has taken LOCK. */
+static void
+lock_sleep (struct lock *lock, struct thread *cur)
+{
+  bool woken = false;
+
+  spinlock_acquire (&lock->wait_lock);
+  atomic_fetch_add_explicit (&lock->waiter_cnt, 1, ATOMIC_SEQ_CST);
+  for (;;)
+    {
+      /* Either lock_release() handed LOCK to us, or we have to
+         take it ourselves. */
+      if (atomic_load_relaxed (&lock->holder) == cur
+          || lock_try_take (lock, cur))
+        break;
+
+      /* A woken thread that lost the lock goes back to the front
+         of the queue, and asks for the lock to be handed to it. */
+      if (woken)
+        {
+          lock->handoff = true;
+          list_push_front (&lock->waiters, &cur->elem);
+        }
+      else
+        list_push_back (&lock->waiters, &cur->elem);
+      thread_block (&lock->wait_lock);
+      woken = true;
+    }
+  atomic_fetch_sub_explicit (&lock->waiter_cnt, 1, ATOMIC_RELAXED);
+  spinlock_release (&lock->wait_lock);
+}
+
 /* One semaphore in a list. */
 struct semaphore_elem 
   {
@@ -353,25 +496,33 @@ cond_broadcast (struct condition *cond, struct lock *lock)
 /* Print error message and panic if an attempt is made to acquire an
  * already held lock. */
 static void
-panic_on_already_acquired_lock (struct callerinfo *info)
+panic_on_already_acquired_lock (struct lock *lock UNUSED)
 {
   console_set_mode (EMERGENCY_MODE);
   printf ("ERROR: Tried to acquire an already held lock!\n");
+#ifdef LOCK_DEBUG
   printf ("Lock last acquired by: ");
-  debug_print_callerinfo (info);
+  debug_print_callerinfo (&lock->debuginfo);
   printf ("\n");
+#else
+  printf ("Build with LOCK_DEBUG=1 to see who acquired it.\n");
+#endif
   PANIC("acquire");
 }
 
 /* Print error message and panic if an attempt is made to release a
  * lock that is not held. */
 static void
-panic_on_non_acquired_lock (struct callerinfo *info)
+panic_on_non_acquired_lock (struct lock *lock UNUSED)
 {
   console_set_mode (EMERGENCY_MODE);
   printf ("ERROR: Tried to release an unacquired lock!\n");
+#ifdef LOCK_DEBUG
   printf ("Lock last released by: ");
-  debug_print_callerinfo (info);
+  debug_print_callerinfo (&lock->debuginfo);
   printf ("\n");
+#else
+  printf ("Build with LOCK_DEBUG=1 to see who released it.\n");
+#endif
   PANIC("release");
 }
@@ -23,11 +23,18 @@ void sema_self_test (void);
 /* Lock. */
 struct lock 
   {
-    struct thread *holder;      /* Thread holding lock (for debugging). */
-    struct semaphore semaphore; /* Binary semaphore controlling access. */
+    struct thread *holder;      /* Thread holding lock, or null. */
+    struct spinlock wait_lock;  /* Protects `waiters' and `handoff'. */
+    struct list waiters;        /* Threads sleeping on the lock. */
+    int waiter_cnt;             /* Threads sleeping or about to. */
+    bool handoff;               /* Pass lock to the first sleeper? */
+#ifdef LOCK_DEBUG
     struct callerinfo debuginfo;/* Debugging info. */
+#endif
   };
 
+extern bool lock_spin;
+
 void lock_init (struct lock *);
 void lock_acquire (struct lock *);
 bool lock_try_acquire (struct lock *);
@@ -20,17 +20,26 @@
 #include "threads/cpu.h"
 #include "threads/mp.h"
 #include "devices/lapic.h"
+#include "devices/timer.h"
 #include "lib/kernel/x86.h"
 #include <atomic-ops.h>
 #include "lib/kernel/bitmap.h"
 #include "threads/ipi.h"
 #include "filesys/directory.h"
+#include "userprog/fd-table.h"
 
 /* Random value for struct thread's `magic' member.
    Used to detect stack overflow.  See the big comment at the top
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
+/* Timer ticks between periodic load balancing on each CPU. */
+#define BALANCE_INTERVAL 10
+
+/* Threads that stopped running less than this many ns ago are
+   cache-hot and are not migrated to another CPU. */
+#define MIGRATION_COST 500000
+
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
 static struct list all_list;
@@ -60,6 +69,12 @@ static void init_boot_thread (struct thread *boot_thread, struct cpu *cpu);
 static void init_thread (struct thread *t, const char *name, int nice);
 static void lock_own_ready_queue (void);
 static void unlock_own_ready_queue (void);
+static bool balance_load (void);
+static int64_t estimate_load (struct cpu *);
+static void account_ticks (struct cpu *, struct thread *, uint64_t cnt);
+static void update_tick (struct thread *cur, struct thread *next);
+static void notify_cpu (struct cpu *);
+static void kick_idle_cpu (void);
 
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
@@ -126,19 +141,13 @@ thread_tick (void)
 {
   ASSERT (intr_get_level () == INTR_OFF);
   struct thread *t = thread_current ();
+  struct cpu *c = get_cpu ();
 
   /* Update statistics. */
-  if (t == get_cpu ()->rq.idle_thread)
-    get_cpu ()->idle_ticks++;
-#ifdef USERPROG
-  else if (t->pagedir != NULL)
-    get_cpu ()->user_ticks++;
-#endif
-  else
-    get_cpu ()->kernel_ticks++;
+  account_ticks (c, t, 1);
 
   lock_own_ready_queue ();
-  enum sched_return_action ret_action = sched_tick (&get_cpu ()->rq, t);
+  enum sched_return_action ret_action = sched_tick (&c->rq, t);
   if (ret_action == RETURN_YIELD)
     {
       /* We are processing an external interrupt, so we cannot yield
@@ -146,7 +155,47 @@ thread_tick (void)
          interrupt. */
       intr_yield_on_return ();
     }
+  else
+    update_tick (t, t);
   unlock_own_ready_queue ();
+
+  /* Periodically pull work from busier CPUs.  If this CPU was
+     idle, run what it pulled right away.  If it has work to
+     spare, wake up an idle CPU whose tick is stopped, since that
+     CPU would not otherwise come looking for it. */
+  if (++c->balance_ticks >= BALANCE_INTERVAL)
+    {
+      c->balance_ticks = 0;
+      if (balance_load () && t == c->rq.idle_thread)
+        intr_yield_on_return ();
+      if (atomic_load_relaxed (&c->rq.nr_ready) > 0)
+        kick_idle_cpu ();
+    }
+}
+
+/* Called when another CPU added threads to this CPU's ready queue
+   while its tick was stopped.  Restarts the tick if the running
+   thread may now have to be preempted.  An idle CPU runs the new
+   threads anyway once the interrupt returns to its idle loop. */
+void
+thread_update_tick (void)
+{
+  struct thread *t = thread_current ();
+
+  lock_own_ready_queue ();
+  update_tick (t, t);
+  unlock_own_ready_queue ();
+}
+
+/* Returns the number of ticks CPU C has spent idle, including
+   ticks it missed while idle with its tick stopped. */
+uint64_t
+thread_idle_ticks (const struct cpu *c)
+{
+  uint64_t idle_ticks = c->idle_ticks;
+  if (c->rq.curr == NULL)
+    idle_ticks += timer_missed_ticks (c);
+  return idle_ticks;
 }
 
 /* Prints thread statistics. */
@@ -157,21 +206,34 @@ thread_print_stats (void)
   for (c = cpus; c < cpus + ncpu; c++)
     {
       printf (
-          "CPU%d: %llu idle ticks, %llu kernel ticks, %llu user ticks, %llu context switches\n",
-          c->id, c->idle_ticks, c->kernel_ticks, c->user_ticks, c->cs);
+          "CPU%d: %llu idle ticks, %llu kernel ticks, %llu user ticks, %llu context switches, %llu migrations\n",
+          c->id, thread_idle_ticks (c), c->kernel_ticks, c->user_ticks, c->cs,
+          c->migrations);
     }
 }
 
-/* The default policy for choosing to which CPU to assign a
- * new thread is a round-robin policy.
+/* A new thread is assigned to the least loaded CPU.  Equally
+ * loaded CPUs are chosen round-robin.
  */
 static struct cpu *
 choose_cpu_for_new_thread (struct thread *t)
 {
-  if (atomic_load (&cpu_started_others))
-    return &cpus[t->tid % ncpu];
-  else
+  if (!atomic_load_acquire (&cpu_started_others))
     return &cpus[0];
+
+  struct cpu *best = NULL;
+  int64_t best_load = 0;
+  for (unsigned int i = 0; i < ncpu; i++)
+    {
+      struct cpu *c = &cpus[(t->tid + i) % ncpu];
+      int64_t load = estimate_load (c);
+      if (best == NULL || load < best_load)
+        {
+          best = c;
+          best_load = load;
+        }
+    }
+  return best;
 }
 
 static void
@@ -181,6 +243,7 @@ wake_up_new_thread (struct thread *t)
   t->cpu = choose_cpu_for_new_thread (t);
   spinlock_acquire (&t->cpu->rq.lock);
   sched_unblock (&t->cpu->rq, t, 1);
+  notify_cpu (t->cpu);
   spinlock_release (&t->cpu->rq.lock);
 }
 
@@ -243,7 +306,8 @@ tid_t
 thread_create (const char *name, int nice, thread_func *function, void *aux)
 {
   struct maternal_bond *bond = NULL;
-  struct file **fd_table = NULL;
+  struct fd_table *fd_table = NULL;
+  struct thread *parent = thread_current ();
 
   /* Allocate memory for bond,
      which will be used for sharing data between
@@ -252,10 +316,18 @@ thread_create (const char *name, int nice, thread_func *function, void *aux)
   if (bond == NULL)
     goto thread_create_err;
 
-  /* Allocate memory for file descriptor table,
-     which keep track of all the open files that 
-     are associate with each process. */
-  fd_table = palloc_get_page (PAL_ZERO);
+  /* Allocate file descriptor table, which keep track of all the
+     open files that are associate with each process.
+     Copy the parent's file descriptor table.
+     Note that underlying file offset is shared between parent and child. */
+  if (parent->fd_table)
+    fd_table = fd_table_copy (parent->fd_table);
+  /* Otherwise, initialize fd 0 as STDIN and fd 1 as STDOUT. */
+  else if ((fd_table = fd_table_create ()) != NULL)
+    {
+      fd_table_install_at (fd_table, 0, file_open_console (STDIN));
+      fd_table_install_at (fd_table, 1, file_open_console (STDOUT));
+    }
   if (fd_table == NULL)
     goto thread_create_err;
 
@@ -274,27 +346,13 @@ thread_create (const char *name, int nice, thread_func *function, void *aux)
   spinlock_init (&bond->lock);
 
   t->bond = bond;
-  struct thread *parent = thread_current ();
   list_push_front (&parent->children, &t->bond->elem);
 
   /* Inherit parent's current directory. */
   if (parent->current_dir)
     t->current_dir = dir_reopen (parent->current_dir);
 
-  /* Copy the parent's file descriptor table.
-     Note that underlying file offset is shared between parent and child. */
   t->fd_table = fd_table;
-  if (parent->fd_table)
-    {
-      for (int i = 0; i < FD_MAX; i++)
-        t->fd_table[i] = file_dup (parent->fd_table[i]);
-    }
-  /* Otherwise, initialize fd 0 as STDIN and fd 1 as STDOUT. */
-  else
-    {
-      t->fd_table[0] = file_open_console (STDIN); 
-      t->fd_table[1] = file_open_console (STDOUT); 
-    }
 
   /* Copy the parent's executable file. */
   t->exec_file = file_dup (parent->exec_file);
@@ -309,8 +367,7 @@ thread_create (const char *name, int nice, thread_func *function, void *aux)
 thread_create_err:
   if (bond)
     free (bond);
-  if (fd_table)
-    palloc_free_page (fd_table);
+  fd_table_destroy (fd_table);
   return TID_ERROR; 
 }
 
@@ -376,6 +433,8 @@ thread_unblock (struct thread *t)
            responsible for running thread t to preempt. */
         lapic_send_ipi_to(IPI_SCHEDULE, t->cpu->id);
     }
+  else
+    notify_cpu (t->cpu);
   spinlock_release (&t->cpu->rq.lock);
 }
 
@@ -521,121 +580,106 @@ thread_get_nice (void)
   return thread_current ()->nice;
 }
 
-/* Balances CPU load. Finds the CPU with the largest CPU load
- * and checks if the imbalance is great enough. If it is
- * threads are stolen until the imbalance is equalized.
+/* Returns an estimate of C's load, read without locking its
+ * ready queue.  The running thread, whose weight cannot be looked
+ * up safely without the lock, counts as a thread at NICE_DEFAULT.
  */
-static void
+static int64_t
+estimate_load (struct cpu *c)
+{
+  return queue_weight (&c->rq)
+         + (atomic_load_relaxed (&c->rq.curr) != NULL
+            ? NICE_DEFAULT_WEIGHT : 0);
+}
+
+/* Returns true if thread T ran recently enough on its CPU, as of
+ * NOW, that its cache state is likely still there.  NOW comes from
+ * this CPU's clock and T's stop time from its own CPU's, so the
+ * difference may be off by the skew between the two, or even
+ * negative.  Either way it errs towards leaving T where it is.
+ */
+static bool
+is_cache_hot (struct thread *t, int64_t now)
+{
+  return t->timer_stop != 0 && now - t->timer_stop < MIGRATION_COST;
+}
+
+/* Balances CPU load by pulling ready threads to this CPU from the
+ * busiest other CPU, if that one's load exceeds ours by more than
+ * a quarter.  Threads are pulled, starting with those that would
+ * run last, until the loads are about even.  Threads that are
+ * cache-hot, or whose weight would just move the imbalance to the
+ * other side, stay where they are.
+ *
+ * Only this CPU's and the victim's ready queues are locked, in
+ * CPU index order, so that two CPUs balancing against each other
+ * cannot deadlock.  Must be called with interrupts off and without
+ * holding this CPU's ready queue lock.  Returns true if any thread
+ * was pulled.
+ */
+static bool
 balance_load (void)
 {
-  struct cpu* self = get_cpu ();
-  struct cpu* max = NULL;
-  int64_t maxLoad = 0;
-  int64_t currLoad;
+  struct cpu *self = get_cpu ();
+  struct cpu *busiest = NULL;
+  int64_t busiest_load = 0;
+
+  ASSERT (intr_get_level () == INTR_OFF);
   if (!self->rq.active)
-    return;
-  
-  /* Searching for the CPU with the largest load */
-  for (unsigned int index = 0; index < ncpu; index++)
-  {
-    /* When this cpu is reached in the cpu array it's ready
-     * queue is grabbed here. This is done because it's ready queue
-     * must be grabbed at some point before adding stolen threads
-     * to it, and grabbing it here avoids possible deadlocks.
-     */
-    if (!cpus[index].rq.active)
-      continue;
-
-    if (cpus[index].id == self->id)
-    { 
-       spinlock_acquire(&self->rq.lock);
-       /* Can't steal from own queue so continue. */
-       continue;
-    }
-    
-    /* Must aquire the queue lock before checking its load. */
-    spinlock_acquire (&cpus[index].rq.lock);
-    currLoad = queue_weight(&cpus[index].rq);
-    if (currLoad > maxLoad)
+    return false;
+
+  /* Pick the victim from unlocked estimates. */
+  for (struct cpu *c = cpus; c < cpus + ncpu; c++)
     {
-      /* This thread is the largets found so far so save it and release
-       * the previous max cpu's lock.
-       */
-      if (max != NULL)
-        spinlock_release (&max->rq.lock);
-      max = &cpus[index];
-      maxLoad = currLoad;
+      if (c == self || !atomic_load_relaxed (&c->rq.active)
+          || atomic_load_relaxed (&c->rq.nr_ready) == 0)
+        continue;
+      int64_t load = estimate_load (c);
+      if (load > busiest_load)
+        {
+          busiest = c;
+          busiest_load = load;
+        }
     }
-    else
-      /* The queue lock is only released when it's not the max.
-       * This is done because the max thread's queue lock
-       * must be held to prevent another thread from stealing from
-       * it before this thread can.
-       */
-      spinlock_release (&cpus[index].rq.lock);
-  }
-  
-  /* Time to do some thieving */
-  if (max != NULL)
-  {
-    int64_t myLoad = queue_weight(&self->rq);
-    /* This is derived from the imbalance and check to find if load balancing
-     * should occur. (When maxLoad is solved for this inequality is found).
-     */
-    if (maxLoad >= 2 * myLoad)
+  if (busiest == NULL || busiest_load * 4 <= estimate_load (self) * 5)
+    return false;
+
+  struct cpu *first = self < busiest ? self : busiest;
+  struct cpu *second = self < busiest ? busiest : self;
+  spinlock_acquire (&first->rq.lock);
+  spinlock_acquire (&second->rq.lock);
+
+  int pulled = 0;
+  int64_t self_load = sched_load (&self->rq);
+  busiest_load = sched_load (&busiest->rq);
+  if (busiest_load * 4 > self_load * 5)
     {
-      int64_t imbalance = (maxLoad - myLoad) / 2;
-      int64_t stolenWeight = 0;
-      bool front = true;
-      struct thread* stolen;
-      
-      /* This value is used to set the stolen queue's vruntime to be relative to
-       * this threads run queue.
-       */
-      int64_t minVruntimeDiff = self->rq.min_vruntime - max->rq.min_vruntime;
-      
-      /* This is done to steal from the front and back of the victim ready queue, to
-       * steal a good mix of high and low weighted threads and avoid stealing
-       * only high or only low weight queues.
-       */
-      while (stolenWeight < imbalance)
-      {
-        if (front)
+      int64_t imbalance = (busiest_load - self_load) / 2;
+      int64_t now = timer_gettime ();
+      struct rb_elem *e = rb_max (&busiest->rq.ready_tree);
+      while (e != NULL && imbalance > 0)
         {
-          stolen = list_entry(list_pop_front(&max->rq.ready_list), struct thread, elem); 
-          front = false;
+          struct thread *t = rb_entry (e, struct thread, rq_elem);
+          int64_t weight = get_thread_weight (t);
+          e = rb_prev (e);
+
+          if (weight >= 2 * imbalance || is_cache_hot (t, now))
+            continue;
+          sched_migrate (&busiest->rq, &self->rq, t);
+          t->cpu = self;
+          imbalance -= weight;
+          pulled++;
         }
-        else
+      if (pulled > 0)
         {
-          stolen = list_entry(list_pop_back(&max->rq.ready_list), struct thread, elem);
-          front = true;
+          set_min_vruntime (&busiest->rq);
+          self->migrations += pulled;
         }
-        /* Updates the total stolen weight, then changes the stolen threads vruntime
-	       * to be relative to this cpu's ready queue.
-         */
-        stolenWeight += get_thread_weight (stolen); 
-        stolen->vruntime = stolen->vruntime - minVruntimeDiff;
-
-	      /* Preventing the stolen thread's runtime from being negative. */
-        if (stolen->vruntime < 0)
-          stolen->vruntime = 0;
-        
-        /* Save the stolen thread. */
-        list_push_front(&self->rq.ready_list, &stolen->elem);
-
-      }
-      /* Since the min runtime thread could have been stolen, update the victim's
-       * min vruntime.
-       */
-      set_min_vruntime(&max->rq);
     }
-    /* Finally, since thieving is done, release the victim's spinlock. */
-    spinlock_release(&max->rq.lock);
-  }
-  /* Release own spinlock here (rather than the above if, since 
-   * max could equal Null. Aka if no max ready queue was found (all zero).
-   */
-  spinlock_release(&self->rq.lock);
+
+  spinlock_release (&second->rq.lock);
+  spinlock_release (&first->rq.lock);
+  return pulled > 0;
 }
 
 /* Idle thread.  Executes when no other thread is ready to run.
@@ -654,10 +698,8 @@ idle (void *idle_started_ UNUSED)
 
       /* An CPU should not go idle if there are ready threads
        * in other CPUs' ready queues that are not running.
-       *
-       * The baseline implementation does not ensure this.
        */
-      //balance_load ();
+      balance_load ();
       thread_block (NULL);
 
       /* Re-enable interrupts and wait for the next one.
@@ -860,6 +902,7 @@ schedule (void)
   ASSERT (cur->status != THREAD_RUNNING);
   ASSERT (is_thread (next));
   int intena = get_cpu ()->intena;      /* Save current value of intena. */
+  update_tick (cur, next);
   if (cur != next)
     {
       get_cpu ()->cs++;
@@ -876,9 +919,79 @@ static tid_t
 allocate_tid (void)
 {
   static tid_t next_tid = 0;
-  return atomic_inci (&next_tid);
+  return atomic_fetch_add_explicit (&next_tid, 1, ATOMIC_RELAXED) + 1;
 }
 
 /* Offset of `stack' member within `struct thread'.
    Used by switch.S, which can't figure it out on its own. */
 uint32_t thread_stack_ofs = offsetof(struct thread, stack);
+
+/* Charges CNT ticks on C to thread T in the CPU statistics. */
+static void
+account_ticks (struct cpu *c, struct thread *t, uint64_t cnt)
+{
+  if (t == c->rq.idle_thread)
+    c->idle_ticks += cnt;
+#ifdef USERPROG
+  else if (t->pagedir != NULL)
+    c->user_ticks += cnt;
+#endif
+  else
+    c->kernel_ticks += cnt;
+}
+
+/* Starts or stops this CPU's tick for running NEXT after CUR.
+   The scheduler needs the tick only to end NEXT's time slice, so
+   an idle CPU, or one with no other thread to switch to, can do
+   without it.  Ticks missed while the tick was stopped are
+   charged to CUR, which ran during them.  This CPU's ready queue
+   must be locked, so that a thread added to it by another CPU
+   either sees the tick stopped and calls notify_cpu(), or is seen
+   here. */
+static void
+update_tick (struct thread *cur, struct thread *next)
+{
+  struct cpu *c = get_cpu ();
+
+  ASSERT (spinlock_held_by_current_cpu (&c->rq.lock));
+
+  int64_t missed = timer_missed_ticks (c);
+  if (missed > 0)
+    {
+      account_ticks (c, cur, missed);
+      timer_account_missed (missed);
+    }
+
+  if (next != c->rq.idle_thread && c->rq.nr_ready > 0)
+    timer_start_tick ();
+  else
+    timer_stop_tick ();
+}
+
+/* Makes CPU C notice a thread just added to its ready queue,
+   which must be locked, even if C's tick is stopped. */
+static void
+notify_cpu (struct cpu *c)
+{
+  if (!c->tick_stopped)
+    return;
+  if (c == get_cpu ())
+    update_tick (running_thread (), running_thread ());
+  else
+    lapic_send_ipi_to (IPI_TICK, c->id);
+}
+
+/* Wakes up one idle CPU whose tick is stopped, so that it runs
+   its idle loop and pulls work from busier CPUs. */
+static void
+kick_idle_cpu (void)
+{
+  struct cpu *self = get_cpu ();
+  for (struct cpu *c = cpus; c < cpus + ncpu; c++)
+    if (c != self && atomic_load_relaxed (&c->tick_stopped)
+        && atomic_load_relaxed (&c->rq.curr) == NULL)
+      {
+        lapic_send_ipi_to (IPI_TICK, c->id);
+        return;
+      }
+}
@@ -3,6 +3,7 @@
 
 #include <debug.h>
 #include <list.h>
+#include <rbtree.h>
 #include <stdint.h>
 #include "filesys/file.h"
 #include "threads/synch.h"
@@ -25,7 +26,6 @@ typedef int tid_t;
 #define NICE_MIN -20                    /* Highest priority. */
 #define NICE_DEFAULT 0                  /* Default priority. */
 #define NICE_MAX 19                     /* Lowest priority. */
-#define FD_MAX 1024                     /* File descriptor capacity per process */
 
 /* Share data between the parent and the child process. */
 struct maternal_bond 
@@ -97,12 +97,9 @@ struct maternal_bond
    the `magic' member of the running thread's `struct thread' is
    set to THREAD_MAGIC.  Stack overflow will normally change this
    value, triggering the assertion. */
-/* The `elem' member has a dual purpose.  It can be an element in
-   the run queue (thread.c), or it can be an element in a
-   semaphore wait list (synch.c).  It can be used these two ways
-   only because they are mutually exclusive: only a thread in the
-   ready state is on the run queue, whereas only a thread in the
-   blocked state is on a semaphore wait list. */
+/* The `elem' member is an element in a semaphore wait list
+   (synch.c).  A thread in the ready state is kept in its CPU's
+   ready queue through `rq_elem' instead (scheduler.c). */
 
 struct thread
 {
@@ -131,6 +128,7 @@ struct thread
   
   /* OUR CODE */
   /* Used for CFS in scheduler.c */
+  struct rb_elem rq_elem; /* Element in the ready queue's tree. */
   int64_t vruntime; /* Virtual Runtime */
   /* CPU consumption */
   int64_t timer_start; /* The start of CPU consumption */
@@ -144,13 +142,16 @@ struct thread
   struct file *exec_file; /* Executable file that the current process 
                         is executing. */
   /* Used for syscall.c */
-  struct file **fd_table; /* file descriptor table */
+  struct fd_table *fd_table; /* file descriptor table */
 
   /* File name for syscalls that uses them */
   char *syscall_arg;
 
   struct dir *current_dir; /* Current working directory. */
+  int journal_depth;       /* Nesting of journal handles. */
+  int journal_credits;     /* Blocks the handle may still log. */
 
+  uintptr_t heap_start; /* Start of the heap, right after the BSS. */
   uintptr_t heap_end; /* Keep track of end of the heap. */
 
   int errno;    /* Record system error number. */
@@ -163,6 +164,9 @@ void thread_init (void);
 void thread_init_on_ap (void);
 void thread_start_idle_thread (void);
 void thread_tick (void);
+void thread_update_tick (void);
+struct cpu;
+uint64_t thread_idle_ticks (const struct cpu *);
 void thread_print_stats (void);
 
 typedef void thread_func (void *aux);
@@ -0,0 +1,228 @@
+#include "userprog/fd-table.h"
+#include <debug.h>
+#include <stdint.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "filesys/directory.h"
+#include "threads/malloc.h"
+#include <user/errno.h>
+
+#define FD_INLINE 16                    /* Slots available before growing. */
+#define FD_WORD_BITS 32                 /* Bits in one word of the bitmap. */
+#define FD_WORDS (FD_MAX / FD_WORD_BITS)
+
+/* A per-process file descriptor table.
+
+   Most processes only ever use a handful of descriptors, so the
+   slots start out inside the table itself and move to a larger
+   heap array only when a descriptor beyond FD_INLINE is needed.
+
+   Open descriptors are tracked by a two-level bitmap: bit FD of
+   USED is set when FD is open, and bit W of FULL_WORDS is set
+   when word W of USED has no free bit left.  Finding the lowest
+   free descriptor therefore takes two bit scans regardless of
+   how many descriptors are open. */
+struct fd_table
+  {
+    struct file **files;                /* FILES[fd], for fd < CAPACITY. */
+    int capacity;                       /* Number of slots in FILES. */
+    uint32_t full_words;                /* Words of USED that are full. */
+    uint32_t used[FD_WORDS];            /* Open descriptors. */
+    struct file *inline_files[FD_INLINE]; /* Initial slots. */
+  };
+
+static bool grow (struct fd_table *, int fd);
+static int lowest_free_fd (const struct fd_table *);
+static void mark_used (struct fd_table *, int fd);
+static void mark_free (struct fd_table *, int fd);
+
+/* Creates and returns an empty file descriptor table.
+   Returns a null pointer if memory allocation fails. */
+struct fd_table *
+fd_table_create (void)
+{
+  /* FULL_WORDS must have one bit per word of USED. */
+  ASSERT (FD_WORDS <= FD_WORD_BITS);
+
+  struct fd_table *table = calloc (1, sizeof *table);
+  if (table == NULL)
+    return NULL;
+
+  table->files = table->inline_files;
+  table->capacity = FD_INLINE;
+  return table;
+}
+
+/* Creates a copy of PARENT in which every open descriptor refers
+   to the same open file description as in PARENT.
+   Returns a null pointer if memory allocation fails. */
+struct fd_table *
+fd_table_copy (struct fd_table *parent)
+{
+  struct fd_table *table = fd_table_create ();
+  if (table == NULL)
+    return NULL;
+
+  if (parent->capacity > table->capacity
+      && !grow (table, parent->capacity - 1))
+    {
+      free (table);
+      return NULL;
+    }
+
+  for (int w = 0; w < FD_WORDS; w++)
+    {
+      uint32_t bits = parent->used[w];
+      while (bits != 0)
+        {
+          int fd = w * FD_WORD_BITS + __builtin_ctz (bits);
+          bits &= bits - 1;
+          table->files[fd] = file_dup (parent->files[fd]);
+        }
+    }
+  memcpy (table->used, parent->used, sizeof table->used);
+  table->full_words = parent->full_words;
+
+  return table;
+}
+
+/* Closes every open descriptor in TABLE and frees it. */
+void
+fd_table_destroy (struct fd_table *table)
+{
+  if (table == NULL)
+    return;
+
+  for (int w = 0; w < FD_WORDS; w++)
+    {
+      uint32_t bits = table->used[w];
+      while (bits != 0)
+        {
+          int fd = w * FD_WORD_BITS + __builtin_ctz (bits);
+          bits &= bits - 1;
+          dir_close (file_get_directory (table->files[fd]));
+          file_close (table->files[fd]);
+        }
+    }
+
+  if (table->files != table->inline_files)
+    free (table->files);
+  free (table);
+}
+
+/* Installs FILE at the lowest free descriptor of TABLE and
+   returns the descriptor, or -EMFILE if no descriptor can be
+   allocated. */
+int
+fd_table_install (struct fd_table *table, struct file *file)
+{
+  ASSERT (file != NULL);
+
+  int fd = lowest_free_fd (table);
+  if (fd < 0 || (fd >= table->capacity && !grow (table, fd)))
+    return -EMFILE;
+
+  table->files[fd] = file;
+  mark_used (table, fd);
+  return fd;
+}
+
+/* Installs FILE at descriptor FD of TABLE, which must be free.
+   Returns false if FD is out of range or memory allocation
+   fails. */
+bool
+fd_table_install_at (struct fd_table *table, int fd, struct file *file)
+{
+  if (fd < 0 || fd >= FD_MAX)
+    return false;
+  if (fd >= table->capacity && !grow (table, fd))
+    return false;
+
+  ASSERT (table->files[fd] == NULL);
+  table->files[fd] = file;
+  if (file != NULL)
+    mark_used (table, fd);
+  return true;
+}
+
+/* Returns the file open at descriptor FD of TABLE, or a null
+   pointer if FD is not open. */
+struct file *
+fd_table_get (struct fd_table *table, int fd)
+{
+  if (table == NULL || fd < 0 || fd >= table->capacity)
+    return NULL;
+
+  return table->files[fd];
+}
+
+/* Frees descriptor FD of TABLE and returns the file that was
+   open there, or a null pointer if FD was not open.  The caller
+   is responsible for closing the file. */
+struct file *
+fd_table_remove (struct fd_table *table, int fd)
+{
+  struct file *file = fd_table_get (table, fd);
+  if (file != NULL)
+    {
+      table->files[fd] = NULL;
+      mark_free (table, fd);
+    }
+  return file;
+}
+
+/* Grows the slot array of TABLE so that it can hold FD.
+   Returns false if memory allocation fails. */
+static bool
+grow (struct fd_table *table, int fd)
+{
+  ASSERT (fd < FD_MAX);
+
+  int capacity = table->capacity;
+  while (capacity <= fd)
+    capacity *= 2;
+  if (capacity > FD_MAX)
+    capacity = FD_MAX;
+
+  struct file **files = calloc (capacity, sizeof *files);
+  if (files == NULL)
+    return false;
+
+  memcpy (files, table->files, table->capacity * sizeof *files);
+  if (table->files != table->inline_files)
+    free (table->files);
+  table->files = files;
+  table->capacity = capacity;
+  return true;
+}
+
+/* Returns the lowest free descriptor in TABLE, or -1 if all
+   FD_MAX descriptors are open. */
+static int
+lowest_free_fd (const struct fd_table *table)
+{
+  if (table->full_words == UINT32_MAX)
+    return -1;
+
+  int w = __builtin_ctz (~table->full_words);
+  return w * FD_WORD_BITS + __builtin_ctz (~table->used[w]);
+}
+
+/* Marks FD as open in TABLE's bitmap. */
+static void
+mark_used (struct fd_table *table, int fd)
+{
+  int w = fd / FD_WORD_BITS;
+  table->used[w] |= 1u << (fd % FD_WORD_BITS);
+  if (table->used[w] == UINT32_MAX)
+    table->full_words |= 1u << w;
+}
+
+/* Marks FD as free in TABLE's bitmap. */
+static void
+mark_free (struct fd_table *table, int fd)
+{
+  int w = fd / FD_WORD_BITS;
+  table->used[w] &= ~(1u << (fd % FD_WORD_BITS));
+  table->full_words &= ~(1u << w);
+}
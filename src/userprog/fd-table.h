@@ -0,0 +1,20 @@
+#ifndef USERPROG_FD_TABLE_H
+#define USERPROG_FD_TABLE_H
+
+#include <stdbool.h>
+
+#define FD_MAX 1024                     /* File descriptor capacity per process */
+
+struct file;
+struct fd_table;
+
+struct fd_table *fd_table_create (void);
+struct fd_table *fd_table_copy (struct fd_table *);
+void fd_table_destroy (struct fd_table *);
+
+int fd_table_install (struct fd_table *, struct file *);
+bool fd_table_install_at (struct fd_table *, int fd, struct file *);
+struct file *fd_table_get (struct fd_table *, int fd);
+struct file *fd_table_remove (struct fd_table *, int fd);
+
+#endif /* userprog/fd-table.h */
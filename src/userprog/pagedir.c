@@ -3,6 +3,7 @@
 #include <stddef.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
@@ -12,8 +13,12 @@
 #include "lib/atomic-ops.h"
 
 static uint32_t *active_pd (void);
-static void invalidate_pagedir (uint32_t *);
-static void invalidate_pagedir_others (uint32_t *pd);
+static void invalidate_pages (uint32_t *pd, const void *const *pages,
+                              size_t cnt);
+static void flush_tlb (uint32_t *pd, const void *const *pages, size_t cnt);
+static void invalidate_pages_on (unsigned int targets, int target_cnt,
+                                 uint32_t *pd, const void *const *pages,
+                                 size_t cnt);
 
 /* Creates a new page directory that has mappings for kernel
    virtual addresses, but none for user virtual addresses.
@@ -220,11 +225,44 @@ pagedir_clear_page (uint32_t *pd, void *upage)
   pte = lookup_page (pd, upage, false);
   if (pte != NULL && (*pte & PTE_P) != 0)
     {
+      const void *page = upage;
       *pte &= ~PTE_P;
-      invalidate_pagedir (pd);
+      invalidate_pages (pd, &page, 1);
     }
 }
 
+/* Marks the PAGE_CNT user virtual pages starting at UPAGE "not
+   present" in page directory PD, like pagedir_clear_page(), but
+   invalidates the TLB entries of all of them at once, with at
+   most one round of inter-processor interrupts.
+   The pages need not be mapped. */
+void
+pagedir_clear_pages (uint32_t *pd, void *upage, size_t page_cnt)
+{
+  const void *pages[TLB_FLUSH_MAX_PAGES];
+  size_t cnt = 0;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (is_user_vaddr (upage));
+  ASSERT (page_cnt <= (size_t) ((uint8_t *) PHYS_BASE
+                                - (uint8_t *) upage) / PGSIZE);
+
+  for (size_t i = 0; i < page_cnt; i++)
+    {
+      uint8_t *page = (uint8_t *) upage + i * PGSIZE;
+      uint32_t *pte = lookup_page (pd, page, false);
+      if (pte != NULL && (*pte & PTE_P) != 0)
+        {
+          *pte &= ~PTE_P;
+          if (cnt < TLB_FLUSH_MAX_PAGES)
+            pages[cnt] = page;
+          cnt++;
+        }
+    }
+  if (cnt > 0)
+    invalidate_pages (pd, pages, cnt);
+}
+
 /* Returns true if the PTE for virtual page VPAGE in PD is dirty,
    that is, if the page has been modified since the PTE was
    installed.
@@ -249,7 +287,7 @@ pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty)
       else 
         {
           *pte &= ~(uint32_t) PTE_D;
-          invalidate_pagedir (pd);
+          invalidate_pages (pd, &vpage, 1);
         }
     }
 }
@@ -278,7 +316,7 @@ pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed)
       else 
         {
           *pte &= ~(uint32_t) PTE_A; 
-          invalidate_pagedir (pd);
+          invalidate_pages (pd, &vpage, 1);
         }
     }
 }
@@ -291,12 +329,21 @@ pagedir_activate (uint32_t *pd)
   if (pd == NULL)
     pd = init_page_dir;
 
+  /* Record that PD is active on this CPU before loading it.  A
+     CPU that changes PD's page tables at the same time either
+     sees the record and invalidates our TLB, or made its changes
+     before we load CR3, which is serializing, so that our TLB
+     only ever sees the new entries.  See invalidate_pages(). */
+  intr_disable_push ();
+  atomic_store_relaxed (&get_cpu ()->pagedir, pd);
+
   /* Store the physical address of the page directory into CR3
      aka PDBR (page directory base register).  This activates our
      new page tables immediately.  See [IA32-v2a] "MOV--Move
      to/from Control Registers" and [IA32-v3a] 3.7.5 "Base
      Address of the Page Directory". */
   lcr3 (vtop (pd));
+  intr_enable_pop ();
 }
 
 /* Returns the currently active page directory. */
@@ -314,36 +361,67 @@ active_pd (void)
 
 /* Some page table changes can cause the CPU's translation
    lookaside buffer (TLB) to become out-of-sync with the page
-   table.  When this happens, we have to "invalidate" the TLB by
-   re-activating it.
+   table.  When this happens, we have to "invalidate" the TLB
+   entries of the changed pages.
+
+   This function invalidates the entries of the CNT pages in
+   PAGES on every CPU on which PD is active, that is, this CPU
+   and the CPUs that other threads of PD's process are running
+   on.  (If PD is not active on a CPU then its entries are not in
+   that CPU's TLB, because loading another page directory flushed
+   them.)  If CNT exceeds TLB_FLUSH_MAX_PAGES, the whole TLB is
+   flushed instead, and only the first TLB_FLUSH_MAX_PAGES
+   elements of PAGES are used. */
+static void
+invalidate_pages (uint32_t *pd, const void *const *pages, size_t cnt)
+{
+  unsigned int targets = 0;
+  int target_cnt = 0;
+
+  /* Make our page table changes visible before looking for the
+     CPUs that may have cached the old entries.  See
+     pagedir_activate(). */
+  smp_barrier ();
 
-   This function invalidates the TLB if PD is the active page
-   directory.  (If PD is not active then its entries are not in
-   the TLB, so there is no need to invalidate anything.) */
+  intr_disable_push ();
+  struct cpu *self = get_cpu ();
+  if (active_pd () == pd)
+    flush_tlb (pd, pages, cnt);
+  for (unsigned int i = 0; i < ncpu; i++)
+    if (&cpus[i] != self && atomic_load_relaxed (&cpus[i].pagedir) == pd)
+      {
+        targets |= 1u << i;
+        target_cnt++;
+      }
+  intr_enable_pop ();
+
+  if (target_cnt == 0)
+    return;
+  invalidate_pages_on (targets, target_cnt, pd, pages, cnt);
+}
+
+/* Invalidates the TLB entries of the CNT pages in PAGES of page
+   directory PD, if it is active, on this CPU.  See
+   invalidate_pages(). */
 static void
-invalidate_pagedir (uint32_t *pd) 
+flush_tlb (uint32_t *pd, const void *const *pages, size_t cnt)
 {
-  if (active_pd () == pd) 
+  if (cnt > TLB_FLUSH_MAX_PAGES)
     {
-      /* Re-activating PD clears the TLB.  See [IA32-v3a] 3.12
+      /* Reloading CR3 clears the TLB.  See [IA32-v3a] 3.12
          "Translation Lookaside Buffers (TLBs)". */
-      pagedir_activate (pd);
-    } 
-  else
-    {
-      /* The PD is not active on the current CPU, but it could be
-         active on other CPUs.  Inform the other CPUs that they
-         need to invalidate any TLB entries related to this PD.
-         If Pintos supported multi-threaded processes, this PD
-         could be active on both this and other CPUs.
-       */
-      invalidate_pagedir_others (pd);
+      lcr3 (vtop (pd));
     }
+  else
+    for (size_t i = 0; i < cnt; i++)
+      invlpg (pages[i]);
 }
 
 static struct {
   struct lock lock; /* only owner of this lock can initiate TLB flush. */
   uint32_t *pd;     /* pagedir to be invalidated */
+  size_t page_cnt;  /* number of pages to be invalidated */
+  const void *pages[TLB_FLUSH_MAX_PAGES]; /* pages to be invalidated */
   int remaining;    /* remaining number of CPUs that must acknowledge IPI_TLB */
 } tlb_flush_state;
 
@@ -354,30 +432,46 @@ pagedir_init (void)
   lock_init (&tlb_flush_state.lock);
 }
 
+/* Has the CPUs in TARGETS, a set of TARGET_CNT indexes into
+   cpus[], invalidate the CNT pages in PAGES of PD, and waits
+   until they have done so. */
 static void
-invalidate_pagedir_others (uint32_t *pd)
+invalidate_pages_on (unsigned int targets, int target_cnt, uint32_t *pd,
+                     const void *const *pages, size_t cnt)
 {
   lock_acquire (&tlb_flush_state.lock);
-  tlb_flush_state.remaining = ncpu - 1;
   tlb_flush_state.pd = pd;
-  smp_barrier ();
-  lapic_send_ipi_to_all_but_self (IPI_TLB);
+  tlb_flush_state.page_cnt = cnt;
+  for (size_t i = 0; i < cnt && i < TLB_FLUSH_MAX_PAGES; i++)
+    tlb_flush_state.pages[i] = pages[i];
+
+  /* Publishes the request.  The IPIs cannot overtake it, because
+     x86 does not reorder stores, including those to the local
+     APIC. */
+  atomic_store_release (&tlb_flush_state.remaining, target_cnt);
+  for (unsigned int i = 0; i < ncpu; i++)
+    if (targets & (1u << i))
+      lapic_send_ipi_to (IPI_TLB, cpus[i].id);
 
   /* We busy-wait here rather than blocking the calling thread
      because we expect to be spinning for a short time only. */
-  while (atomic_load (&tlb_flush_state.remaining) > 0)
-    ;
+  while (atomic_load_acquire (&tlb_flush_state.remaining) > 0)
+    cpu_relax ();
   lock_release (&tlb_flush_state.lock);
 }
 
 /* This method will be called from the IPI TLB_FLUSH interrupt
    handler on CPUs to which a request to flush their TLB was sent.
+   By the time the request arrives, the CPU may have switched to
+   another page directory, which needs no flushing.
  */
 void
 pagedir_handle_tlbflush_request (void)
 {
-  if (active_pd () == tlb_flush_state.pd)
-    pagedir_activate (active_pd ());
+  uint32_t *pd = active_pd ();
+  if (pd == tlb_flush_state.pd)
+    flush_tlb (pd, tlb_flush_state.pages, tlb_flush_state.page_cnt);
 
-  atomic_deci (&tlb_flush_state.remaining);
+  /* Orders the flush before the acknowledgement. */
+  atomic_fetch_sub_explicit (&tlb_flush_state.remaining, 1, ATOMIC_RELEASE);
 }
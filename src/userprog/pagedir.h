@@ -2,8 +2,14 @@
 #define USERPROG_PAGEDIR_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+/* Invalidating more pages than this at once flushes the whole
+   TLB instead, since invalidating them one by one would cost more
+   than refilling the TLB. */
+#define TLB_FLUSH_MAX_PAGES 32
+
 void pagedir_init (void);
 uint32_t *pagedir_create (void);
 uint32_t *pagedir_copy (uint32_t *pd);
@@ -11,6 +17,7 @@ void pagedir_destroy (uint32_t *pd);
 bool pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool rw);
 void *pagedir_get_page (uint32_t *pd, const void *upage);
 void pagedir_clear_page (uint32_t *pd, void *upage);
+void pagedir_clear_pages (uint32_t *pd, void *upage, size_t page_cnt);
 bool pagedir_is_dirty (uint32_t *pd, const void *upage);
 void pagedir_set_dirty (uint32_t *pd, const void *upage, bool dirty);
 bool pagedir_is_accessed (uint32_t *pd, const void *upage);
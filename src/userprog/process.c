@@ -8,6 +8,7 @@
 #include <string.h>
 #include "threads/gdt.h"
 #include "userprog/pagedir.h"
+#include "userprog/fd-table.h"
 #include "threads/tss.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
@@ -305,16 +306,8 @@ process_exit (void)
   printf("%s: exit(%d)\n", cur->name, status);
 
   /* Closes all open file descriptors and free the fd table. */
-  struct file **fd_table = cur->fd_table;
-  for (int fd = 0; fd < FD_MAX; fd++)
-    {
-      if (fd_table[fd] != NULL)
-        {
-          dir_close (file_get_directory (fd_table[fd]));
-          file_close (fd_table[fd]);
-        }
-    }
-  palloc_free_page (cur->fd_table);
+  fd_table_destroy (cur->fd_table);
+  cur->fd_table = NULL;
 
   /* Close the executable that was running on exiting process.
      This re-enable the write permission. */
@@ -543,7 +536,7 @@ load (const char *file_name, void (**eip) (void), void **esp)
 
   /* Set the start of the heap right after the end of BSS. */
   heap_start += PGSIZE;
-  t->heap_end = heap_start;
+  t->heap_start = t->heap_end = heap_start;
 
   /* Set up stack. */
   if (!setup_stack (esp))
@@ -10,6 +10,7 @@
 #include <devices/input.h>
 #include <lib/kernel/stdio.h>
 #include <userprog/process.h>
+#include "userprog/fd-table.h"
 #include <devices/shutdown.h>
 
 #include <threads/vaddr.h>
@@ -23,11 +24,14 @@
 #include "vm/mem.h"
 #include <user/errno.h>
 #include "devices/timer.h"
+#include <limits.h>
+#include <round.h>
 
 #define WORD_SIZE 4
 #define SYSCALL1 WORD_SIZE 
 #define SYSCALL2 (WORD_SIZE * 2)
 #define SYSCALL3 (WORD_SIZE * 3)
+#define SYSCALL4 (WORD_SIZE * 4)
 
 static void syscall_handler (struct intr_frame *);
 
@@ -56,6 +60,13 @@ static void sys_exec2 (const char *cmd_line);
 static uintptr_t sys_sbrk (intptr_t increment);
 static int64_t sys_times (void);
 static void sys_sleep (int64_t ticks);
+static int sys_readv (int fd, const struct iovec *iov, int iovcnt);
+static int sys_writev (int fd, const struct iovec *iov, int iovcnt);
+static int sys_pread (int fd, void *buffer, unsigned size, unsigned offset);
+static int sys_getdents (int fd, void *buffer, unsigned size);
+static int sys_fsync (int fd, bool data_only);
+static int sys_pwrite (int fd, const void *buffer, unsigned size,
+                       unsigned offset);
 
 static struct file *get_file_from_fd (int fd);
 static int set_next_fd (struct file *file);
@@ -64,6 +75,8 @@ static void validate_buffer (void *buffer, unsigned size);
 static int get_user (const uint8_t *uaddr);
 static void copy_from_user (void *to, const void *user, size_t bytes);
 static void str_copy_from_user (char *dst, const char *user);
+static int iovec_copy_from_user (struct iovec *dst, const struct iovec *user,
+                                 int iovcnt);
 
 
 void
@@ -78,7 +91,7 @@ syscall_handler (struct intr_frame *f)
   int syscall_number;
   copy_from_user (&syscall_number, f->esp, WORD_SIZE);
   
-  int args[3];  /* Array holding maximum of 3 arguments. */
+  int args[4];  /* Array holding maximum of 4 arguments. */
   void *stack_arg_addr = f->esp + WORD_SIZE; /* Starting address of the arguments
                                                 in stack */
   struct thread *cur = thread_current ();
@@ -252,6 +265,50 @@ syscall_handler (struct intr_frame *f)
           sys_sleep (args[0]);
           break;
         }
+      case SYS_READV:
+      case SYS_WRITEV:
+        {
+          copy_from_user (&args, stack_arg_addr, SYSCALL3);
+          /* Copy the whole iovec array in a single pass. */
+          struct iovec *iov = (struct iovec *) cur->syscall_arg;
+          int error = iovec_copy_from_user (iov, (struct iovec *) args[1],
+                                            args[2]);
+          if (error)
+            f->eax = -error;
+          else if (syscall_number == SYS_READV)
+            f->eax = sys_readv (args[0], iov, args[2]);
+          else
+            f->eax = sys_writev (args[0], iov, args[2]);
+          break;
+        }
+      case SYS_PREAD:
+        {
+          copy_from_user (&args, stack_arg_addr, SYSCALL4);
+          validate_buffer ((void *) args[1], args[2]);
+          f->eax = sys_pread (args[0], (char *) args[1], args[2], args[3]);
+          break;
+        }
+      case SYS_PWRITE:
+        {
+          copy_from_user (&args, stack_arg_addr, SYSCALL4);
+          validate_buffer ((void *) args[1], args[2]);
+          f->eax = sys_pwrite (args[0], (char *) args[1], args[2], args[3]);
+          break;
+        }
+      case SYS_GETDENTS:
+        {
+          copy_from_user (&args, stack_arg_addr, SYSCALL3);
+          validate_buffer ((void *) args[1], args[2]);
+          f->eax = sys_getdents (args[0], (void *) args[1], args[2]);
+          break;
+        }
+      case SYS_FSYNC:
+      case SYS_FDATASYNC:
+        {
+          copy_from_user (&args, stack_arg_addr, SYSCALL1);
+          f->eax = sys_fsync (args[0], syscall_number == SYS_FDATASYNC);
+          break;
+        }
     }
   
   palloc_free_page (cur->syscall_arg);
@@ -316,6 +373,31 @@ str_copy_from_user (char *dst, const char *user)
   copy[index] = '\0';
 }
 
+/* Copies IOVCNT iovec entries from user into DST, which must
+   have room for IOV_MAX entries, and validates every buffer they
+   describe.  Returns 0 if successful, or the error number
+   specified in errno.h if IOVCNT or the total length is invalid. */
+static int
+iovec_copy_from_user (struct iovec *dst, const struct iovec *user, int iovcnt)
+{
+  if (iovcnt < 0 || iovcnt > IOV_MAX)
+    return EINVAL;
+
+  copy_from_user (dst, user, iovcnt * sizeof *dst);
+
+  /* The total length must fit in the return value. */
+  size_t total = 0;
+  for (int i = 0; i < iovcnt; i++)
+    {
+      if (dst[i].iov_len > INT_MAX - total)
+        return EINVAL;
+      total += dst[i].iov_len;
+      validate_buffer (dst[i].iov_base, dst[i].iov_len);
+    }
+
+  return 0;
+}
+
 /* Checks if the given buffer span over the valid address range. */
 static void
 validate_buffer (void *buffer, unsigned size)
@@ -467,43 +549,28 @@ sys_tell(int fd)
 static void
 sys_close(int fd)
 {
-  struct thread *cur = thread_current ();
-  struct file *file = get_file_from_fd (fd);
+  struct file *file = fd_table_remove (thread_current ()->fd_table, fd);
   if (file == NULL)
     return;
  
   dir_close (file_get_directory (file));
   file_close (file);
-  cur->fd_table[fd] = NULL;
 }
 
 /* Obtains a file from file descriptor */
 static struct file *
 get_file_from_fd (int fd)
 {
-  if (fd < 0 || fd >= FD_MAX)
-    return NULL;
-
-  return thread_current ()->fd_table[fd];
+  return fd_table_get (thread_current ()->fd_table, fd);
 }
 
-/* Finds the next available file descriptor mapping and
- * sets the values within it. Also checks if the file
- * can be written into. */
+/* Maps the file to the lowest available file descriptor.
+   Returns the file descriptor, or -EMFILE if the per-process
+   limit on the number of open file descriptors has been reached. */
 static int
 set_next_fd (struct file *file)
 {
-  struct file **fd_table = thread_current ()->fd_table;
-
-  for (int fd = 0; fd < FD_MAX; fd++)
-    {
-      if (!fd_table[fd])
-        {
-          fd_table[fd] = file;
-          return fd;
-        } 
-    }
-  return -EMFILE;
+  return fd_table_install (thread_current ()->fd_table, file);
 }
 
 /* Changes the current working directory of the process to dir,
@@ -528,7 +595,7 @@ sys_chdir (const char *dir)
 static bool 
 sys_mkdir (const char *dir)
 {
-  return filesys_dir_create (dir, 0);
+  return filesys_dir_create (dir);
 }
 
 /* Reads a directory entry from file descriptor fd, which must represent
@@ -577,25 +644,34 @@ sys_fork (struct intr_frame *f)
 
 
 /* Allocates a new file descriptor NEW_FD that refers to the same
-   open file description as the OLD_FD. */
+   open file description as the OLD_FD.  A file already open at
+   NEW_FD is closed, but only once the duplicate is installed, so
+   that NEW_FD is unchanged if the call fails. */
 static int
 sys_dup2 (int old_fd, int new_fd)
 {
   struct file *file = get_file_from_fd (old_fd);
   if (file == NULL)
-    return -1;
+    return -EBADF;
   
   if (old_fd == new_fd)
     return new_fd;
+  if (new_fd < 0 || new_fd >= FD_MAX)
+    return -EBADF;
+
+  /* Duplicate file to new_fd.  Installing fails only if the
+     table has to grow, in which case NEW_FD was not open. */
+  struct fd_table *fd_table = thread_current ()->fd_table;
+  struct file *prev_file = fd_table_remove (fd_table, new_fd);
+  if (!fd_table_install_at (fd_table, new_fd, file_dup (file)))
+    {
+      file_close (file);
+      ASSERT (prev_file == NULL);
+      return -ENOMEM;
+    }
 
   /* Close previously opened file in new_fd. */
-  struct file *prev_file = get_file_from_fd (new_fd);
   file_close (prev_file);
-
-  /* Duplicate file to new_fd. */
-  struct thread *cur = thread_current();
-  cur->fd_table[new_fd] = file_dup (file);
-
   return new_fd;
 }
 
@@ -619,8 +695,13 @@ sys_pipe (int *pipefd)
   pipefd[0] = set_next_fd (read_end);
   pipefd[1] = set_next_fd (write_end);
   /* The per-process limit on the number of open fd has been reached. */
-  if (pipefd[0] == -1 || pipefd[1] == -1)
+  if (pipefd[0] < 0 || pipefd[1] < 0)
     {
+      struct fd_table *fd_table = thread_current ()->fd_table;
+      if (pipefd[0] >= 0)
+        fd_table_remove (fd_table, pipefd[0]);
+      if (pipefd[1] >= 0)
+        fd_table_remove (fd_table, pipefd[1]);
       file_close (read_end);
       file_close (write_end);
       return -1;
@@ -638,7 +719,7 @@ sys_exec2 (const char *cmd_line)
 
 /* Change the location of the program break.
    Increasing the program break has the effect of allocating memory
-   to the process. */
+   to the process, and decreasing it frees memory. */
 static uintptr_t 
 sys_sbrk (intptr_t increment)
 {
@@ -659,3 +740,148 @@ sys_sleep (int64_t ticks)
 {
   timer_sleep (ticks);
 }
+
+/* Reads from fd into the IOVCNT buffers described by IOV, filling
+   each buffer in order before moving on to the next one.
+   Returns the total number of bytes read, which is less than the
+   total length of the buffers only if end of file is reached. */
+static int
+sys_readv (int fd, const struct iovec *iov, int iovcnt)
+{
+  struct file *file = get_file_from_fd (fd);
+  int total = 0;
+
+  for (int i = 0; i < iovcnt; i++)
+    {
+      int read = file_read (file, iov[i].iov_base, iov[i].iov_len);
+      if (read < 0)
+        return total > 0 ? total : read;
+
+      total += read;
+      /* Stop at end of file (or at an empty pipe). */
+      if ((size_t) read < iov[i].iov_len)
+        break;
+    }
+
+  return total;
+}
+
+/* Writes the IOVCNT buffers described by IOV, in order, to fd.
+   Returns the total number of bytes written. */
+static int
+sys_writev (int fd, const struct iovec *iov, int iovcnt)
+{
+  struct file *file = get_file_from_fd (fd);
+  int total = 0;
+
+  for (int i = 0; i < iovcnt; i++)
+    {
+      int written = file_write (file, iov[i].iov_base, iov[i].iov_len);
+      if (written < 0)
+        return total > 0 ? total : written;
+
+      total += written;
+      if ((size_t) written < iov[i].iov_len)
+        break;
+    }
+
+  return total;
+}
+
+/* Reads SIZE bytes from fd into BUFFER, starting at byte OFFSET
+   of the file.  Unlike read, the file's position is neither used
+   nor updated, so processes sharing an open file do not race on
+   the position. */
+static int
+sys_pread (int fd, void *buffer, unsigned size, unsigned offset)
+{
+  struct file *file = get_file_from_fd (fd);
+  if ((int) offset < 0)
+    return -EINVAL;
+
+  return file_read_at (file, buffer, size, offset);
+}
+
+/* Writes SIZE bytes from BUFFER to fd, starting at byte OFFSET
+   of the file.  The file's position is unaffected. */
+static int
+sys_pwrite (int fd, const void *buffer, unsigned size, unsigned offset)
+{
+  struct file *file = get_file_from_fd (fd);
+  if ((int) offset < 0)
+    return -EINVAL;
+
+  return file_write_at (file, buffer, size, offset);
+}
+
+/* Progress of a getdents() call. */
+struct getdents_buf
+  {
+    uint8_t *buffer;            /* Start of the user buffer. */
+    unsigned size;              /* Size of the user buffer. */
+    unsigned used;              /* Bytes filled so far. */
+    bool full;                  /* An entry did not fit. */
+  };
+
+/* dir_filldir_func for sys_getdents().  Appends an entry to the
+   user buffer described by AUX if it fits. */
+static bool
+getdents_fill (const char *name, size_t len, block_sector_t inumber,
+               bool is_dir, void *aux)
+{
+  struct getdents_buf *buf = aux;
+  unsigned reclen = ROUND_UP (offsetof (struct dirent, d_name) + len + 1,
+                              sizeof (int));
+  if (reclen > buf->size - buf->used)
+    {
+      buf->full = true;
+      return false;
+    }
+
+  struct dirent *d = (struct dirent *) (buf->buffer + buf->used);
+  d->d_ino = inumber;
+  d->d_reclen = reclen;
+  d->d_type = is_dir ? DT_DIR : DT_REG;
+  memcpy (d->d_name, name, len);
+  d->d_name[len] = '\0';
+  buf->used += reclen;
+  return true;
+}
+
+/* Fills BUFFER, SIZE bytes long, with as many entries of the
+   directory open as fd as fit, continuing where the previous
+   readdir() or getdents() on the same open directory stopped.
+   Returns the number of bytes filled, 0 at the end of the
+   directory, or a negative error code; -EINVAL means that
+   BUFFER cannot hold even the next entry. */
+static int
+sys_getdents (int fd, void *buffer, unsigned size)
+{
+  struct file *file = get_file_from_fd (fd);
+  if (file == NULL)
+    return -EBADF;
+  if (file_get_directory (file) == NULL)
+    return -ENOTDIR;
+
+  struct getdents_buf buf = { buffer, size, 0, false };
+  dir_iterate (file_get_directory (file), getdents_fill, &buf);
+  if (buf.used == 0 && buf.full)
+    return -EINVAL;
+  return buf.used;
+}
+
+/* Writes the data of the file open as FD to disk.  Unless
+   DATA_ONLY is true, its metadata is written as well.
+   Returns 0 if successful, a negated error number otherwise. */
+static int
+sys_fsync (int fd, bool data_only)
+{
+  struct file *file = get_file_from_fd (fd);
+  if (file == NULL)
+    return -EBADF;
+  if (file_get_inode (file) == NULL)
+    return -EINVAL;
+
+  inode_sync (file_get_inode (file), data_only);
+  return 0;
+}
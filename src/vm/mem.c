@@ -5,23 +5,28 @@
 #include "threads/vaddr.h"
 #include "stdio.h"
 
+/* Heap pages unmapped with one TLB invalidation when the heap
+   shrinks. */
+#define SHRINK_BATCH 64
+
 static bool mem_install_page (void *upage, void *kpage);
+static bool mem_shrink (uintptr_t decrement);
 
 /* Change the location of the program break, which defines the
    end of the process's data segment. Increasing the program
    break has the effect of allocating memory to the process. 
    sbrk increments the program's data space by INCREMENT bytes.
    Calling sbrk with an INCREMENT of 0 can be used to find the
-   current location of the program break. */
+   current location of the program break.  A negative INCREMENT
+   shrinks the heap and frees the pages past the new break. */
 uintptr_t 
 mem_sbrk (intptr_t increment)
 {
-  /* Does not support heap shrinking. */
-  if (increment < 0)
-    return -1;
-
   struct thread *cur = thread_current ();
   uintptr_t prev_end = cur->heap_end;
+
+  if (increment < 0)
+    return mem_shrink (-(uintptr_t) increment) ? prev_end : (uintptr_t) -1;
   int size = increment;
 
   void *current_heap = pg_round_down ((void *) (cur->heap_end + increment));
@@ -58,6 +63,39 @@ mem_sbrk (intptr_t increment)
   return prev_end;
 }
 
+/* Moves the program break DECREMENT bytes down, unmapping and
+   freeing the heap pages that lie entirely past the new break.
+   Returns false, changing nothing, if the heap is smaller than
+   DECREMENT bytes. */
+static bool
+mem_shrink (uintptr_t decrement)
+{
+  struct thread *cur = thread_current ();
+  if (decrement > cur->heap_end - cur->heap_start)
+    return false;
+
+  uint8_t *upage = pg_round_up ((void *) (cur->heap_end - decrement));
+  uint8_t *end = pg_round_up ((void *) cur->heap_end);
+  while (upage < end)
+    {
+      void *kpages[SHRINK_BATCH];
+      size_t cnt = 0;
+
+      for (; cnt < SHRINK_BATCH && upage + cnt * PGSIZE < end; cnt++)
+        kpages[cnt] = pagedir_get_page (cur->pagedir, upage + cnt * PGSIZE);
+
+      /* Free the pages only once no CPU's TLB maps them anymore. */
+      pagedir_clear_pages (cur->pagedir, upage, cnt);
+      for (size_t i = 0; i < cnt; i++)
+        if (kpages[i] != NULL)
+          palloc_free_page (kpages[i]);
+      upage += cnt * PGSIZE;
+    }
+
+  cur->heap_end -= decrement;
+  return true;
+}
+
 /* Adds a mapping from user virtual address UPAGE to kernel
    virtual address KPAGE to the page table.
    The user process may modify the page.